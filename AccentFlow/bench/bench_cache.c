@@ -0,0 +1,75 @@
+#include "config.h"
+#include "config_cache.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Startup cost: parsing the JSON source against mapping the compiled cache image. */
+
+static int write_config(char *path, size_t mapping_count)
+{
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n  \"input_device\": \"auto\",\n  \"xkb_layout\": \"us\",\n");
+    for (size_t i = 0; i < mapping_count; ++i) {
+        fprintf(fp, "  \"k%zu\": [\"\xc3\xa9\", \"\xc3\xa8\", \"\xc3\xaa\", \"\xc3\xab\"]%s\n", i,
+                i + 1 < mapping_count ? "," : "");
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+    return 0;
+}
+
+static double time_loads(const char *source, const char *cache, int iterations)
+{
+    uint64_t start = monotonic_time_ns();
+    for (int i = 0; i < iterations; ++i) {
+        AccentConfig *config = cache ? config_cache_load(cache, source, NULL) : config_load(source, NULL);
+        if (!config) {
+            fprintf(stderr, "load failed\n");
+            exit(EXIT_FAILURE);
+        }
+        config_free(config);
+    }
+    return (double)(monotonic_time_ns() - start) / iterations / 1000.0;
+}
+
+static void run_size(size_t mapping_count, int iterations)
+{
+    char source[] = "/tmp/accentflow-bench-XXXXXX";
+    if (write_config(source, mapping_count) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    char cache[64];
+    snprintf(cache, sizeof(cache), "%s.cache", source);
+
+    char *error = NULL;
+    AccentConfig *config = config_load(source, &error);
+    if (!config || !config_cache_write(config, source, cache, &error)) {
+        fprintf(stderr, "setup failed: %s\n", error ? error : "unknown error");
+        exit(EXIT_FAILURE);
+    }
+    config_free(config);
+
+    double parse_us = time_loads(source, NULL, iterations);
+    double mapped_us = time_loads(source, cache, iterations);
+    printf("config/json     mappings=%-7zu %12.1f us/load\n", mapping_count, parse_us);
+    printf("config/cache    mappings=%-7zu %12.1f us/load\n", mapping_count, mapped_us);
+    unlink(cache);
+    unlink(source);
+}
+
+int main(void)
+{
+    /* Both sides compile "us" from the fixture, whatever the host's keyboard is. */
+    setenv("XKB_CONFIG_ROOT", "bench/xkb", 1);
+    run_size(100, 200);
+    run_size(10000, 20);
+    run_size(100000, 5);
+    return EXIT_SUCCESS;
+}
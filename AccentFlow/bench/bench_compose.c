@@ -0,0 +1,115 @@
+#include "compose.h"
+#include "config.h"
+#include "utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Compose table built from the system en_US.UTF-8 Compose file: load cost on top of a
+ * plain configuration, size of the trie, and the cost of one key step. */
+
+#define LOAD_ITERATIONS 10
+#define STEP_ITERATIONS 20000000
+
+static const uint32_t sequences[][3] = {
+    {'a', 'e', 0}, {'o', '/', 0}, {'\'', 'e', 0}, {'"', 'u', 0}, {'c', ',', 0},
+    {'-', '-', '-'}, {'<', '<', 0}, {'1', '2', 0}, {'s', 's', 0}, {'=', 'e', 0},
+};
+#define SEQUENCE_COUNT (sizeof(sequences) / sizeof(sequences[0]))
+
+static char *write_config(const char *compose_file)
+{
+    static char path[64];
+    snprintf(path, sizeof(path), "/tmp/accentflow-bench-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n");
+    if (compose_file) {
+        fprintf(fp, "  \"compose_file\": \"%s\",\n", compose_file);
+    }
+    fprintf(fp, "  \"e\": [\"\xc3\xa9\", \"\xc3\xa8\"]\n}\n");
+    fclose(fp);
+    return path;
+}
+
+static double best_load_ms(const char *compose_file, AccentConfig **kept)
+{
+    char *path = write_config(compose_file);
+    if (!path) {
+        exit(EXIT_FAILURE);
+    }
+    uint64_t best_ns = UINT64_MAX;
+    for (int i = 0; i < LOAD_ITERATIONS; ++i) {
+        uint64_t start = monotonic_time_ns();
+        AccentConfig *config = config_load(path, NULL);
+        uint64_t elapsed = monotonic_time_ns() - start;
+        if (!config) {
+            fprintf(stderr, "load failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (elapsed < best_ns) {
+            best_ns = elapsed;
+        }
+        if (i + 1 == LOAD_ITERATIONS && kept) {
+            *kept = config;
+        } else {
+            config_free(config);
+        }
+    }
+    unlink(path);
+    return (double)best_ns / 1e6;
+}
+
+int main(void)
+{
+    const char *compose_file = "%S/en_US.UTF-8/Compose";
+    AccentConfig *config = NULL;
+    double plain = best_load_ms(NULL, NULL);
+    double with_compose = best_load_ms(compose_file, &config);
+    const ComposeTable *table = config->compose;
+    if (!table) {
+        fprintf(stderr, "no compose table; is %s installed?\n", compose_file);
+        config_free(config);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < SEQUENCE_COUNT; ++i) {
+        uint32_t state = COMPOSE_START;
+        for (size_t j = 0; j < 3 && sequences[i][j]; ++j) {
+            state = compose_step(table, state, sequences[i][j]);
+        }
+        if (state == COMPOSE_NONE || !compose_result(table, state)) {
+            fprintf(stderr, "sequence %zu did not compose\n", i);
+            config_free(config);
+            return EXIT_FAILURE;
+        }
+    }
+
+    volatile uintptr_t sink = 0;
+    size_t keys = 0;
+    uint64_t start = monotonic_time_ns();
+    for (size_t i = 0; i < STEP_ITERATIONS; ++i) {
+        const uint32_t *sequence = sequences[i % SEQUENCE_COUNT];
+        uint32_t state = COMPOSE_START;
+        for (size_t j = 0; j < 3 && sequence[j]; ++j) {
+            state = compose_step(table, state, sequence[j]);
+            keys++;
+        }
+        sink += (uintptr_t)compose_result(table, state);
+    }
+    uint64_t step_ns = monotonic_time_ns() - start;
+
+    printf("compose/load    plain %8.2f ms   with en_US table %8.2f ms\n", plain, with_compose);
+    printf("compose/table   sequences=%zu states=%zu %zu KiB\n", compose_sequence_count(table),
+           compose_state_count(table), compose_table_bytes(table) / 1024);
+    printf("compose/step    %10.1f ns/key\n", (double)step_ns / (double)keys);
+    (void)sink;
+    config_free(config);
+    return EXIT_SUCCESS;
+}
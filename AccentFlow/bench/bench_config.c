@@ -0,0 +1,93 @@
+#include "config.h"
+#include "layout.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* config_load time for every min:/maj: preset shipped in files/ and for default.conf.
+ * Each load also compiles the keyboard layout, which is timed on its own first, as "us"
+ * so the figure does not depend on the host's keyboard. */
+
+#define BENCH_CONFIG_ITERATIONS 200
+
+static int load_preset(const char *path, const char *label)
+{
+    char *error = NULL;
+    AccentConfig *config = config_load(path, &error);
+    if (!config) {
+        fprintf(stderr, "%s: %s\n", path, error ? error : "unknown error");
+        free(error);
+        return -1;
+    }
+    size_t mapping_count = config->mapping_count;
+    config_free(config);
+
+    uint64_t start = monotonic_time_ns();
+    for (int i = 0; i < BENCH_CONFIG_ITERATIONS; ++i) {
+        config_free(config_load(path, NULL));
+    }
+    uint64_t elapsed = monotonic_time_ns() - start;
+
+    printf("config/preset   %-22s mappings=%-4zu %8.2f us/load\n", label, mapping_count,
+           (double)elapsed / BENCH_CONFIG_ITERATIONS / 1000.0);
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int main(int argc, char **argv)
+{
+    const char *directory = argc > 1 ? argv[1] : "../files";
+    const char *default_preset = argc > 2 ? argv[2] : "../default.conf";
+
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        fprintf(stderr, "Unable to open preset directory %s\n", directory);
+        return EXIT_FAILURE;
+    }
+    char *names[256];
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) && count < sizeof(names) / sizeof(names[0])) {
+        size_t length = strlen(entry->d_name);
+        if (length > 5 && strcmp(entry->d_name + length - 5, ".conf") == 0) {
+            names[count++] = duplicate_string(entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, count, sizeof(names[0]), compare_names);
+
+    static KeyboardLayout layout;
+    char error[256];
+    uint64_t start = monotonic_time_ns();
+    for (int i = 0; i < BENCH_CONFIG_ITERATIONS; ++i) {
+        if (!layout_compile(&layout, "us", NULL, error, sizeof(error))) {
+            layout_load_us(&layout);
+        }
+    }
+    printf("config/layout   %-22s %22.2f us/compile\n", "us",
+           (double)(monotonic_time_ns() - start) / BENCH_CONFIG_ITERATIONS / 1000.0);
+
+    int rc = EXIT_SUCCESS;
+    start = monotonic_time_ns();
+    for (size_t i = 0; i < count; ++i) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        if (load_preset(path, names[i]) < 0) {
+            rc = EXIT_FAILURE;
+        }
+        free(names[i]);
+    }
+    if (load_preset(default_preset, "default.conf (BOM)") < 0) {
+        rc = EXIT_FAILURE;
+    }
+    printf("config/preset   %zu presets checked in %.1f ms\n", count + 1,
+           (double)(monotonic_time_ns() - start) / 1e6);
+    return rc;
+}
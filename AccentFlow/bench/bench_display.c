@@ -0,0 +1,127 @@
+#include "config.h"
+#include "display.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Cost on the input thread of one preview update plus one log line while stderr is a pipe
+ * drained at 4 MB/s, as when journald falls behind: writing them directly against queuing
+ * them for the display and log threads. */
+
+#define UPDATE_ITERATIONS 20000
+#define READ_CHUNK 4096
+
+static _Atomic bool reader_fast;
+static _Atomic bool reader_stop;
+
+static void *slow_reader(void *userdata)
+{
+    int fd = *(int *)userdata;
+    char buffer[READ_CHUNK];
+    while (!atomic_load(&reader_stop)) {
+        if (read(fd, buffer, sizeof(buffer)) <= 0) {
+            break;
+        }
+        if (!atomic_load(&reader_fast)) {
+            struct timespec pause = {0, 1000000};
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+/* What log_info did before it had a thread of its own. */
+static void direct_log(const char *variant)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct tm tm;
+    localtime_r(&ts.tv_sec, &tm);
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+    flockfile(stderr);
+    fprintf(stderr, "%s.%03ld [INFO] ", buffer, ts.tv_nsec / 1000000L);
+    fprintf(stderr, "Committed variant '%s'", variant);
+    fputc('\n', stderr);
+    funlockfile(stderr);
+}
+
+static uint64_t samples[UPDATE_ITERATIONS];
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name)
+{
+    double mean = 0;
+    for (size_t i = 0; i < UPDATE_ITERATIONS; ++i) {
+        mean += (double)samples[i] / UPDATE_ITERATIONS;
+    }
+    qsort(samples, UPDATE_ITERATIONS, sizeof(samples[0]), compare_u64);
+    printf("display/%-7s %10.1f ns/update mean %10.1f ns p99 %10.1f us max\n", name, mean,
+           (double)samples[UPDATE_ITERATIONS * 99 / 100], (double)samples[UPDATE_ITERATIONS - 1] / 1e3);
+}
+
+int main(void)
+{
+    const char *variants[] = {"\xc3\xa9", "\xc3\xa8", "\xc3\xaa", "\xc3\xab"};
+    AccentMapping mapping;
+    memset(&mapping, 0, sizeof(mapping));
+    mapping.base = "e";
+    mapping.variants = (char **)variants;
+    mapping.variant_count = 4;
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return EXIT_FAILURE;
+    }
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(pipe_fds[1], STDERR_FILENO);
+    pthread_t reader;
+    pthread_create(&reader, NULL, slow_reader, &pipe_fds[0]);
+
+    for (size_t i = 0; i < UPDATE_ITERATIONS; ++i) {
+        uint64_t start = monotonic_time_ns();
+        fprintf(stderr, "\rAccentFlow e:  %s [%s] %s  %s ", variants[0], variants[i % 4], variants[2], variants[3]);
+        direct_log(variants[i % 4]);
+        samples[i] = monotonic_time_ns() - start;
+    }
+    report("direct");
+
+    log_set_rate_limit(0);
+    Display *display = display_create_tui();
+    if (!display || !log_start()) {
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < UPDATE_ITERATIONS; ++i) {
+        uint64_t start = monotonic_time_ns();
+        display_show_variants(display, "e", &mapping, i % 4);
+        log_info("Committed variant '%s'", variants[i % 4]);
+        samples[i] = monotonic_time_ns() - start;
+    }
+    report("queued");
+
+    atomic_store(&reader_fast, true);
+    display_destroy(display);
+    log_stop();
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(pipe_fds[1]);
+    atomic_store(&reader_stop, true);
+    pthread_join(reader, NULL);
+    close(pipe_fds[0]);
+    close(saved_stderr);
+
+    return EXIT_SUCCESS;
+}
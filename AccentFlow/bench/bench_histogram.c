@@ -0,0 +1,55 @@
+#include "histogram.h"
+#include "utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Latency histogram: the cost of recording one value, and its percentiles against the
+ * exact ones for a long-tailed latency distribution. */
+
+#define VALUE_COUNT 1000000
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(void)
+{
+    uint64_t *values = malloc(VALUE_COUNT * sizeof(*values));
+    Histogram *histogram = calloc(1, sizeof(*histogram));
+    if (!values || !histogram) {
+        return EXIT_FAILURE;
+    }
+    /* Mostly 40-120 us, one in a hundred up to 2 ms, one in ten thousand up to 50 ms. */
+    uint64_t state = 88172645463325252ull;
+    for (size_t i = 0; i < VALUE_COUNT; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        uint64_t spread = i % 10000 == 0 ? 50000000 : i % 100 == 0 ? 2000000 : 80000;
+        values[i] = 40000 + state % spread;
+    }
+
+    uint64_t start = monotonic_time_ns();
+    for (size_t i = 0; i < VALUE_COUNT; ++i) {
+        histogram_record(histogram, values[i]);
+    }
+    uint64_t record_ns = monotonic_time_ns() - start;
+
+    qsort(values, VALUE_COUNT, sizeof(*values), compare_u64);
+    static const double fractions[] = {0.5, 0.99, 0.999};
+    printf("histogram/record  %8.2f ns/value  %zu KiB\n", (double)record_ns / VALUE_COUNT, sizeof(*histogram) / 1024);
+    for (size_t i = 0; i < sizeof(fractions) / sizeof(fractions[0]); ++i) {
+        uint64_t exact = values[(size_t)(fractions[i] * VALUE_COUNT) - 1];
+        uint64_t estimate = histogram_percentile(histogram, fractions[i]);
+        printf("histogram/p%-5g  exact %9.1f us  histogram %9.1f us  (%+.1f%%)\n", fractions[i] * 100,
+               (double)exact / 1e3, (double)estimate / 1e3, 100.0 * ((double)estimate - (double)exact) / (double)exact);
+    }
+    free(histogram);
+    free(values);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "config.h"
+#include "utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* JSON parser throughput (MB/s of source text) for a few document shapes. */
+
+typedef enum {
+    DOCUMENT_MAPPINGS,  /* UTF-8 variants, the common case */
+    DOCUMENT_ESCAPED,   /* the same variants spelled as \uXXXX escapes, plus an emoji pair */
+    DOCUMENT_RULES      /* one long device_include array: string scanning only */
+} DocumentShape;
+
+static const char *const plain_variants = "\"\xc3\xa9\", \"\xc3\xa8\", \"\xc3\xaa\", \"\xc3\xab\", \"\xf0\x9f\x98\x80\"";
+static const char *const escaped_variants = "\"\\u00e9\", \"\\u00E8\", \"\\u00ea\", \"\\u00eb\", \"\\ud83d\\ude00\"";
+
+static int write_document(char *path, DocumentShape shape, size_t count)
+{
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n  \"input_device\": \"auto\",\n");
+    if (shape == DOCUMENT_RULES) {
+        fprintf(fp, "  \"device_include\": [\n");
+        for (size_t i = 0; i < count; ++i) {
+            fprintf(fp, "    \"usb-Vendor_Model_%06zu_Keyboard-event-kbd\"%s\n", i, i + 1 < count ? "," : "");
+        }
+        fprintf(fp, "  ]\n");
+    } else {
+        const char *variants = shape == DOCUMENT_ESCAPED ? escaped_variants : plain_variants;
+        for (size_t i = 0; i < count; ++i) {
+            fprintf(fp, "  \"key_%zu\": [%s]%s\n", i, variants, i + 1 < count ? "," : "");
+        }
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+    return 0;
+}
+
+static void run_document(const char *name, DocumentShape shape, size_t count, int iterations)
+{
+    char path[] = "/tmp/accentflow-bench-XXXXXX";
+    if (write_document(path, shape, count) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    char *error = NULL;
+    AccentConfig *config = config_load(path, &error);
+    if (!config) {
+        printf("json/%-9s %8zu items   rejected: %s\n", name, count, error ? error : "unknown error");
+        free(error);
+        unlink(path);
+        return;
+    }
+    config_free(config);
+
+    /* Best of several runs: the quietest load is the closest to the parser's own cost. */
+    uint64_t best_ns = UINT64_MAX;
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t start = monotonic_time_ns();
+        config = config_load(path, NULL);
+        if (!config) {
+            fprintf(stderr, "load failed\n");
+            exit(EXIT_FAILURE);
+        }
+        config_free(config);
+        uint64_t elapsed = monotonic_time_ns() - start;
+        if (elapsed < best_ns) {
+            best_ns = elapsed;
+        }
+    }
+    double seconds = (double)best_ns / 1e9;
+    printf("json/%-9s %8zu items %8.2f MB %9.1f us/load %8.1f MB/s\n", name, count,
+           (double)st.st_size / 1e6, seconds * 1e6, (double)st.st_size / 1e6 / seconds);
+    unlink(path);
+}
+
+int main(void)
+{
+    run_document("mappings", DOCUMENT_MAPPINGS, 100000, 10);
+    run_document("escaped", DOCUMENT_ESCAPED, 100000, 10);
+    run_document("rules", DOCUMENT_RULES, 200000, 10);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#include "utils.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Cost of one log_info call at the call site: formatted and written by the caller, queued
+ * for the log thread, filtered out by the level, and dropped by the rate limit. stderr
+ * goes to /dev/null. Queued calls come in bursts that fit the ring, as keystrokes do. */
+
+#define BURSTS 400
+#define BURST_CALLS 256
+#define FILTERED_ITERATIONS 10000000
+
+static double per_call_ns(void)
+{
+    uint64_t total = 0;
+    for (size_t burst = 0; burst < BURSTS; ++burst) {
+        uint64_t start = monotonic_time_ns();
+        for (size_t i = 0; i < BURST_CALLS; ++i) {
+            log_info("Committed variant '%s' (%zu of %d)", "\xc3\xa9", i, BURST_CALLS);
+        }
+        total += monotonic_time_ns() - start;
+        struct timespec pause = {0, 2000000};
+        nanosleep(&pause, NULL);
+    }
+    return (double)total / (BURSTS * BURST_CALLS);
+}
+
+static double filtered_ns(void)
+{
+    uint64_t start = monotonic_time_ns();
+    for (size_t i = 0; i < FILTERED_ITERATIONS; ++i) {
+        log_info("Committed variant '%s' (%zu of %d)", "\xc3\xa9", i, FILTERED_ITERATIONS);
+    }
+    return (double)(monotonic_time_ns() - start) / FILTERED_ITERATIONS;
+}
+
+int main(void)
+{
+    int null_fd = open("/dev/null", O_WRONLY);
+    int saved_stderr = dup(STDERR_FILENO);
+    if (null_fd < 0 || saved_stderr < 0) {
+        return EXIT_FAILURE;
+    }
+    dup2(null_fd, STDERR_FILENO);
+
+    log_set_rate_limit(0);
+    double direct = per_call_ns();
+    if (!log_start()) {
+        return EXIT_FAILURE;
+    }
+    double queued = per_call_ns();
+    log_set_level("error");
+    double disabled = filtered_ns();
+    log_set_level(NULL);
+    log_set_rate_limit(LOG_RATE_LIMIT);
+    double limited = filtered_ns();
+    log_stop();
+
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(null_fd);
+
+    printf("log/direct    %8.1f ns/call\n", direct);
+    printf("log/queued    %8.1f ns/call\n", queued);
+    printf("log/disabled  %8.1f ns/call\n", disabled);
+    printf("log/limited   %8.1f ns/call\n", limited);
+    return EXIT_SUCCESS;
+}
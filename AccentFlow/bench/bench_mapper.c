@@ -0,0 +1,115 @@
+#include "config.h"
+#include "mapper.h"
+#include "utils.h"
+
+#include <linux/input-event-codes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Keycode lookup: the old keycode_to_base + strcpy + config_find_mapping path
+ * against the compiled keymap, for growing mapping tables. */
+
+static const uint16_t lookup_keys[] = {
+    KEY_A, KEY_E, KEY_I, KEY_O, KEY_U, KEY_C, KEY_N, KEY_S, KEY_Z, KEY_Y,
+    KEY_APOSTROPHE, KEY_X,
+};
+#define LOOKUP_KEY_COUNT (sizeof(lookup_keys) / sizeof(lookup_keys[0]))
+
+static const char *legacy_base(uint16_t keycode)
+{
+    switch (keycode) {
+    case KEY_A: return "a";
+    case KEY_E: return "e";
+    case KEY_I: return "i";
+    case KEY_O: return "o";
+    case KEY_U: return "u";
+    case KEY_C: return "c";
+    case KEY_N: return "n";
+    case KEY_S: return "s";
+    case KEY_Z: return "z";
+    case KEY_Y: return "y";
+    case KEY_APOSTROPHE: return "'";
+    case KEY_X: return "x";
+    default: return NULL;
+    }
+}
+
+static const char *const real_bases[] = {"a", "e", "i", "o", "u", "c", "n", "s", "z", "y"};
+#define REAL_BASE_COUNT (sizeof(real_bases) / sizeof(real_bases[0]))
+
+/* Synthetic filler first so the real bases sit at the end of a linear scan. */
+static AccentConfig *load_config(size_t mapping_count)
+{
+    char path[] = "/tmp/accentflow-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n");
+    size_t filler = mapping_count > REAL_BASE_COUNT ? mapping_count - REAL_BASE_COUNT : 0;
+    for (size_t i = 0; i < filler; ++i) {
+        fprintf(fp, "  \"k%zu\": [\"\xc3\xa9\", \"\xc3\xa8\"],\n", i);
+    }
+    size_t real = mapping_count - filler;
+    for (size_t i = 0; i < real; ++i) {
+        fprintf(fp, "  \"%s\": [\"\xc3\xa9\", \"\xc3\xa8\"]%s\n", real_bases[i], i + 1 < real ? "," : "");
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+
+    char *error = NULL;
+    AccentConfig *config = config_load(path, &error);
+    if (!config) {
+        fprintf(stderr, "config_load failed: %s\n", error ? error : "unknown error");
+        free(error);
+    }
+    unlink(path);
+    return config;
+}
+
+static void run_size(size_t mapping_count)
+{
+    AccentConfig *config = load_config(mapping_count);
+    if (!config) {
+        exit(EXIT_FAILURE);
+    }
+
+    size_t iterations = 20000000 / mapping_count;
+    if (iterations < 2000) {
+        iterations = 2000;
+    }
+    volatile uintptr_t sink = 0;
+
+    uint64_t start = monotonic_time_ns();
+    for (size_t i = 0; i < iterations; ++i) {
+        uint16_t keycode = lookup_keys[i % LOOKUP_KEY_COUNT];
+        const char *base = legacy_base(keycode);
+        char copy[8];
+        strcpy(copy, base);
+        sink += (uintptr_t)config_find_mapping(config, copy);
+    }
+    uint64_t legacy_ns = monotonic_time_ns() - start;
+
+    size_t indexed_iterations = 50000000;
+    start = monotonic_time_ns();
+    for (size_t i = 0; i < indexed_iterations; ++i) {
+        sink += (uintptr_t)mapper_from_keycode(config, lookup_keys[i % LOOKUP_KEY_COUNT], 0);
+    }
+    uint64_t indexed_ns = monotonic_time_ns() - start;
+
+    printf("mapper/legacy   mappings=%-7zu %10.1f ns/op\n", mapping_count, (double)legacy_ns / (double)iterations);
+    printf("mapper/keymap   mappings=%-7zu %10.1f ns/op\n", mapping_count, (double)indexed_ns / (double)indexed_iterations);
+    (void)sink;
+    config_free(config);
+}
+
+int main(void)
+{
+    run_size(10);
+    run_size(1000);
+    run_size(100000);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,373 @@
+#include "arena.h"
+#include "config.h"
+#include "display.h"
+#include "mapper.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <linux/input-event-codes.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICRO_HAVE_TSC 1
+#else
+#define MICRO_HAVE_TSC 0
+#endif
+
+/* Per-component costs, one line per case:
+ *
+ *   micro/<function>  <parameter>  ns/op  TSC cycles/op  allocations/op  ±spread
+ *
+ * Each case is calibrated to rounds of at least MICRO_ROUND_NS, run MICRO_ROUNDS times on
+ * one CPU, and reported by the median round; the spread is half the interquartile range
+ * relative to the median. Allocations are counted by wrapping malloc and friends at link
+ * time (see the Makefile) and are exact. Cases are in a fixed order and inputs are fixed, so
+ * two runs can be compared line by line. An argument runs only the cases whose name
+ * contains it. */
+
+#define MICRO_ROUNDS 15
+#define MICRO_ROUND_NS 5000000ull
+
+/* Linked with -Wl,--wrap=malloc,... so the library's allocations come here. */
+static _Atomic uint64_t allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_realloc(pointer, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_aligned_alloc(alignment, size);
+}
+
+static uint64_t tsc_now(void)
+{
+#if MICRO_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+typedef struct MicroCase {
+    const char *name;
+    const char *parameter;
+    void (*run)(void *state, size_t iterations);
+    void *state;
+} MicroCase;
+
+static volatile uintptr_t sink;
+
+/* --- config_load ------------------------------------------------------------------------ */
+
+static const char *const real_bases[] = {"a", "e", "i", "o", "u", "c", "n", "s", "z", "y"};
+#define REAL_BASE_COUNT (sizeof(real_bases) / sizeof(real_bases[0]))
+
+/* Synthetic filler first so the real bases sit at the end of the table. */
+static char *write_config(size_t mapping_count)
+{
+    char *path = duplicate_string("/tmp/accentflow-bench-XXXXXX");
+    int fd = path ? mkstemp(path) : -1;
+    if (fd < 0) {
+        free(path);
+        return NULL;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n  \"xkb_layout\": \"us\",\n");
+    size_t filler = mapping_count > REAL_BASE_COUNT ? mapping_count - REAL_BASE_COUNT : 0;
+    for (size_t i = 0; i < filler; ++i) {
+        fprintf(fp, "  \"k%zu\": [\"\xc3\xa9\", \"\xc3\xa8\", \"\xc3\xaa\"],\n", i);
+    }
+    size_t real = mapping_count - filler;
+    for (size_t i = 0; i < real; ++i) {
+        fprintf(fp, "  \"%s\": [\"\xc3\xa9\", \"\xc3\xa8\", \"\xc3\xaa\"]%s\n", real_bases[i], i + 1 < real ? "," : "");
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+    return path;
+}
+
+static void run_config_load(void *state, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; ++i) {
+        AccentConfig *config = config_load(state, NULL);
+        sink += (uintptr_t)config;
+        config_free(config);
+    }
+}
+
+/* --- lookups ----------------------------------------------------------------------------- */
+
+static const char *const lookup_bases[] = {"a", "e", "i", "o", "u", "c", "n", "s", "z", "y", "'", "x"};
+static const uint16_t lookup_keys[] = {KEY_A, KEY_E, KEY_I, KEY_O, KEY_U, KEY_C,
+                                       KEY_N, KEY_S, KEY_Z, KEY_Y, KEY_APOSTROPHE, KEY_X};
+#define LOOKUP_COUNT (sizeof(lookup_keys) / sizeof(lookup_keys[0]))
+
+static void run_find_mapping(void *state, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += (uintptr_t)config_find_mapping(state, lookup_bases[i % LOOKUP_COUNT]);
+    }
+}
+
+static void run_mapper_from_keycode(void *state, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += (uintptr_t)mapper_from_keycode(state, lookup_keys[i % LOOKUP_COUNT], 0);
+    }
+}
+
+/* --- UTF-8 and Ctrl+Shift+U sequences ----------------------------------------------------- */
+
+/* One, two, three and four byte characters: a é € 𝄞, then a mixed French word. */
+static const char *const utf8_samples[] = {"a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9d\x84\x9e"};
+static const char utf8_text[] = "d\xc3\xa9j\xc3\xa0 \xc5\x93uvre \xe2\x82\xac\xf0\x9d\x84\x9e na\xc3\xafve";
+
+static void run_utf8_char(void *state, size_t iterations)
+{
+    const char *sample = state;
+    uint32_t codepoint = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += utf8_to_codepoint(sample, &codepoint);
+        sink += codepoint;
+    }
+}
+
+/* Per op: one code point of utf8_text, wrapping around. */
+static void run_utf8_text(void *state, size_t iterations)
+{
+    (void)state;
+    size_t offset = 0;
+    uint32_t codepoint = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        size_t length = utf8_to_codepoint(utf8_text + offset, &codepoint);
+        sink += codepoint;
+        offset = utf8_text[offset + length] ? offset + length : 0;
+    }
+}
+
+typedef struct SequenceState {
+    Arena *scratch;
+    const char *text;
+} SequenceState;
+
+/* As the engine builds a compose result: into a scratch arena reset for each. */
+static void run_unicode_sequence(void *state, size_t iterations)
+{
+    SequenceState *sequence_state = state;
+    char error[128];
+    for (size_t i = 0; i < iterations; ++i) {
+        AccentSequence sequence;
+        arena_reset(sequence_state->scratch);
+        if (unicode_sequence_build(sequence_state->text, NULL, &sequence, sequence_state->scratch, error, sizeof(error))) {
+            sink += sequence.event_count;
+        }
+    }
+}
+
+/* --- display ------------------------------------------------------------------------------ */
+
+typedef struct DisplayState {
+    Display *display;
+    FILE *stream;
+    const AccentMapping *mapping;
+} DisplayState;
+
+/* Cycling through the variants, as holding the accent key and tapping the base does. */
+static void run_display_variants(void *state, size_t iterations)
+{
+    DisplayState *display_state = state;
+    size_t variant_count = display_state->mapping->variant_count;
+    for (size_t i = 0; i < iterations; ++i) {
+        if ((i & 1023u) == 0) {
+            rewind(display_state->stream);
+        }
+        display_show_variants(display_state->display, "e", display_state->mapping, i % variant_count);
+    }
+}
+
+/* --- harness ------------------------------------------------------------------------------ */
+
+typedef struct MicroRound {
+    double ns;
+    double cycles;
+} MicroRound;
+
+static int compare_ns(const void *a, const void *b)
+{
+    double x = ((const MicroRound *)a)->ns;
+    double y = ((const MicroRound *)b)->ns;
+    return (x > y) - (x < y);
+}
+
+static int compare_cycles(const void *a, const void *b)
+{
+    double x = ((const MicroRound *)a)->cycles;
+    double y = ((const MicroRound *)b)->cycles;
+    return (x > y) - (x < y);
+}
+
+static void run_case(const MicroCase *micro)
+{
+    /* Warm-up doubles as calibration. */
+    size_t iterations = 1;
+    while (1) {
+        uint64_t start = monotonic_time_ns();
+        micro->run(micro->state, iterations);
+        uint64_t elapsed = monotonic_time_ns() - start;
+        if (elapsed >= MICRO_ROUND_NS || iterations >= SIZE_MAX / 4) {
+            break;
+        }
+        size_t scale = elapsed > 0 ? (size_t)(MICRO_ROUND_NS / elapsed) + 1 : 16;
+        iterations *= scale < 2 ? 2 : scale > 16 ? 16 : scale;
+    }
+
+    MicroRound rounds[MICRO_ROUNDS];
+    uint64_t allocations_before = atomic_load_explicit(&allocations, memory_order_relaxed);
+    for (int round = 0; round < MICRO_ROUNDS; ++round) {
+        uint64_t start = monotonic_time_ns();
+        uint64_t start_cycles = tsc_now();
+        micro->run(micro->state, iterations);
+        uint64_t cycles = tsc_now() - start_cycles;
+        uint64_t elapsed = monotonic_time_ns() - start;
+        rounds[round].ns = (double)elapsed / (double)iterations;
+        rounds[round].cycles = (double)cycles / (double)iterations;
+    }
+    uint64_t allocated = atomic_load_explicit(&allocations, memory_order_relaxed) - allocations_before;
+
+    qsort(rounds, MICRO_ROUNDS, sizeof(rounds[0]), compare_ns);
+    double median_ns = rounds[MICRO_ROUNDS / 2].ns;
+    double spread = (rounds[MICRO_ROUNDS * 3 / 4].ns - rounds[MICRO_ROUNDS / 4].ns) / 2.0 / median_ns * 100.0;
+    qsort(rounds, MICRO_ROUNDS, sizeof(rounds[0]), compare_cycles);
+    double median_cycles = rounds[MICRO_ROUNDS / 2].cycles;
+
+    char cycles_text[32] = "-";
+    if (MICRO_HAVE_TSC) {
+        snprintf(cycles_text, sizeof(cycles_text), "%.1f", median_cycles);
+    }
+    printf("micro/%-22s %-14s %12.1f ns/op %12s cycles/op %9.2f allocs/op  \xc2\xb1%.1f%%\n", micro->name,
+           micro->parameter, median_ns, cycles_text, (double)allocated / ((double)iterations * MICRO_ROUNDS), spread);
+    fflush(stdout);
+}
+
+/* Keeps the run on the CPU it started on, so rounds do not straddle migrations. */
+static void pin_cpu(void)
+{
+    int cpu = sched_getcpu();
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+static AccentConfig *load_config(const char *path)
+{
+    char *error = NULL;
+    AccentConfig *config = path ? config_load(path, &error) : NULL;
+    if (!config) {
+        fprintf(stderr, "config_load failed: %s\n", error ? error : "unknown error");
+        free(error);
+    }
+    return config;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    log_set_level("warn");
+    /* The configurations name "us"; compile it from the fixture, not the host's files. */
+    setenv("XKB_CONFIG_ROOT", "bench/xkb", 1);
+    pin_cpu();
+
+    static const size_t config_sizes[] = {10, 100, 1000};
+    char *config_paths[3];
+    char config_labels[3][32];
+    for (size_t i = 0; i < 3; ++i) {
+        config_paths[i] = write_config(config_sizes[i]);
+        snprintf(config_labels[i], sizeof(config_labels[i]), "mappings=%zu", config_sizes[i]);
+    }
+    AccentConfig *small = load_config(config_paths[0]);
+    AccentConfig *large = load_config(config_paths[2]);
+    if (!small || !large) {
+        return EXIT_FAILURE;
+    }
+
+    SequenceState sequence_short = {arena_create(4096), "\xc3\xa9"};
+    SequenceState sequence_long = {arena_create(4096), "\xc5\x93uvre"};
+    char display_buffer[128 * 1024];
+    FILE *display_stream = fmemopen(display_buffer, sizeof(display_buffer), "w");
+    DisplayState display_state = {
+        display_stream ? display_create_stream(display_stream) : NULL,
+        display_stream,
+        config_find_mapping(small, "e"),
+    };
+    if (!sequence_short.scratch || !sequence_long.scratch || !display_state.display || !display_state.mapping) {
+        return EXIT_FAILURE;
+    }
+
+    const MicroCase cases[] = {
+        {"config_load", config_labels[0], run_config_load, config_paths[0]},
+        {"config_load", config_labels[1], run_config_load, config_paths[1]},
+        {"config_load", config_labels[2], run_config_load, config_paths[2]},
+        {"config_find_mapping", config_labels[0], run_find_mapping, small},
+        {"config_find_mapping", config_labels[2], run_find_mapping, large},
+        {"mapper_from_keycode", config_labels[0], run_mapper_from_keycode, small},
+        {"mapper_from_keycode", config_labels[2], run_mapper_from_keycode, large},
+        {"utf8_to_codepoint", "1 byte", run_utf8_char, (void *)utf8_samples[0]},
+        {"utf8_to_codepoint", "2 bytes", run_utf8_char, (void *)utf8_samples[1]},
+        {"utf8_to_codepoint", "3 bytes", run_utf8_char, (void *)utf8_samples[2]},
+        {"utf8_to_codepoint", "4 bytes", run_utf8_char, (void *)utf8_samples[3]},
+        {"utf8_to_codepoint", "mixed text", run_utf8_text, NULL},
+        {"unicode_sequence_build", "1 char", run_unicode_sequence, &sequence_short},
+        {"unicode_sequence_build", "5 chars", run_unicode_sequence, &sequence_long},
+        {"display_show_variants", "4 variants", run_display_variants, &display_state},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (!filter || strstr(cases[i].name, filter)) {
+            run_case(&cases[i]);
+        }
+    }
+
+    display_destroy(display_state.display);
+    fclose(display_stream);
+    arena_destroy(sequence_short.scratch);
+    arena_destroy(sequence_long.scratch);
+    config_free(small);
+    config_free(large);
+    for (size_t i = 0; i < 3; ++i) {
+        unlink(config_paths[i]);
+        free(config_paths[i]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include "arena.h"
+#include "config.h"
+#include "input_engine.h"
+#include "output_backend.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Every preset in files/ preloaded as profiles: load time, memory against loading each
+ * preset as a configuration of its own, and the cost of switching profiles. */
+
+#define LOAD_ITERATIONS 10
+#define SWITCH_ITERATIONS 10000000
+
+static char *write_config(const char *profiles_dir)
+{
+    static char path[64];
+    snprintf(path, sizeof(path), "/tmp/accentflow-bench-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n  \"profiles_dir\": \"%s\",\n  \"e\": [\"\xc3\xa9\", \"\xc3\xa8\"]\n}\n", profiles_dir);
+    fclose(fp);
+    return path;
+}
+
+/* Arena bytes of every preset loaded as a separate configuration. */
+static size_t separate_bytes(const char *profiles_dir, size_t *count)
+{
+    DIR *dir = opendir(profiles_dir);
+    if (!dir) {
+        return 0;
+    }
+    size_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *extension = strrchr(entry->d_name, '.');
+        if (!extension || strcmp(extension, ".conf") != 0) {
+            continue;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", profiles_dir, entry->d_name);
+        AccentConfig *config = config_load(path, NULL);
+        if (config) {
+            total += arena_bytes_used(config->arena);
+            (*count)++;
+            config_free(config);
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    const char *profiles_dir = argc > 1 ? argv[1] : "../files";
+    char *path = write_config(profiles_dir);
+    if (!path) {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t best_ns = UINT64_MAX;
+    AccentConfig *config = NULL;
+    for (int i = 0; i < LOAD_ITERATIONS; ++i) {
+        config_free(config);
+        uint64_t start = monotonic_time_ns();
+        char *error = NULL;
+        config = config_load(path, &error);
+        uint64_t elapsed = monotonic_time_ns() - start;
+        if (!config) {
+            fprintf(stderr, "load failed: %s\n", error ? error : "unknown error");
+            free(error);
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+        if (elapsed < best_ns) {
+            best_ns = elapsed;
+        }
+    }
+    unlink(path);
+
+    size_t preset_count = 0;
+    size_t separate = separate_bytes(profiles_dir, &preset_count);
+    size_t shared = arena_bytes_used(config->arena);
+
+    OutputBackend *backend = output_backend_create_recorder(NULL);
+    InputEngine *engine = input_engine_create(config, NULL, backend, false);
+    if (!engine) {
+        return EXIT_FAILURE;
+    }
+    volatile uintptr_t sink = 0;
+    uint64_t start = monotonic_time_ns();
+    for (size_t i = 0; i < SWITCH_ITERATIONS; ++i) {
+        sink += (uintptr_t)input_engine_next_profile(engine);
+    }
+    uint64_t next_ns = monotonic_time_ns() - start;
+
+    const char *last = config->profiles[config->profile_count - 1]->profile_name;
+    start = monotonic_time_ns();
+    for (size_t i = 0; i < SWITCH_ITERATIONS; ++i) {
+        sink += (uintptr_t)input_engine_select_profile(engine, (i & 1) ? last : config->profile_name);
+    }
+    uint64_t select_ns = monotonic_time_ns() - start;
+
+    printf("profiles/load    profiles=%zu %8.2f ms\n", config->profile_count, (double)best_ns / 1e6);
+    printf("profiles/memory  shared %7.1f KiB   separate (%zu presets) %7.1f KiB\n", (double)shared / 1024.0,
+           preset_count, (double)separate / 1024.0);
+    printf("profiles/next    %8.1f ns/switch\n", (double)next_ns / SWITCH_ITERATIONS);
+    printf("profiles/select  %8.1f ns/switch (by name)\n", (double)select_ns / SWITCH_ITERATIONS);
+    (void)sink;
+
+    input_engine_destroy(engine);
+    output_backend_destroy(backend);
+    config_free(config);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+#include "config.h"
+#include "input_engine.h"
+#include "output_backend.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <getopt.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Replays a trace recorded with accentflowd --record through the engine, output kept in
+ * memory: events/s and ns/event of the state machine and the recorder backend, and the
+ * emitted sequence checked against a golden hash.
+ *
+ *   bench_replay [-u] [-d dump.txt] [trace [config [golden]]]
+ *
+ * -u rewrites the golden file from this run; -d writes the emitted events, one per line. */
+
+#define REPLAY_EVENTS 2000000 /* events fed per measurement, over as many passes as it takes */
+#define REPLAY_BATCH 64       /* at most as many events per feed as the engine reads at once */
+
+typedef struct ReplayBatch {
+    uint16_t device;
+    size_t start;
+    size_t count;
+} ReplayBatch;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t hash_output(const struct input_event *events, size_t count)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count; ++i) {
+        hash = fnv1a(hash, &events[i].type, sizeof(events[i].type));
+        hash = fnv1a(hash, &events[i].code, sizeof(events[i].code));
+        hash = fnv1a(hash, &events[i].value, sizeof(events[i].value));
+    }
+    return hash;
+}
+
+/* Runs of one device's events, as the engine would have read them. */
+static ReplayBatch *split_batches(const TraceEvent *trace_events, size_t count, size_t *batch_count, uint16_t *device_count)
+{
+    ReplayBatch *batches = malloc((count ? count : 1) * sizeof(ReplayBatch));
+    if (!batches) {
+        return NULL;
+    }
+    size_t n = 0;
+    *device_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t device = trace_events[i].device;
+        if (device >= *device_count) {
+            *device_count = (uint16_t)(device + 1u);
+        }
+        if (n > 0 && batches[n - 1].device == device && batches[n - 1].count < REPLAY_BATCH) {
+            batches[n - 1].count++;
+        } else {
+            batches[n++] = (ReplayBatch){.device = device, .start = i, .count = 1};
+        }
+    }
+    *batch_count = n;
+    return batches;
+}
+
+static InputEngine *create_engine(const AccentConfig *config, OutputBackend *backend, uint16_t device_count)
+{
+    InputEngine *engine = input_engine_create(config, NULL, backend, false);
+    for (uint16_t i = 0; engine && i < device_count; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "replay%u", (unsigned int)i);
+        if (input_engine_add_replay_device(engine, name) != i) {
+            input_engine_destroy(engine);
+            engine = NULL;
+        }
+    }
+    return engine;
+}
+
+static bool replay(InputEngine *engine, const ReplayBatch *batches, size_t batch_count, const struct input_event *events)
+{
+    for (size_t i = 0; i < batch_count; ++i) {
+        if (input_engine_feed(engine, batches[i].device, &events[batches[i].start], batches[i].count) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool write_dump(const char *path, const struct input_event *events, size_t count)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        fprintf(fp, "%u %u %d\n", events[i].type, events[i].code, events[i].value);
+    }
+    return fclose(fp) == 0;
+}
+
+/* 1 if the golden file matches, 0 if it does not, -1 if it cannot be read. */
+static int check_golden(const char *path, size_t count, uint64_t hash, size_t *golden_count, unsigned long long *golden_hash)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    int fields = fscanf(fp, "events=%zu fnv1a=%llx", golden_count, golden_hash);
+    fclose(fp);
+    if (fields != 2) {
+        fprintf(stderr, "%s: not a golden file\n", path);
+        return -1;
+    }
+    return *golden_count == count && *golden_hash == hash;
+}
+
+int main(int argc, char **argv)
+{
+    bool update = false;
+    const char *dump_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "ud:")) != -1) {
+        switch (opt) {
+        case 'u':
+            update = true;
+            break;
+        case 'd':
+            dump_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-u] [-d dump] [trace [config [golden]]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    const char *trace_path = optind < argc ? argv[optind] : "bench/traces/typing.trace";
+    const char *config_path = optind + 1 < argc ? argv[optind + 1] : "bench/traces/typing.json";
+    const char *golden_path = optind + 2 < argc ? argv[optind + 2] : "bench/traces/typing.golden";
+
+    log_set_level("warn");
+    /* The configuration names its layout; the fixture pins the symbols it compiles from, so
+     * the golden does not depend on the host's keyboard or xkeyboard-config. */
+    setenv("XKB_CONFIG_ROOT", "bench/xkb", 1);
+
+    char *error = NULL;
+    Trace *trace = trace_open(trace_path, &error);
+    AccentConfig *config = trace ? config_load(config_path, &error) : NULL;
+    if (!config) {
+        fprintf(stderr, "%s\n", error ? error : "out of memory");
+        free(error);
+        trace_close(trace);
+        return EXIT_FAILURE;
+    }
+
+    /* Decoded up front so the measurement covers the engine only. */
+    size_t count = 0;
+    const TraceEvent *recorded = trace_events(trace, &count);
+    struct input_event *events = malloc((count ? count : 1) * sizeof(struct input_event));
+    size_t batch_count = 0;
+    uint16_t device_count = 0;
+    ReplayBatch *batches = events ? split_batches(recorded, count, &batch_count, &device_count) : NULL;
+    if (!batches || count == 0) {
+        fprintf(stderr, "%s: no events\n", trace_path);
+        return EXIT_FAILURE;
+    }
+    uint64_t time_us = 0;
+    for (size_t i = 0; i < count; ++i) {
+        trace_event_decode(&recorded[i], &time_us, &events[i]);
+    }
+
+    OutputBackend *backend = output_backend_create_recorder(NULL);
+    InputEngine *engine = backend ? create_engine(config, backend, device_count) : NULL;
+    if (!engine || !replay(engine, batches, batch_count, events)) {
+        fprintf(stderr, "replay failed\n");
+        return EXIT_FAILURE;
+    }
+    size_t output_count = 0;
+    const struct input_event *output = output_backend_recorded_events(backend, &output_count);
+    uint64_t hash = hash_output(output, output_count);
+    if (dump_path && !write_dump(dump_path, output, output_count)) {
+        return EXIT_FAILURE;
+    }
+    input_engine_destroy(engine);
+
+    /* Each pass starts from a fresh engine so the passes are identical; only feeding is timed. */
+    size_t passes = REPLAY_EVENTS / count + 1;
+    uint64_t elapsed_ns = 0;
+    bool stable = true;
+    for (size_t pass = 0; pass < passes; ++pass) {
+        output_backend_clear_recording(backend);
+        engine = create_engine(config, backend, device_count);
+        if (!engine) {
+            return EXIT_FAILURE;
+        }
+        uint64_t start = monotonic_time_ns();
+        bool fed = replay(engine, batches, batch_count, events);
+        elapsed_ns += monotonic_time_ns() - start;
+        size_t pass_count = 0;
+        const struct input_event *pass_output = output_backend_recorded_events(backend, &pass_count);
+        stable = stable && fed && pass_count == output_count && hash_output(pass_output, pass_count) == hash;
+        input_engine_destroy(engine);
+    }
+
+    const char *name = strrchr(trace_path, '/');
+    name = name ? name + 1 : trace_path;
+    double fed_events = (double)count * (double)passes;
+    printf("replay/%-8s events=%zu devices=%u passes=%zu %8.1f ns/event %8.2f M events/s\n", name, count,
+           (unsigned int)device_count, passes, (double)elapsed_ns / fed_events, fed_events / (double)elapsed_ns * 1e3);
+
+    int rc = EXIT_SUCCESS;
+    if (!stable) {
+        fprintf(stderr, "replay/output differs between passes\n");
+        rc = EXIT_FAILURE;
+    } else if (update) {
+        FILE *fp = fopen(golden_path, "w");
+        if (!fp || fprintf(fp, "events=%zu fnv1a=0x%016llx\n", output_count, (unsigned long long)hash) < 0 || fclose(fp) != 0) {
+            perror(golden_path);
+            rc = EXIT_FAILURE;
+        } else {
+            printf("replay/output  events=%zu fnv1a=0x%016llx written to %s\n", output_count, (unsigned long long)hash, golden_path);
+        }
+    } else {
+        size_t golden_count = 0;
+        unsigned long long golden_hash = 0;
+        int match = check_golden(golden_path, output_count, hash, &golden_count, &golden_hash);
+        if (match == 1) {
+            printf("replay/output  events=%zu fnv1a=0x%016llx matches %s\n", output_count, (unsigned long long)hash, golden_path);
+        } else {
+            if (match == 0) {
+                fprintf(stderr, "replay/output  events=%zu fnv1a=0x%016llx, expected events=%zu fnv1a=0x%016llx (%s)\n",
+                        output_count, (unsigned long long)hash, golden_count, golden_hash, golden_path);
+            }
+            rc = EXIT_FAILURE;
+        }
+    }
+
+    output_backend_destroy(backend);
+    free(batches);
+    free(events);
+    config_free(config);
+    trace_close(trace);
+    return rc;
+}
@@ -0,0 +1,122 @@
+#include "config.h"
+#include "text_scan.h"
+#include "utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Large generated mapping file, loaded with each scanner implementation in turn. The file
+ * is shaped like json.dump(indent=4, ensure_ascii=False) output over Unicode data:
+ * non-ASCII keys and variants, one array element per indented line. */
+
+#define MAPPING_COUNT 200000
+#define ITERATIONS 5
+
+static void put_utf8(FILE *fp, uint32_t codepoint)
+{
+    if (codepoint < 0x800) {
+        fputc(0xC0 | (codepoint >> 6), fp);
+        fputc(0x80 | (codepoint & 0x3F), fp);
+    } else if (codepoint < 0x10000) {
+        fputc(0xE0 | (codepoint >> 12), fp);
+        fputc(0x80 | ((codepoint >> 6) & 0x3F), fp);
+        fputc(0x80 | (codepoint & 0x3F), fp);
+    } else {
+        fputc(0xF0 | (codepoint >> 18), fp);
+        fputc(0x80 | ((codepoint >> 12) & 0x3F), fp);
+        fputc(0x80 | ((codepoint >> 6) & 0x3F), fp);
+        fputc(0x80 | (codepoint & 0x3F), fp);
+    }
+}
+
+static long write_document(char *path)
+{
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, "{\n    \"input_device\": \"auto\",\n");
+    for (uint32_t i = 0; i < MAPPING_COUNT; ++i) {
+        fputs("    \"", fp);
+        put_utf8(fp, 0x20000 + i);
+        fputs("\": [\n", fp);
+        for (uint32_t j = 0; j < 4; ++j) {
+            fputs("        \"", fp);
+            put_utf8(fp, 0x0400 + (i + j) % 256);
+            put_utf8(fp, 0x0300 + j);
+            fputs(j < 3 ? "\",\n" : "\"\n", fp);
+        }
+        fputs(i + 1 < MAPPING_COUNT ? "    ],\n" : "    ]\n", fp);
+    }
+    fputs("}\n", fp);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+static double best_load_seconds(const char *path)
+{
+    uint64_t best_ns = UINT64_MAX;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        uint64_t start = monotonic_time_ns();
+        AccentConfig *config = config_load(path, NULL);
+        if (!config) {
+            fprintf(stderr, "load failed\n");
+            exit(EXIT_FAILURE);
+        }
+        config_free(config);
+        uint64_t elapsed = monotonic_time_ns() - start;
+        if (elapsed < best_ns) {
+            best_ns = elapsed;
+        }
+    }
+    return (double)best_ns / 1e9;
+}
+
+static double best_validate_seconds(const char *data, size_t length)
+{
+    uint64_t best_ns = UINT64_MAX;
+    for (int i = 0; i < ITERATIONS * 4; ++i) {
+        uint64_t start = monotonic_time_ns();
+        if (!text_validate_utf8(data, length, NULL)) {
+            fprintf(stderr, "validation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        uint64_t elapsed = monotonic_time_ns() - start;
+        if (elapsed < best_ns) {
+            best_ns = elapsed;
+        }
+    }
+    return (double)best_ns / 1e9;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/accentflow-bench-XXXXXX";
+    long size = write_document(path);
+    size_t length = 0;
+    char *data = size > 0 ? read_file_to_buffer(path, &length) : NULL;
+    if (!data) {
+        exit(EXIT_FAILURE);
+    }
+    double megabytes = (double)size / 1e6;
+    TextScanLevel widest = text_scan_level();
+
+    for (int level = TEXT_SCAN_SCALAR; level <= (int)widest; ++level) {
+        text_scan_limit((TextScanLevel)level);
+        const char *name = text_scan_level_name((TextScanLevel)level);
+        double validate = best_validate_seconds(data, length);
+        double load = best_load_seconds(path);
+        printf("scan/utf8    %-6s %6.1f MB %9.1f us %8.1f MB/s\n", name, megabytes, validate * 1e6,
+               megabytes / validate);
+        printf("scan/load    %-6s %6.1f MB %9.1f us %8.1f MB/s\n", name, megabytes, load * 1e6, megabytes / load);
+    }
+    text_scan_limit(TEXT_SCAN_AVX2);
+
+    free(data);
+    unlink(path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+#include "layout.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <linux/input-event-codes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compiles fr, de, us(dvorak) and us(colemak) from the XKB fixture in bench/xkb and checks
+ * keycode to character entries and the Ctrl+Shift+U keys against what the keys are
+ * labelled. A layout that cannot be compiled, or that came out as US QWERTY, fails. de(neo),
+ * which makes Caps Lock select level 3, must be rejected rather than compiled.
+ *
+ *   check_layout [xkb_root] */
+
+#define LAYOUT_COMPILES 2000
+
+typedef struct {
+    uint16_t keycode;
+    uint32_t lower;
+    uint32_t upper;
+} ExpectedKey;
+
+typedef struct {
+    const char *name;
+    const char *variant;
+    ExpectedKey keys[8];
+    uint16_t u;
+    uint16_t shifted_digits;
+} ExpectedLayout;
+
+static const ExpectedLayout expected_layouts[] = {
+    {"fr", NULL,
+     {{KEY_Q, 'a', 'A'}, {KEY_A, 'q', 'Q'}, {KEY_W, 'z', 'Z'}, {KEY_Z, 'w', 'W'}, {KEY_SEMICOLON, 'm', 'M'},
+      {KEY_2, 0xe9, '2'}, {KEY_7, 0xe8, '7'}, {KEY_0, 0xe0, '0'}},
+     KEY_U, 0x3ff},
+    {"de", NULL,
+     {{KEY_Y, 'z', 'Z'}, {KEY_Z, 'y', 'Y'}, {KEY_SEMICOLON, 0xf6, 0xd6}, {KEY_APOSTROPHE, 0xe4, 0xc4},
+      {KEY_LEFTBRACE, 0xfc, 0xdc}, {KEY_MINUS, 0xdf, '?'}, {KEY_2, '2', '"'}, {KEY_Q, 'q', 'Q'}},
+     KEY_U, 0},
+    {"us", "dvorak",
+     {{KEY_Q, '\'', '"'}, {KEY_W, ',', '<'}, {KEY_E, '.', '>'}, {KEY_S, 'o', 'O'}, {KEY_F, 'u', 'U'},
+      {KEY_SEMICOLON, 's', 'S'}, {KEY_Z, ';', ':'}, {KEY_MINUS, '[', '{'}},
+     KEY_F, 0},
+    {"us", "colemak",
+     {{KEY_E, 'f', 'F'}, {KEY_S, 'r', 'R'}, {KEY_D, 's', 'S'}, {KEY_J, 'n', 'N'}, {KEY_K, 'e', 'E'},
+      {KEY_SEMICOLON, 'o', 'O'}, {KEY_I, 'u', 'U'}, {KEY_CAPSLOCK, 0, 0}},
+     KEY_I, 0},
+};
+#define EXPECTED_LAYOUT_COUNT (sizeof(expected_layouts) / sizeof(expected_layouts[0]))
+
+/* Layouts the keycode table cannot describe, and the key the error must name. */
+static const struct {
+    const char *name;
+    const char *variant;
+    const char *key;
+} rejected_layouts[] = {
+    {"de", "neo", "<CAPS>"},
+};
+#define REJECTED_LAYOUT_COUNT (sizeof(rejected_layouts) / sizeof(rejected_layouts[0]))
+
+static KeyboardLayout layout;
+static KeyboardLayout us_layout;
+
+static bool check_layout(const ExpectedLayout *expected)
+{
+    char label[64];
+    snprintf(label, sizeof(label), "%s%s%s%s", expected->name, expected->variant ? "(" : "",
+             expected->variant ? expected->variant : "", expected->variant ? ")" : "");
+
+    char error[256] = "";
+    if (!layout_compile(&layout, expected->name, expected->variant, error, sizeof(error))) {
+        fprintf(stderr, "layout/%-12s FAILED to compile: %s\n", label, error);
+        return false;
+    }
+    if (memcmp(&layout, &us_layout, sizeof(layout)) == 0) {
+        fprintf(stderr, "layout/%-12s FAILED: compiled to US QWERTY\n", label);
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(expected->keys) / sizeof(expected->keys[0]); ++i) {
+        const ExpectedKey *key = &expected->keys[i];
+        if (key->keycode == 0) {
+            continue;
+        }
+        const uint32_t *levels = layout.levels[key->keycode];
+        if (levels[0] != key->lower || levels[1] != key->upper) {
+            fprintf(stderr, "layout/%-12s FAILED: keycode %u types U+%04X/U+%04X, expected U+%04X/U+%04X\n", label,
+                    (unsigned int)key->keycode, (unsigned int)levels[0], (unsigned int)levels[1],
+                    (unsigned int)key->lower, (unsigned int)key->upper);
+            ok = false;
+        }
+    }
+
+    UnicodeKeys keys;
+    if (!unicode_keys_from_layout(&keys, &layout)) {
+        fprintf(stderr, "layout/%-12s FAILED: no keys for Ctrl+Shift+U\n", label);
+        ok = false;
+    } else if (keys.u != expected->u || keys.shifted_digits != expected->shifted_digits) {
+        fprintf(stderr, "layout/%-12s FAILED: u on keycode %u, shifted digits 0x%x; expected %u, 0x%x\n", label,
+                (unsigned int)keys.u, (unsigned int)keys.shifted_digits, (unsigned int)expected->u,
+                (unsigned int)expected->shifted_digits);
+        ok = false;
+    }
+    if (!ok) {
+        return false;
+    }
+
+    uint64_t start = monotonic_time_ns();
+    for (int i = 0; i < LAYOUT_COMPILES; ++i) {
+        layout_compile(&layout, expected->name, expected->variant, error, sizeof(error));
+    }
+    uint64_t elapsed = monotonic_time_ns() - start;
+    printf("layout/%-12s ok %8.1f us/compile\n", label, (double)elapsed / LAYOUT_COMPILES / 1000.0);
+    return true;
+}
+
+static bool check_rejected(const char *name, const char *variant, const char *key)
+{
+    char error[256] = "";
+    if (layout_compile(&layout, name, variant, error, sizeof(error))) {
+        fprintf(stderr, "layout/%s(%s) FAILED: compiled, expected it to be rejected\n", name, variant);
+        return false;
+    }
+    if (!strstr(error, key)) {
+        fprintf(stderr, "layout/%s(%s) FAILED: rejected without naming %s: %s\n", name, variant, key, error);
+        return false;
+    }
+    printf("layout/%s(%s) rejected: %s\n", name, variant, error);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *root = argc > 1 ? argv[1] : "bench/xkb";
+    if (setenv("XKB_CONFIG_ROOT", root, 1) != 0) {
+        perror("setenv");
+        return EXIT_FAILURE;
+    }
+    layout_load_us(&us_layout);
+
+    bool ok = true;
+    for (size_t i = 0; i < EXPECTED_LAYOUT_COUNT; ++i) {
+        ok = check_layout(&expected_layouts[i]) && ok;
+    }
+    for (size_t i = 0; i < REJECTED_LAYOUT_COUNT; ++i) {
+        ok = check_rejected(rejected_layouts[i].name, rejected_layouts[i].variant, rejected_layouts[i].key) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,19 @@
+#ifndef ACCENTFLOW_ARENA_H
+#define ACCENTFLOW_ARENA_H
+
+#include <stddef.h>
+
+/* Bump allocator for data that lives and dies together, such as one loaded configuration.
+ * Allocations are never freed individually; arena_destroy releases everything at once. */
+typedef struct Arena Arena;
+
+Arena *arena_create(size_t chunk_size);
+void arena_destroy(Arena *arena);
+/* Zero-filled memory aligned for any object type, or NULL when out of memory. */
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *text, size_t length);
+/* Releases every allocation but keeps the newest chunk for reuse, for scratch arenas. */
+void arena_reset(Arena *arena);
+size_t arena_bytes_used(const Arena *arena);
+
+#endif /* ACCENTFLOW_ARENA_H */
@@ -0,0 +1,57 @@
+#ifndef ACCENTFLOW_COMPOSE_H
+#define ACCENTFLOW_COMPOSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPOSE_START 0u
+#define COMPOSE_NONE UINT32_MAX
+#define COMPOSE_NO_RESULT UINT32_MAX
+
+/* Multi-key compose sequences ("o /" -> ø) as a trie over the characters typed after the
+ * Compose key. Every transition sits in one open-addressed table keyed by (state,
+ * character), so a key costs one hash probe whatever the fan-out of its state. The layout
+ * is public so config_embed can write a table out as C initializers; only compose.c
+ * builds or reads one. */
+typedef struct {
+    uint32_t state;
+    uint32_t codepoint; /* 0 marks an empty slot */
+    uint32_t target;
+} ComposeEdge;
+
+/* A state ending a sequence never has children: where one sequence is a prefix of
+ * another, the longer one wins. */
+typedef struct {
+    uint32_t result; /* offset into strings, or COMPOSE_NO_RESULT */
+    uint32_t children;
+} ComposeNode;
+
+typedef struct ComposeTable {
+    ComposeEdge *edges;
+    size_t mask;
+    unsigned int shift;
+    ComposeNode *nodes;
+    size_t node_count;
+    char *strings;
+    size_t strings_size;
+    size_t sequence_count;
+} ComposeTable;
+
+struct AccentConfig;
+
+/* Builds config->compose in the configuration's arena from its multi-character bases and
+ * from compose_file (XCompose format; only <Multi_key> sequences are used). A missing or
+ * unreadable compose file is logged and skipped. Returns false when out of memory. */
+bool compose_build(struct AccentConfig *config);
+
+/* State after typing codepoint in state, or COMPOSE_NONE when no sequence continues so. */
+uint32_t compose_step(const ComposeTable *table, uint32_t state, uint32_t codepoint);
+/* Text of the sequence ending in state, or NULL while more keys are needed. */
+const char *compose_result(const ComposeTable *table, uint32_t state);
+size_t compose_sequence_count(const ComposeTable *table);
+size_t compose_state_count(const ComposeTable *table);
+/* Bytes of the trie, transition table and result strings. */
+size_t compose_table_bytes(const ComposeTable *table);
+
+#endif /* ACCENTFLOW_COMPOSE_H */
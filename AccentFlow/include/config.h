@@ -1,25 +1,97 @@
 #ifndef ACCENTFLOW_CONFIG_H
 #define ACCENTFLOW_CONFIG_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+struct Arena;
+struct AccentSequence;
+struct ComposeTable;
+struct UnicodeKeys;
 
 typedef struct AccentMapping {
     char *base;
     char **variants;
     size_t variant_count;
+    struct AccentSequence *sequences; /* one prebuilt injection sequence per variant */
+    uint32_t layer; /* index in the configuration's layers of the file that defined it */
 } AccentMapping;
 
+/* Overlays config_load merges over a configuration file: every *.json in this directory
+ * beside it, in name order, then the user file if one is set. */
+#define CONFIG_OVERLAY_DIRECTORY "conf.d"
+
 typedef struct AccentConfig {
     AccentMapping *mappings;
     size_t mapping_count;
+    /* Built by mapper_compile: MAPPER_LAYER_COUNT tables of MAPPER_KEY_COUNT mappings. */
+    const AccentMapping **keymap;
+    /* Built by mapper_compile when there are compose sequences: their trie, and the
+     * character each key types on each layer (MAPPER_LAYER_COUNT tables of MAPPER_KEY_COUNT). */
+    const struct ComposeTable *compose;
+    uint32_t *key_characters;
+    /* Set by mapper_compile when the layout's "u" or hex digit keys differ from US; the
+     * key sequences are built with them. NULL: US keys. */
+    const struct UnicodeKeys *unicode_keys;
     char *input_device;
     char *display_mode;
+    char *output_backend;
+    char *xkb_layout;  /* NULL: system keyboard layout */
+    char *xkb_variant;
+    /* Set by mapper_compile: the layout the keymap and key sequences were built for, as
+     * layout_resolve writes it. */
+    char *layout;
+    char *compose_file; /* XCompose table; NULL: sequences from the mappings only */
+    char *profiles_dir;  /* presets preloaded as switchable profiles, or NULL */
+    char *startup_profile;
+    char *log_level;  /* error, warn, info or debug; NULL: info */
+    char **device_include;
+    size_t device_include_count;
+    char **device_exclude;
+    size_t device_exclude_count;
+    /* Profiles share the loaded configuration's arena, strings and key sequences. Each is
+     * an AccentConfig of its own with the main one's settings and its preset's mappings;
+     * profiles[0] is the main configuration, and root points back to it from every profile.
+     * Without profiles_dir, profiles is NULL and root is the configuration itself. */
+    struct AccentConfig **profiles;
+    size_t profile_count;
+    size_t profile_index;
+    const struct AccentConfig *root;
+    char *profile_name; /* file name without its extension */
+    /* Owns the configuration, its source text and everything else it points to, except a cache image. */
+    struct Arena *arena;
+    /* Read-only config cache image that strings and sequences point into, or NULL. */
+    const void *image;
+    size_t image_size;
+    /* Files merged into the configuration, the main file first; each later one overrides
+     * the earlier ones. A profile has its preset as its only layer. */
+    char **layers;
+    size_t layer_count;
 } AccentConfig;
 
+/* Loads path with its overlays: a later file replaces the settings and mappings it names,
+ * and a mapping set to null or [] is removed. */
 AccentConfig *config_load(const char *path, char **error_message);
+/* The files config_load merges for path, path first; overlays that do not exist are left
+ * out. One allocation: release it with free(). */
+char **config_layer_paths(const char *path, size_t *count);
+/* The user's overlay (--user-config), merged last into every configuration loaded from a
+ * file; NULL, the default, merges none. path is not copied. Set it before loading. */
+void config_set_user_file(const char *path);
+const char *config_get_user_file(void);
 void config_free(AccentConfig *config);
+/* Rebuilds the key sequences of config and its profiles with config->unicode_keys. */
+bool config_compile_sequences(AccentConfig *config, char **error_message);
+/* Loads profiles_dir into config (called by the loaders); source_path names the main profile. */
+bool config_load_profiles(AccentConfig *config, const char *source_path, char **error_message);
 const AccentMapping *config_find_mapping(const AccentConfig *config, const char *base);
+/* The profile of config's file called name, or NULL. */
+const AccentConfig *config_find_profile(const AccentConfig *config, const char *name);
 const char *config_get_input_device(const AccentConfig *config);
 const char *config_get_display_mode(const AccentConfig *config);
+const char *config_get_output_backend(const AccentConfig *config);
+const char *config_get_log_level(const AccentConfig *config);
+const char *const *config_get_device_rules(const AccentConfig *config, bool exclude, size_t *count);
 
 #endif /* ACCENTFLOW_CONFIG_H */
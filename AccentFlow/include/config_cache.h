@@ -0,0 +1,21 @@
+#ifndef ACCENTFLOW_CONFIG_CACHE_H
+#define ACCENTFLOW_CONFIG_CACHE_H
+
+#include <stdbool.h>
+
+struct AccentConfig;
+
+/* Flat, versioned image of a loaded configuration: mapping index, string pool and the
+ * prebuilt injection sequences, addressed by offsets so it can be mapped read-only and
+ * shared between daemons. The image records the size and mtime of every file merged
+ * into the configuration. */
+bool config_cache_write(const struct AccentConfig *config, const char *source_path, const char *cache_path,
+                        char **error_message);
+/* Maps the image; fails when it is missing, corrupt or older than source_path or its overlays. */
+struct AccentConfig *config_cache_load(const char *cache_path, const char *source_path, char **error_message);
+/* Uses the cache when it is current, otherwise loads source_path and rewrites the cache. */
+struct AccentConfig *config_load_cached(const char *source_path, const char *cache_path, char **error_message);
+/* Called by config_free for image-backed configurations. */
+void config_cache_unmap(struct AccentConfig *config);
+
+#endif /* ACCENTFLOW_CONFIG_CACHE_H */
@@ -0,0 +1,19 @@
+#ifndef ACCENTFLOW_CONFIG_EMBED_H
+#define ACCENTFLOW_CONFIG_EMBED_H
+
+#include <stdbool.h>
+
+struct AccentConfig;
+
+/* Configuration compiled into the daemon. config_embed_write turns a loaded configuration
+ * into a C header of static const tables: mappings, injection sequences, the keymap for
+ * the layout it was loaded with and the compose table. A daemon built with
+ * -DACCENTFLOW_EMBEDDED_CONFIG='"header"' starts from those tables without reading or
+ * parsing a file. The configuration must set xkb_layout. Profiles are not embedded. */
+bool config_embed_write(const struct AccentConfig *config, const char *source_path, const char *header_path,
+                        char **error_message);
+/* The configuration built into this binary, or NULL. It is never freed; config_free on it
+ * does nothing. */
+struct AccentConfig *config_embedded(void);
+
+#endif /* ACCENTFLOW_CONFIG_EMBED_H */
@@ -0,0 +1,24 @@
+#ifndef ACCENTFLOW_CONFIG_RELOAD_H
+#define ACCENTFLOW_CONFIG_RELOAD_H
+
+struct AccentConfig;
+struct InputEngine;
+
+/* Reloads the configuration on a background thread when the file changes (inotify on its
+ * directory, so editors that save by rename are seen) or on config_reloader_request.
+ * A new configuration is published to the engine and the previous one is freed on the
+ * reload thread once the engine has switched away from it. A file that fails to load
+ * is logged and the running configuration kept. */
+typedef struct ConfigReloader ConfigReloader;
+
+/* Takes ownership of config, which must be the engine's current configuration; on failure
+ * the caller keeps it. cache_path may be NULL. */
+ConfigReloader *config_reloader_create(struct InputEngine *engine, struct AccentConfig *config,
+                                       const char *config_path, const char *cache_path);
+/* Stops the thread and frees every configuration it owns; call once the engine has
+ * stopped running. */
+void config_reloader_destroy(ConfigReloader *reloader);
+/* Queues a reload; callable from any thread. */
+void config_reloader_request(ConfigReloader *reloader);
+
+#endif /* ACCENTFLOW_CONFIG_RELOAD_H */
@@ -0,0 +1,11 @@
+#ifndef ACCENTFLOW_DEVICE_MONITOR_H
+#define ACCENTFLOW_DEVICE_MONITOR_H
+
+struct InputEngine;
+
+typedef struct DeviceMonitor DeviceMonitor;
+
+DeviceMonitor *device_monitor_create(struct InputEngine *engine);
+void device_monitor_destroy(DeviceMonitor *monitor);
+
+#endif /* ACCENTFLOW_DEVICE_MONITOR_H */
@@ -2,12 +2,20 @@
 #define ACCENTFLOW_DISPLAY_H
 
 #include <stddef.h>
+#include <stdio.h>
 
 struct AccentMapping;
 
+/* Preview line on stderr. The calls below are made on the input thread and only queue a
+ * record; a display thread of its own does the writing, so a slow stderr consumer cannot
+ * hold up key forwarding. */
 typedef struct Display Display;
 
 Display *display_create_tui(void);
+/* The same lines written to stream on the calling thread, without a display thread: a
+ * memory stream (fmemopen) for benchmarks. The stream stays the caller's. */
+Display *display_create_stream(FILE *stream);
+/* Writes out what is still queued before returning. */
 void display_destroy(Display *display);
 void display_show_variants(Display *display, const char *base, const struct AccentMapping *mapping, size_t active_index);
 void display_show_committed(Display *display, const char *text);
@@ -0,0 +1,21 @@
+#ifndef ACCENTFLOW_EVENT_LOOP_H
+#define ACCENTFLOW_EVENT_LOOP_H
+
+#include <stdint.h>
+
+typedef struct EventLoop EventLoop;
+
+/* Return a negative value to abort event_loop_run with an error. */
+typedef int (*EventLoopHandler)(EventLoop *loop, int fd, uint32_t events, void *userdata);
+typedef int (*EventLoopSignalHandler)(EventLoop *loop, int signo, void *userdata);
+
+EventLoop *event_loop_create(void);
+void event_loop_destroy(EventLoop *loop);
+int event_loop_add(EventLoop *loop, int fd, uint32_t events, EventLoopHandler handler, void *userdata);
+int event_loop_remove(EventLoop *loop, int fd);
+int event_loop_add_signal(EventLoop *loop, int signo, EventLoopSignalHandler handler, void *userdata);
+void event_loop_set_spin(EventLoop *loop, unsigned int spin_usec);
+int event_loop_run(EventLoop *loop);
+void event_loop_stop(EventLoop *loop);
+
+#endif /* ACCENTFLOW_EVENT_LOOP_H */
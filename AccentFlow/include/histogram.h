@@ -0,0 +1,26 @@
+#ifndef ACCENTFLOW_HISTOGRAM_H
+#define ACCENTFLOW_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Log-linear histogram of non-negative values such as latencies in nanoseconds. Values
+ * below 16 have a bucket each; above that, every power of two is split into 16 buckets, so
+ * a percentile is off by at most 1/16 of its value. Recording is a few instructions and
+ * never allocates. Not thread-safe. */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64u - HISTOGRAM_SUB_BITS + 1u) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct Histogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+void histogram_record(Histogram *histogram, uint64_t value);
+void histogram_reset(Histogram *histogram);
+/* The value below which the given fraction (0.5 for the median) of the recorded values
+ * fall: the upper bound of its bucket, capped at the maximum. 0 when empty. */
+uint64_t histogram_percentile(const Histogram *histogram, double fraction);
+
+#endif /* ACCENTFLOW_HISTOGRAM_H */
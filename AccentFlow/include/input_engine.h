@@ -2,14 +2,56 @@
 #define ACCENTFLOW_INPUT_ENGINE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct AccentConfig;
 struct Display;
+struct EventLoop;
+struct OutputBackend;
+struct TraceWriter;
+struct input_event;
 
 typedef struct InputEngine InputEngine;
 
-InputEngine *input_engine_create(const char *device_path, const struct AccentConfig *config, struct Display *display, bool grab_device);
+InputEngine *input_engine_create(const struct AccentConfig *config, struct Display *display, struct OutputBackend *backend, bool grab_devices);
 void input_engine_destroy(InputEngine *engine);
+int input_engine_add_device(InputEngine *engine, const char *device_path);
+void input_engine_remove_device(InputEngine *engine, const char *device_path);
+bool input_engine_has_device(const InputEngine *engine, const char *device_path);
+size_t input_engine_device_count(const InputEngine *engine);
+void input_engine_set_hotplug(InputEngine *engine, bool enabled);
 int input_engine_run(InputEngine *engine);
+struct EventLoop *input_engine_get_loop(InputEngine *engine);
+
+/* Configuration handoff for hot reload, callable from any thread. The engine switches to a
+ * published configuration between event batches, once no keyboard is in an accent cycle;
+ * until input_engine_active_config returns it, the previous one may still be in use.
+ * input_engine_config_switch_fd becomes readable (eventfd) after each switch. */
+void input_engine_publish_config(InputEngine *engine, const struct AccentConfig *config);
+const struct AccentConfig *input_engine_active_config(InputEngine *engine);
+int input_engine_config_switch_fd(const InputEngine *engine);
+
+/* Profiles (profiles_dir). All profiles are loaded with the configuration, so a switch parses
+ * and allocates nothing; it goes through the same handoff as a reload and waits for an
+ * accent cycle or compose sequence in progress to end. Call on the engine thread, for
+ * instance from a signal handler of its event loop. Both return the selected profile's
+ * name, or NULL. */
+const char *input_engine_select_profile(InputEngine *engine, const char *name);
+const char *input_engine_next_profile(InputEngine *engine);
+
+/* Replay (bench_replay). A replay device has no file descriptor: its events come from
+ * input_engine_feed, which runs them through the same state machine as a read batch, without
+ * recording latency. add returns the index to feed. Devices are numbered in the order they
+ * are added, replay or not, as in traces. */
+int input_engine_add_replay_device(InputEngine *engine, const char *name);
+int input_engine_feed(InputEngine *engine, size_t device_index, const struct input_event *events, size_t count);
+/* Appends every event read from a device to trace (--record) until set to NULL. The writer
+ * must outlive the engine or be unset first. */
+void input_engine_set_trace(InputEngine *engine, struct TraceWriter *trace);
+
+/* Logs p50, p99, p99.9 and the maximum of the time from each event's kernel timestamp to
+ * the end of the output write, separately for passthrough keys, accent cycling and
+ * commits, since the engine started. Call on the engine thread. */
+void input_engine_log_latency(const InputEngine *engine);
 
 #endif /* ACCENTFLOW_INPUT_ENGINE_H */
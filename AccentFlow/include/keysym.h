@@ -0,0 +1,11 @@
+#ifndef ACCENTFLOW_KEYSYM_H
+#define ACCENTFLOW_KEYSYM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Unicode code point of an X keysym name ("eacute", "U00E9", "0x10000e9"), or 0.
+ * Dead keys resolve to their spacing accent so they can still serve as bases. */
+uint32_t keysym_to_codepoint(const char *name, size_t length);
+
+#endif /* ACCENTFLOW_KEYSYM_H */
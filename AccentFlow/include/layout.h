@@ -0,0 +1,26 @@
+#ifndef ACCENTFLOW_LAYOUT_H
+#define ACCENTFLOW_LAYOUT_H
+
+#include <linux/input-event-codes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Characters produced by each evdev keycode on its first two shift levels; 0 when none. */
+typedef struct KeyboardLayout {
+    uint32_t levels[KEY_CNT][2];
+} KeyboardLayout;
+
+/* Compiles an XKB layout and variant from the xkeyboard-config symbols files
+ * (XKB_CONFIG_ROOT, default /usr/share/X11/xkb). A NULL layout uses the system
+ * keyboard, as layout_resolve does. */
+bool layout_compile(KeyboardLayout *layout, const char *name, const char *variant, char *error, size_t error_size);
+/* The layout layout_compile uses for name and variant, written as "name" or "name(variant)".
+ * A NULL or empty name is the system keyboard from /etc/default/keyboard, falling back to
+ * "us"; that file is read once per process, so every load agrees on it. */
+void layout_resolve(const char *name, const char *variant, char *spec, size_t spec_size);
+void layout_load_us(KeyboardLayout *layout);
+/* True when Caps Lock switches the key to its second level, as for letters. */
+bool layout_key_is_alphabetic(const KeyboardLayout *layout, uint16_t keycode);
+
+#endif /* ACCENTFLOW_LAYOUT_H */
@@ -0,0 +1,72 @@
+#ifndef ACCENTFLOW_LOG_H
+#define ACCENTFLOW_LOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Logging. While the log thread runs (log_start to log_stop), a call site only copies a
+ * timestamp and its arguments into a ring owned by the calling thread; the log thread
+ * formats the lines and writes them to stderr in timestamp order. Before log_start and
+ * after log_stop, lines are formatted and written by the caller.
+ *
+ * Each warn, info or debug call site writes at most log_set_rate_limit lines per second
+ * (LOG_RATE_LIMIT by default); the next line it writes after that says how many were
+ * suppressed. Errors are not limited. */
+typedef enum {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+} LogLevel;
+
+#define LOG_RATE_LIMIT 20
+#define LOG_MAX_ARGS 10
+
+/* State of one call site, set up by the log macros. The argument types are parsed from
+ * the format on first use. */
+typedef struct LogSite {
+    LogLevel level;
+    const char *format;
+    _Atomic unsigned char parse_state;
+    unsigned char arg_count;
+    unsigned char arg_types[LOG_MAX_ARGS];
+    _Atomic uint64_t window_start_ns;
+    _Atomic uint32_t window_count;
+    _Atomic uint32_t suppressed;
+} LogSite;
+
+#define LOG_FORMAT_(format, ...) format
+#define LOG_AT(log_level_, ...)                                                                          \
+    do {                                                                                                 \
+        static LogSite log_site_ = {.level = (log_level_), .format = LOG_FORMAT_(__VA_ARGS__, 0)};       \
+        if (log_enabled(log_level_)) {                                                                   \
+            log_write(&log_site_, __VA_ARGS__);                                                          \
+        }                                                                                                \
+    } while (0)
+
+#define log_error(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) LOG_AT(LOG_WARN, __VA_ARGS__)
+#define log_info(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+
+bool log_enabled(LogLevel level);
+void log_write(LogSite *site, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Sets the level from its name; NULL means info. False for an unknown name. */
+bool log_set_level(const char *name);
+/* Lines per second and call site; 0 turns the limit off. */
+void log_set_rate_limit(uint32_t per_second);
+bool log_start(void);
+/* Writes what is queued and stops the log thread. Threads other than the caller must be
+ * done logging. */
+void log_stop(void);
+
+/* For a status line on stderr that has no newline yet: log lines wipe it before they are
+ * written. Both are called with stderr locked (flockfile). log_take_partial_line returns
+ * the width still on screen, or 0 if it is gone. */
+void log_partial_line(size_t columns);
+size_t log_take_partial_line(void);
+
+#endif /* ACCENTFLOW_LOG_H */
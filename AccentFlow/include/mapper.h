@@ -1,13 +1,27 @@
 #ifndef ACCENTFLOW_MAPPER_H
 #define ACCENTFLOW_MAPPER_H
 
+#include <linux/input-event-codes.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/* Modifier state selecting one of the precompiled keymap layers. */
+#define MAPPER_LAYER_SHIFT 1u
+#define MAPPER_LAYER_CAPS 2u
+#define MAPPER_LAYER_COUNT 4u
+/* Keycodes the keymap covers: the whole evdev key range, so a key the layout gives a
+ * character can always be a base, wherever it sits. */
+#define MAPPER_KEY_COUNT ((unsigned int)KEY_CNT)
+
 struct AccentConfig;
 struct AccentMapping;
 
-const struct AccentMapping *mapper_from_keycode(const struct AccentConfig *config, uint16_t keycode, char *out_base);
+bool mapper_compile(struct AccentConfig *config);
+const struct AccentMapping *mapper_from_keycode(const struct AccentConfig *config, uint16_t keycode, unsigned int layer);
+/* Character the key types on the layer, for compose sequences; 0 for keys such as
+ * modifiers, or when the configuration has no compose sequences. */
+uint32_t mapper_character_from_keycode(const struct AccentConfig *config, uint16_t keycode, unsigned int layer);
 const char *mapper_select_variant(const struct AccentMapping *mapping, size_t index);
 
 #endif /* ACCENTFLOW_MAPPER_H */
@@ -0,0 +1,66 @@
+#ifndef ACCENTFLOW_OUTPUT_BACKEND_H
+#define ACCENTFLOW_OUTPUT_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* USB id of the virtual keyboard, so discovery can skip it. */
+#define ACCENTFLOW_UINPUT_VENDOR 0x1fed
+#define ACCENTFLOW_UINPUT_PRODUCT 0x0001
+
+struct AccentSequence;
+struct input_event;
+
+typedef struct OutputBackendStats {
+    uint64_t forwarded_events;
+    uint64_t forward_writes;
+    uint64_t commits;
+    uint64_t commit_events;
+    uint64_t commit_writes;
+    uint64_t commit_ns;
+    uint64_t commit_ns_max;
+} OutputBackendStats;
+
+typedef struct OutputBackend OutputBackend;
+
+/* Ctrl and Shift keys the user holds during a commit. The sequence types its hex digits
+ * unshifted and ends with Ctrl and Shift up, so the backend releases these before it and
+ * presses them again after it, in the same write. */
+#define OUTPUT_MODIFIERS_MAX 4
+
+typedef struct OutputModifiers {
+    uint16_t keys[OUTPUT_MODIFIERS_MAX];
+    size_t count;
+} OutputModifiers;
+
+/* Backends bump the *_writes counters; event counts and timing are kept by the wrappers. */
+typedef struct OutputBackendOps {
+    const char *name;
+    int (*forward)(OutputBackend *backend, const struct input_event *event);
+    int (*commit)(OutputBackend *backend, const char *utf8, const struct AccentSequence *sequence,
+                  const OutputModifiers *held);
+    void (*destroy)(OutputBackend *backend);
+} OutputBackendOps;
+
+struct OutputBackend {
+    const OutputBackendOps *ops;
+    OutputBackendStats stats;
+};
+
+OutputBackend *output_backend_create(const char *spec, char **error_message);
+OutputBackend *output_backend_create_uinput(void);
+OutputBackend *output_backend_create_recorder(const char *path);
+void output_backend_destroy(OutputBackend *backend);
+int output_backend_forward(OutputBackend *backend, const struct input_event *event);
+/* held may be NULL. */
+int output_backend_commit(OutputBackend *backend, const char *utf8, const struct AccentSequence *sequence,
+                          const OutputModifiers *held);
+/* Sets every held modifier to value (0 up, 1 down) and ends with a SYN_REPORT; nothing when
+ * none is held. events has room for OUTPUT_MODIFIERS_MAX + 1; returns the count. */
+size_t output_modifier_events(const OutputModifiers *held, int32_t value, struct input_event *events);
+const char *output_backend_name(const OutputBackend *backend);
+void output_backend_get_stats(const OutputBackend *backend, OutputBackendStats *stats);
+const struct input_event *output_backend_recorded_events(const OutputBackend *backend, size_t *count);
+void output_backend_clear_recording(OutputBackend *backend);
+
+#endif /* ACCENTFLOW_OUTPUT_BACKEND_H */
@@ -0,0 +1,28 @@
+#ifndef ACCENTFLOW_SPSC_RING_H
+#define ACCENTFLOW_SPSC_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Lock-free ring of fixed-size slots for one producer thread and one consumer thread.
+ * The producer fills the slot from spsc_ring_reserve and hands it over with
+ * spsc_ring_publish; it never waits, and a full ring makes reserve return NULL.
+ * The consumer reads slots in order with spsc_ring_peek and frees them with
+ * spsc_ring_pop. Neither side makes a system call. */
+typedef struct SpscRing SpscRing;
+
+/* slot_count is rounded up to a power of two. */
+SpscRing *spsc_ring_create(size_t slot_size, size_t slot_count);
+void spsc_ring_destroy(SpscRing *ring);
+
+/* Producer side. */
+void *spsc_ring_reserve(SpscRing *ring);
+void spsc_ring_publish(SpscRing *ring);
+
+/* Consumer side. peek returns the offset-th published slot after the oldest, or NULL
+ * when fewer are available. */
+const void *spsc_ring_peek(SpscRing *ring, size_t offset);
+void spsc_ring_pop(SpscRing *ring);
+bool spsc_ring_empty(SpscRing *ring);
+
+#endif /* ACCENTFLOW_SPSC_RING_H */
@@ -0,0 +1,29 @@
+#ifndef ACCENTFLOW_TEXT_SCAN_H
+#define ACCENTFLOW_TEXT_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Vectorized scanning for the configuration parser. Each function picks the widest
+ * instruction set the CPU supports (AVX2, SSE2, then plain C) at call time. */
+typedef enum {
+    TEXT_SCAN_SCALAR,
+    TEXT_SCAN_SSE2,
+    TEXT_SCAN_AVX2
+} TextScanLevel;
+
+/* Widest level in use, after text_scan_limit. */
+TextScanLevel text_scan_level(void);
+/* Caps the instruction set, so benchmarks can compare the implementations. */
+void text_scan_limit(TextScanLevel level);
+const char *text_scan_level_name(TextScanLevel level);
+
+/* Index of the first byte at or after pos that is not JSON whitespace, or length. */
+size_t text_skip_whitespace(const char *data, size_t pos, size_t length);
+/* Index of the first '"' or '\\' at or after pos, or length. */
+size_t text_find_string_delimiter(const char *data, size_t pos, size_t length);
+/* Checks the whole buffer is well-formed UTF-8 (no overlongs, surrogates or code points
+ * past U+10FFFF); on failure *error_offset is the first bad byte. */
+bool text_validate_utf8(const char *data, size_t length, size_t *error_offset);
+
+#endif /* ACCENTFLOW_TEXT_SCAN_H */
@@ -0,0 +1,45 @@
+#ifndef ACCENTFLOW_TRACE_H
+#define ACCENTFLOW_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct input_event;
+
+/* Input trace: the raw evdev stream the engine read, as --record writes it, for replaying
+ * through input_engine_feed. A header is followed by fixed-size events; the time of each
+ * is stored as microseconds since the previous event. */
+#define TRACE_MAGIC "AFTRACE"
+#define TRACE_VERSION 1u
+
+typedef struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+} TraceHeader;
+
+typedef struct TraceEvent {
+    uint32_t delta_us;  /* saturates after 71 minutes */
+    uint16_t device;    /* order in which the daemon opened the device */
+    uint16_t type;
+    uint16_t code;
+    uint16_t reserved;
+    int32_t value;
+} TraceEvent;
+
+typedef struct TraceWriter TraceWriter;
+typedef struct Trace Trace;
+
+TraceWriter *trace_writer_create(const char *path, char **error_message);
+/* Buffered; an I/O error is logged once and recording stops. */
+void trace_writer_append(TraceWriter *writer, uint16_t device, const struct input_event *events, size_t count);
+void trace_writer_destroy(TraceWriter *writer);
+
+/* Maps a trace read-only. */
+Trace *trace_open(const char *path, char **error_message);
+void trace_close(Trace *trace);
+const TraceEvent *trace_events(const Trace *trace, size_t *count);
+/* Fills event from a trace event, time_us running through the trace from 0. */
+void trace_event_decode(const TraceEvent *trace_event, uint64_t *time_us, struct input_event *event);
+
+#endif /* ACCENTFLOW_TRACE_H */
@@ -0,0 +1,35 @@
+#ifndef ACCENTFLOW_UNICODE_SEQUENCE_H
+#define ACCENTFLOW_UNICODE_SEQUENCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct Arena;
+struct KeyboardLayout;
+struct input_event;
+
+/* Keys of the layout in use that type "u" and the hex digits 0-9a-f: the Ctrl+Shift+U
+ * entry reads characters, so on AZERTY the digits are shifted and on Dvorak "u" is KEY_F. */
+typedef struct UnicodeKeys {
+    uint16_t u;
+    uint16_t digits[16];
+    uint16_t shifted_digits; /* bit n: digit n is on the Shift level */
+} UnicodeKeys;
+
+extern const UnicodeKeys unicode_keys_us;
+/* Fills keys from layout; a character the layout does not have keeps its US key, and
+ * false is returned. */
+bool unicode_keys_from_layout(UnicodeKeys *keys, const struct KeyboardLayout *layout);
+
+/* Prebuilt Ctrl+Shift+U key events that type one variant string. */
+typedef struct AccentSequence {
+    struct input_event *events;
+    size_t event_count;
+} AccentSequence;
+
+/* The events are allocated from arena and released with it. keys NULL means US. */
+bool unicode_sequence_build(const char *utf8, const UnicodeKeys *keys, AccentSequence *sequence, struct Arena *arena,
+                            char *error, size_t error_size);
+
+#endif /* ACCENTFLOW_UNICODE_SEQUENCE_H */
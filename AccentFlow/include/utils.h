@@ -1,12 +1,21 @@
 #ifndef ACCENTFLOW_UTILS_H
 #define ACCENTFLOW_UTILS_H
 
-#include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "log.h"
 
-void log_info(const char *fmt, ...);
-void log_error(const char *fmt, ...);
 char *read_file_to_buffer(const char *path, size_t *length);
 char *duplicate_string(const char *src);
+uint64_t monotonic_time_ns(void);
+size_t utf8_to_codepoint(const char *utf8, uint32_t *codepoint);
+/* Writes codepoint as 1 to 4 bytes of UTF-8, not terminated, and returns how many. */
+size_t codepoint_to_utf8(uint32_t codepoint, char *out);
+/* Value of a hex digit of either case, or -1. */
+int hex_digit_value(char c);
+/* Uppercase partner of a lowercase letter, or 0; covers Latin-1, Latin Extended-A, Greek
+ * and Cyrillic, the scripts xkeyboard-config uses for Latin layouts. */
+uint32_t codepoint_upper_case(uint32_t codepoint);
 
 #endif /* ACCENTFLOW_UTILS_H */
@@ -1,46 +1,169 @@
 #include "accentflow.h"
 #include "config.h"
+#include "config_cache.h"
+#include "config_embed.h"
+#include "config_reload.h"
+#include "device_monitor.h"
 #include "display.h"
+#include "event_loop.h"
 #include "input_engine.h"
+#include "output_backend.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <getopt.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void usage(const char *program)
 {
-    fprintf(stderr, "Usage: %s [-c config] [-d device] [--no-grab]\n", program);
+    fprintf(stderr, "Usage: %s [-c config] [-u user-config] [-d device]... [-b backend] [--no-grab] [--spin-us usec]\n"
+                    "          [--record file]\n"
+                    "       %s [-c config] [-u user-config] [--cache file] --compile\n"
+                    "       %s [-c config] [-u user-config] --dump-config\n"
+                    "       %s [-c config] [-u user-config] --emit-c-header file.h\n", program, program, program, program);
+}
+
+/* --record: every event read from the input devices, for bench_replay. */
+static TraceWriter *start_recording(InputEngine *engine, const char *path)
+{
+    char *error_message = NULL;
+    TraceWriter *trace = trace_writer_create(path, &error_message);
+    if (!trace) {
+        log_error("%s", error_message ? error_message : "Unable to record input");
+        free(error_message);
+        return NULL;
+    }
+    input_engine_set_trace(engine, trace);
+    log_info("Recording input to %s", path);
+    return trace;
+}
+
+/* The merged mappings in preset syntax, each followed by the file it came from. */
+static void dump_config(const AccentConfig *config)
+{
+    for (size_t i = 0; i < config->layer_count; ++i) {
+        printf("# layer %zu: %s\n", i, config->layers[i]);
+    }
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        printf("%s =", mapping->base);
+        for (size_t j = 0; j < mapping->variant_count; ++j) {
+            printf("%s %s", j > 0 ? "," : "", mapping->variants[j]);
+        }
+        printf("    # %s\n", config->layers[mapping->layer]);
+    }
+}
+
+static int handle_reload_signal(EventLoop *loop, int signo, void *userdata)
+{
+    (void)loop;
+    if (!userdata) {
+        log_info("Received signal %d, but the built-in configuration cannot be reloaded", signo);
+        return 0;
+    }
+    log_info("Received signal %d, reloading configuration", signo);
+    config_reloader_request(userdata);
+    return 0;
+}
+
+static int handle_profile_signal(EventLoop *loop, int signo, void *userdata)
+{
+    (void)loop;
+    const char *profile = input_engine_next_profile(userdata);
+    if (profile) {
+        log_info("Received signal %d, switched to profile '%s'", signo, profile);
+    }
+    return 0;
+}
+
+static int handle_latency_signal(EventLoop *loop, int signo, void *userdata)
+{
+    (void)loop;
+    (void)signo;
+    input_engine_log_latency(userdata);
+    return 0;
+}
+
+static int handle_shutdown_signal(EventLoop *loop, int signo, void *userdata)
+{
+    (void)userdata;
+    log_info("Received signal %d, shutting down", signo);
+    event_loop_stop(loop);
+    return 0;
 }
 
 int main(int argc, char **argv)
 {
-    const char *config_path = "/etc/accentflow/config.json";
-    const char *device_path = NULL;
+    const char *config_path = NULL;
+    const char *device_paths[argc > 0 ? argc : 1];
+    size_t device_count = 0;
+    const char *backend_spec = NULL;
     bool grab_device = true;
+    unsigned int spin_usec = 0;
+    const char *cache_path = NULL;
+    bool compile_only = false;
+    bool dump_only = false;
+    const char *header_path = NULL;
+    const char *record_path = NULL;
+    TraceWriter *trace = NULL;
 
     static struct option long_options[] = {
         {"config", required_argument, 0, 'c'},
+        {"user-config", required_argument, 0, 'u'},
         {"device", required_argument, 0, 'd'},
+        {"backend", required_argument, 0, 'b'},
         {"no-grab", no_argument, 0, 'n'},
+        {"spin-us", required_argument, 0, 's'},
+        {"cache", required_argument, 0, 'K'},
+        {"compile", no_argument, 0, 'C'},
+        {"dump-config", no_argument, 0, 'D'},
+        {"emit-c-header", required_argument, 0, 'E'},
+        {"record", required_argument, 0, 'R'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "c:d:nh", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:u:d:b:ns:K:CDE:R:h", long_options, NULL)) != -1) {
         switch (opt) {
         case 'c':
             config_path = optarg;
             break;
+        case 'u':
+            config_set_user_file(optarg);
+            break;
         case 'd':
-            device_path = optarg;
+            device_paths[device_count++] = optarg;
+            break;
+        case 'b':
+            backend_spec = optarg;
             break;
         case 'n':
             grab_device = false;
             break;
+        case 's':
+            spin_usec = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'K':
+            cache_path = optarg;
+            break;
+        case 'C':
+            compile_only = true;
+            break;
+        case 'D':
+            dump_only = true;
+            break;
+        case 'E':
+            header_path = optarg;
+            break;
+        case 'R':
+            record_path = optarg;
+            break;
         case 'h':
         default:
             usage(argv[0]);
@@ -48,22 +171,85 @@ int main(int argc, char **argv)
         }
     }
 
+    /* A daemon built with a configuration uses it unless it is given one. */
+    AccentConfig *embedded = config_path || compile_only || header_path ? NULL : config_embedded();
+    if (!config_path) {
+        config_path = "/etc/accentflow/config.json";
+    }
+
+    /* A cache next to the configuration is picked up without --cache once --compile wrote it. */
+    char default_cache[4096];
+    snprintf(default_cache, sizeof(default_cache), "%s.cache", config_path);
+    if (!cache_path && !embedded && (compile_only || access(default_cache, F_OK) == 0)) {
+        cache_path = default_cache;
+    }
+
     char *error_message = NULL;
-    AccentConfig *config = config_load(config_path, &error_message);
+    if (header_path) {
+        AccentConfig *config = config_load(config_path, &error_message);
+        if (!config) {
+            log_error("Failed to load configuration: %s", error_message ? error_message : "unknown error");
+            free(error_message);
+            return EXIT_FAILURE;
+        }
+        bool written = config_embed_write(config, config_path, header_path, &error_message);
+        if (written) {
+            log_info("Wrote %zu mappings to %s", config->mapping_count, header_path);
+        } else {
+            log_error("Failed to write configuration header: %s", error_message ? error_message : "unknown error");
+        }
+        free(error_message);
+        config_free(config);
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (compile_only) {
+        AccentConfig *config = config_load(config_path, &error_message);
+        if (!config) {
+            log_error("Failed to load configuration: %s", error_message ? error_message : "unknown error");
+            free(error_message);
+            return EXIT_FAILURE;
+        }
+        bool written = config_cache_write(config, config_path, cache_path, &error_message);
+        if (written) {
+            log_info("Wrote %zu mappings to %s", config->mapping_count, cache_path);
+        } else {
+            log_error("Failed to write configuration cache: %s", error_message ? error_message : "unknown error");
+        }
+        free(error_message);
+        config_free(config);
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    AccentConfig *config = embedded;
+    if (!config) {
+        config = cache_path ? config_load_cached(config_path, cache_path, &error_message)
+                            : config_load(config_path, &error_message);
+    }
     if (!config) {
         log_error("Failed to load configuration: %s", error_message ? error_message : "unknown error");
         free(error_message);
         return EXIT_FAILURE;
     }
     free(error_message);
-
-    if (!device_path) {
-        device_path = config_get_input_device(config);
-    }
-    if (!device_path) {
-        log_error("No input device specified. Use --device or set input_device in the configuration file.");
+    if (dump_only) {
+        dump_config(config);
         config_free(config);
-        return EXIT_FAILURE;
+        return EXIT_SUCCESS;
+    }
+    /* From here on, call sites only queue their messages for the log thread. */
+    if (log_start()) {
+        atexit(log_stop);
+    }
+    if (!log_set_level(config_get_log_level(config))) {
+        log_warn("Unknown log_level '%s', keeping the current level", config_get_log_level(config));
+    }
+    if (config->layer_count > 1) {
+        log_info("Merged %zu mappings from %zu configuration files", config->mapping_count, config->layer_count);
+    }
+
+    const char *configured_device = config_get_input_device(config);
+    if (device_count == 0 && configured_device && strcmp(configured_device, "auto") != 0) {
+        device_paths[device_count++] = configured_device;
     }
 
     Display *display = display_create_tui();
@@ -73,13 +259,78 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    InputEngine *engine = input_engine_create(device_path, config, display, grab_device);
+    if (!backend_spec) {
+        backend_spec = config_get_output_backend(config);
+    }
+    OutputBackend *backend = output_backend_create(backend_spec, &error_message);
+    if (!backend) {
+        log_error("Unable to initialize output backend: %s", error_message ? error_message : "unknown error");
+        free(error_message);
+        display_destroy(display);
+        config_free(config);
+        return EXIT_FAILURE;
+    }
+
+    InputEngine *engine = input_engine_create(config, display, backend, grab_device);
     if (!engine) {
+        output_backend_destroy(backend);
         display_destroy(display);
         config_free(config);
         return EXIT_FAILURE;
     }
 
+    DeviceMonitor *monitor = NULL;
+    if (device_count == 0) {
+        monitor = device_monitor_create(engine);
+        if (!monitor) {
+            input_engine_destroy(engine);
+            output_backend_destroy(backend);
+            display_destroy(display);
+            config_free(config);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t i = 0; i < device_count; ++i) {
+        input_engine_add_device(engine, device_paths[i]);
+    }
+    if (!monitor && input_engine_device_count(engine) == 0) {
+        log_error("None of the requested input devices could be opened");
+        input_engine_destroy(engine);
+        output_backend_destroy(backend);
+        display_destroy(display);
+        config_free(config);
+        return EXIT_FAILURE;
+    }
+
+    /* From here on the reloader owns the configuration and frees it. A built-in
+     * configuration has no file to reload. */
+    ConfigReloader *reloader = NULL;
+    if (embedded) {
+        log_info("Using the configuration built into the daemon (%zu mappings)", config->mapping_count);
+    } else {
+        reloader = config_reloader_create(engine, config, config_path, cache_path);
+    }
+    EventLoop *loop = input_engine_get_loop(engine);
+    event_loop_set_spin(loop, spin_usec);
+    if ((!reloader && !embedded) ||
+        event_loop_add_signal(loop, SIGINT, handle_shutdown_signal, NULL) < 0 ||
+        event_loop_add_signal(loop, SIGTERM, handle_shutdown_signal, NULL) < 0 ||
+        event_loop_add_signal(loop, SIGHUP, handle_reload_signal, reloader) < 0 ||
+        event_loop_add_signal(loop, SIGUSR1, handle_latency_signal, engine) < 0 ||
+        event_loop_add_signal(loop, SIGUSR2, handle_profile_signal, engine) < 0 ||
+        (record_path && !(trace = start_recording(engine, record_path)))) {
+        device_monitor_destroy(monitor);
+        config_reloader_destroy(reloader);
+        input_engine_destroy(engine);
+        output_backend_destroy(backend);
+        display_destroy(display);
+        if (!reloader) {
+            config_free(config);
+        }
+        return EXIT_FAILURE;
+    }
+
     log_info("AccentFlow daemon started");
 
     int rc = input_engine_run(engine);
@@ -87,9 +338,27 @@ int main(int argc, char **argv)
         log_error("Input engine terminated with error");
     }
 
+    OutputBackendStats stats;
+    output_backend_get_stats(backend, &stats);
+    log_info("%s backend: forwarded %llu events in %llu writes; committed %llu variants (%llu events) in %llu writes",
+             output_backend_name(backend),
+             (unsigned long long)stats.forwarded_events, (unsigned long long)stats.forward_writes,
+             (unsigned long long)stats.commits, (unsigned long long)stats.commit_events,
+             (unsigned long long)stats.commit_writes);
+    if (stats.commits > 0) {
+        log_info("Commit cost: %.1f events, %llu ns average, %llu ns max",
+                 (double)stats.commit_events / (double)stats.commits,
+                 (unsigned long long)(stats.commit_ns / stats.commits),
+                 (unsigned long long)stats.commit_ns_max);
+    }
+    input_engine_log_latency(engine);
+
+    device_monitor_destroy(monitor);
+    config_reloader_destroy(reloader);
     input_engine_destroy(engine);
+    trace_writer_destroy(trace);
+    output_backend_destroy(backend);
     display_destroy(display);
-    config_free(config);
 
     log_info("AccentFlow daemon stopped");
     return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
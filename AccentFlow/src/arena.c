@@ -0,0 +1,136 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+#define ARENA_MAX_CHUNK_SIZE ((size_t)1 << 24)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+} ArenaChunk;
+
+struct Arena {
+    ArenaChunk *chunks;
+    size_t chunk_size;
+    size_t bytes_used;
+};
+
+static ArenaChunk *chunk_create(size_t size)
+{
+    ArenaChunk *chunk = calloc(1, sizeof(ArenaChunk) + size);
+    if (chunk) {
+        chunk->size = size;
+    }
+    return chunk;
+}
+
+Arena *arena_create(size_t chunk_size)
+{
+    Arena *arena = calloc(1, sizeof(Arena));
+    if (!arena) {
+        return NULL;
+    }
+    arena->chunk_size = chunk_size ? chunk_size : 4096;
+    return arena;
+}
+
+void arena_destroy(Arena *arena)
+{
+    if (!arena) {
+        return;
+    }
+    while (arena->chunks) {
+        ArenaChunk *chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+    free(arena);
+}
+
+static void *alloc_aligned(Arena *arena, size_t size, size_t alignment)
+{
+    if (!arena) {
+        return NULL;
+    }
+    ArenaChunk *chunk = arena->chunks;
+    if (chunk) {
+        size_t offset = (chunk->used + alignment - 1) & ~(alignment - 1);
+        if (offset <= chunk->size && chunk->size - offset >= size) {
+            chunk->used = offset + size;
+            arena->bytes_used += size;
+            return chunk->data + offset;
+        }
+    }
+
+    /* Big blocks get their own chunk behind the current one, which stays open for small ones. */
+    if (chunk && size > arena->chunk_size / 4) {
+        ArenaChunk *large = chunk_create(size);
+        if (!large) {
+            return NULL;
+        }
+        large->used = size;
+        large->next = chunk->next;
+        chunk->next = large;
+        arena->bytes_used += size;
+        return large->data;
+    }
+
+    /* Chunks double up to a cap, so a large table costs a logarithmic number of mallocs. */
+    size_t chunk_size = arena->chunk_size;
+    if (chunk && chunk_size < ARENA_MAX_CHUNK_SIZE) {
+        arena->chunk_size = chunk_size *= 2;
+    }
+    if (chunk_size < size) {
+        chunk_size = size;
+    }
+    chunk = chunk_create(chunk_size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->used = size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->bytes_used += size;
+    return chunk->data;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    return alloc_aligned(arena, size, ARENA_ALIGNMENT);
+}
+
+char *arena_strndup(Arena *arena, const char *text, size_t length)
+{
+    char *copy = alloc_aligned(arena, length + 1, 1);
+    if (copy) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+void arena_reset(Arena *arena)
+{
+    if (!arena || !arena->chunks) {
+        return;
+    }
+    ArenaChunk *keep = arena->chunks;
+    while (keep->next) {
+        ArenaChunk *chunk = keep->next;
+        keep->next = chunk->next;
+        free(chunk);
+    }
+    memset(keep->data, 0, keep->used);
+    keep->used = 0;
+    arena->bytes_used = 0;
+}
+
+size_t arena_bytes_used(const Arena *arena)
+{
+    return arena ? arena->bytes_used : 0;
+}
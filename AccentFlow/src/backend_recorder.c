@@ -0,0 +1,133 @@
+#include "output_backend.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Keeps the exact event stream the uinput backend would write, in memory or in a file. */
+typedef struct {
+    OutputBackend base;
+    FILE *file;
+    struct input_event *events;
+    size_t count;
+    size_t capacity;
+} RecorderBackend;
+
+/* writes is NULL for the parts of a commit after its first. */
+static int record_events(RecorderBackend *recorder, const struct input_event *events, size_t count, uint64_t *writes)
+{
+    if (count == 0) {
+        return 0;
+    }
+    if (recorder->file) {
+        if (fwrite(events, sizeof(*events), count, recorder->file) != count) {
+            log_error("Recorder write failed: %s", strerror(errno));
+            return -1;
+        }
+        if (writes) {
+            ++*writes;
+        }
+        return 0;
+    }
+
+    if (recorder->count + count > recorder->capacity) {
+        size_t capacity = recorder->capacity ? recorder->capacity : 1024;
+        while (capacity < recorder->count + count) {
+            capacity *= 2;
+        }
+        struct input_event *grown = realloc(recorder->events, capacity * sizeof(*grown));
+        if (!grown) {
+            log_error("Recorder out of memory");
+            return -1;
+        }
+        recorder->events = grown;
+        recorder->capacity = capacity;
+    }
+    memcpy(&recorder->events[recorder->count], events, count * sizeof(*events));
+    recorder->count += count;
+    if (writes) {
+        ++*writes;
+    }
+    return 0;
+}
+
+static int recorder_forward(OutputBackend *backend, const struct input_event *event)
+{
+    return record_events((RecorderBackend *)backend, event, 1, &backend->stats.forward_writes);
+}
+
+/* Counted as one write per commit, as uinput writes it. */
+static int recorder_commit(OutputBackend *backend, const char *utf8, const AccentSequence *sequence,
+                           const OutputModifiers *held)
+{
+    (void)utf8;
+    RecorderBackend *recorder = (RecorderBackend *)backend;
+    struct input_event released[OUTPUT_MODIFIERS_MAX + 1];
+    struct input_event pressed[OUTPUT_MODIFIERS_MAX + 1];
+    size_t modifier_count = output_modifier_events(held, 0, released);
+    output_modifier_events(held, 1, pressed);
+    if (record_events(recorder, released, modifier_count, NULL) < 0 ||
+        record_events(recorder, sequence->events, sequence->event_count, NULL) < 0 ||
+        record_events(recorder, pressed, modifier_count, NULL) < 0) {
+        return -1;
+    }
+    backend->stats.commit_writes++;
+    return 0;
+}
+
+static void recorder_destroy(OutputBackend *backend)
+{
+    RecorderBackend *recorder = (RecorderBackend *)backend;
+    if (recorder->file) {
+        fclose(recorder->file);
+    }
+    free(recorder->events);
+    free(recorder);
+}
+
+static const OutputBackendOps recorder_ops = {
+    .name = "recorder",
+    .forward = recorder_forward,
+    .commit = recorder_commit,
+    .destroy = recorder_destroy,
+};
+
+OutputBackend *output_backend_create_recorder(const char *path)
+{
+    RecorderBackend *recorder = calloc(1, sizeof(RecorderBackend));
+    if (!recorder) {
+        return NULL;
+    }
+    recorder->base.ops = &recorder_ops;
+    if (path) {
+        recorder->file = fopen(path, "wb");
+        if (!recorder->file) {
+            log_error("Unable to open recorder output %s: %s", path, strerror(errno));
+            free(recorder);
+            return NULL;
+        }
+    }
+    return &recorder->base;
+}
+
+const struct input_event *output_backend_recorded_events(const OutputBackend *backend, size_t *count)
+{
+    if (!backend || backend->ops != &recorder_ops) {
+        *count = 0;
+        return NULL;
+    }
+    const RecorderBackend *recorder = (const RecorderBackend *)backend;
+    *count = recorder->count;
+    return recorder->events;
+}
+
+void output_backend_clear_recording(OutputBackend *backend)
+{
+    if (backend && backend->ops == &recorder_ops) {
+        ((RecorderBackend *)backend)->count = 0;
+    }
+}
@@ -0,0 +1,180 @@
+#include "output_backend.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input-event-codes.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define UINPUT_OUTPUT_CAPACITY 128
+
+typedef struct {
+    OutputBackend base;
+    int fd;
+    /* Events queued for uinput; flushed at each SYN_REPORT or after a commit. */
+    struct input_event buffer[UINPUT_OUTPUT_CAPACITY];
+    size_t count;
+} UinputBackend;
+
+/* Writes the queued events. Whatever the kernel did not take stays queued for the next
+ * flush, so a failed write loses no events. */
+static int flush_output(UinputBackend *uinput, uint64_t *writes)
+{
+    const char *data = (const char *)uinput->buffer;
+    size_t size = uinput->count * sizeof(struct input_event);
+    size_t written = 0;
+    ssize_t rc = 0;
+    while (written < size) {
+        rc = write(uinput->fd, data + written, size - written);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        ++*writes;
+        written += (size_t)rc;
+    }
+    if (written == size) {
+        uinput->count = 0;
+        return 0;
+    }
+
+    log_error("uinput write failed after %zu of %zu bytes: %s", written, size,
+              rc < 0 ? strerror(errno) : "no progress");
+    size_t sent = written / sizeof(struct input_event);
+    memmove(uinput->buffer, &uinput->buffer[sent], (uinput->count - sent) * sizeof(struct input_event));
+    uinput->count -= sent;
+    return -1;
+}
+
+static int queue_events(UinputBackend *uinput, const struct input_event *events, size_t count, uint64_t *writes)
+{
+    while (count > 0) {
+        if (uinput->count == UINPUT_OUTPUT_CAPACITY && flush_output(uinput, writes) < 0) {
+            return -1;
+        }
+        size_t chunk = UINPUT_OUTPUT_CAPACITY - uinput->count;
+        if (chunk > count) {
+            chunk = count;
+        }
+        memcpy(&uinput->buffer[uinput->count], events, chunk * sizeof(*events));
+        uinput->count += chunk;
+        events += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+static int uinput_forward(OutputBackend *backend, const struct input_event *event)
+{
+    UinputBackend *uinput = (UinputBackend *)backend;
+    if (queue_events(uinput, event, 1, &backend->stats.forward_writes) < 0) {
+        return -1;
+    }
+    if (event->type == EV_SYN && event->code == SYN_REPORT) {
+        return flush_output(uinput, &backend->stats.forward_writes);
+    }
+    return 0;
+}
+
+/* The held modifiers' release, the sequence and their press again go out in one write. */
+static int uinput_commit(OutputBackend *backend, const char *utf8, const AccentSequence *sequence,
+                         const OutputModifiers *held)
+{
+    (void)utf8;
+    UinputBackend *uinput = (UinputBackend *)backend;
+    uint64_t *writes = &backend->stats.commit_writes;
+    struct input_event released[OUTPUT_MODIFIERS_MAX + 1];
+    struct input_event pressed[OUTPUT_MODIFIERS_MAX + 1];
+    size_t modifier_count = output_modifier_events(held, 0, released);
+    output_modifier_events(held, 1, pressed);
+    if (queue_events(uinput, released, modifier_count, writes) < 0 ||
+        queue_events(uinput, sequence->events, sequence->event_count, writes) < 0 ||
+        queue_events(uinput, pressed, modifier_count, writes) < 0) {
+        return -1;
+    }
+    return flush_output(uinput, writes);
+}
+
+static void uinput_destroy(OutputBackend *backend)
+{
+    UinputBackend *uinput = (UinputBackend *)backend;
+    if (uinput->fd >= 0) {
+        ioctl(uinput->fd, UI_DEV_DESTROY);
+        close(uinput->fd);
+    }
+    free(uinput);
+}
+
+static const OutputBackendOps uinput_ops = {
+    .name = "uinput",
+    .forward = uinput_forward,
+    .commit = uinput_commit,
+    .destroy = uinput_destroy,
+};
+
+static bool setup_uinput_device(UinputBackend *uinput)
+{
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        log_error("Unable to open /dev/uinput: %s", strerror(errno));
+        return false;
+    }
+
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0 ||
+        ioctl(fd, UI_SET_EVBIT, EV_SYN) < 0) {
+        log_error("Failed to configure uinput events: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    for (int key = KEY_ESC; key <= KEY_MICMUTE; ++key) {
+        ioctl(fd, UI_SET_KEYBIT, key);
+    }
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    snprintf(setup.name, sizeof(setup.name), "AccentFlow Virtual Keyboard");
+    setup.id.bustype = BUS_USB;
+    setup.id.vendor = ACCENTFLOW_UINPUT_VENDOR;
+    setup.id.product = ACCENTFLOW_UINPUT_PRODUCT;
+    setup.id.version = 1;
+
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0) {
+        log_error("Failed to setup uinput device: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (ioctl(fd, UI_DEV_CREATE) < 0) {
+        log_error("Failed to create uinput device: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    uinput->fd = fd;
+    return true;
+}
+
+OutputBackend *output_backend_create_uinput(void)
+{
+    UinputBackend *uinput = calloc(1, sizeof(UinputBackend));
+    if (!uinput) {
+        return NULL;
+    }
+    uinput->base.ops = &uinput_ops;
+    uinput->fd = -1;
+    if (!setup_uinput_device(uinput)) {
+        free(uinput);
+        return NULL;
+    }
+    return &uinput->base;
+}
@@ -0,0 +1,536 @@
+#include "compose.h"
+#include "arena.h"
+#include "config.h"
+#include "keysym.h"
+#include "text_scan.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COMPOSE_MAX_KEYS 16
+#define COMPOSE_MAX_TEXT 256
+#define COMPOSE_MAX_INCLUDE_DEPTH 4
+#define COMPOSE_DEFAULT_LOCALE "en_US.UTF-8"
+
+/* The trie grows in malloc'd buffers and is copied into the arena at its final size. */
+typedef struct {
+    ComposeTable table;
+    size_t edge_count;
+    size_t node_capacity;
+    size_t strings_capacity;
+    size_t skipped; /* sequences needing a key that types no character */
+    bool failed;
+} ComposeBuilder;
+
+/* Fibonacci hashing: the top bits of the product index a table of 2^(64 - shift) slots. */
+static size_t edge_slot(const ComposeEdge *edges, size_t mask, unsigned int shift, uint32_t state,
+                        uint32_t codepoint)
+{
+    uint64_t key = ((uint64_t)state << 32) | codepoint;
+    size_t index = (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift);
+    while (edges[index].codepoint && (edges[index].state != state || edges[index].codepoint != codepoint)) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+/* Enough slots for count edges to stay at most half full. */
+static unsigned int edge_bits(size_t count)
+{
+    unsigned int bits = 4;
+    while (((size_t)1 << bits) < count * 2) {
+        bits++;
+    }
+    return bits;
+}
+
+static void edge_table_init(ComposeTable *table, unsigned int bits, ComposeEdge *edges)
+{
+    table->edges = edges;
+    table->mask = ((size_t)1 << bits) - 1;
+    table->shift = 64 - bits;
+}
+
+static void edge_table_copy(ComposeTable *to, const ComposeTable *from)
+{
+    for (size_t i = 0; i <= from->mask; ++i) {
+        const ComposeEdge *edge = &from->edges[i];
+        if (edge->codepoint) {
+            to->edges[edge_slot(to->edges, to->mask, to->shift, edge->state, edge->codepoint)] = *edge;
+        }
+    }
+}
+
+/* Room for edges more transitions and states and a result of length bytes, so the
+ * insertion that follows cannot run out of memory halfway. */
+static bool builder_reserve(ComposeBuilder *builder, size_t edges, size_t length)
+{
+    ComposeTable *table = &builder->table;
+    if ((builder->edge_count + edges) * 2 > table->mask + 1) {
+        ComposeTable grown = *table;
+        unsigned int bits = edge_bits(builder->edge_count + edges);
+        ComposeEdge *slots = calloc((size_t)1 << bits, sizeof(ComposeEdge));
+        if (!slots) {
+            return false;
+        }
+        edge_table_init(&grown, bits, slots);
+        edge_table_copy(&grown, table);
+        free(table->edges);
+        *table = grown;
+    }
+    if (table->node_count + edges > builder->node_capacity) {
+        size_t capacity = builder->node_capacity ? builder->node_capacity * 2 : 256;
+        while (capacity < table->node_count + edges) {
+            capacity *= 2;
+        }
+        ComposeNode *nodes = realloc(table->nodes, capacity * sizeof(ComposeNode));
+        if (!nodes) {
+            return false;
+        }
+        table->nodes = nodes;
+        builder->node_capacity = capacity;
+    }
+    if (table->strings_size + length + 1 > builder->strings_capacity) {
+        size_t capacity = builder->strings_capacity ? builder->strings_capacity * 2 : 4096;
+        while (capacity < table->strings_size + length + 1) {
+            capacity *= 2;
+        }
+        char *strings = realloc(table->strings, capacity);
+        if (!strings) {
+            return false;
+        }
+        table->strings = strings;
+        builder->strings_capacity = capacity;
+    }
+    return true;
+}
+
+/* Needs a node reserved with builder_reserve. */
+static uint32_t builder_add_node(ComposeBuilder *builder)
+{
+    ComposeTable *table = &builder->table;
+    table->nodes[table->node_count].result = COMPOSE_NO_RESULT;
+    table->nodes[table->node_count].children = 0;
+    return (uint32_t)table->node_count++;
+}
+
+/* Stores the result of state, over its earlier one when the new text fits there. */
+static void builder_set_result(ComposeBuilder *builder, uint32_t state, const char *text, size_t length)
+{
+    ComposeTable *table = &builder->table;
+    uint32_t offset = table->nodes[state].result;
+    if (offset == COMPOSE_NO_RESULT || strlen(table->strings + offset) < length) {
+        offset = (uint32_t)table->strings_size;
+        table->strings_size += length + 1;
+    }
+    memcpy(table->strings + offset, text, length);
+    table->strings[offset + length] = '\0';
+    table->nodes[state].result = offset;
+}
+
+/* A later definition of the same sequence replaces the earlier one, as in XCompose. The
+ * part of the sequence already in the trie is walked first and everything the rest needs
+ * is reserved, so running out of memory leaves the trie as it was. */
+static void builder_insert(ComposeBuilder *builder, const uint32_t *keys, size_t count, const char *text,
+                           size_t text_length)
+{
+    ComposeTable *table = &builder->table;
+    if (builder->failed) {
+        return;
+    }
+    uint32_t state = COMPOSE_START;
+    size_t known = 0;
+    for (; known < count; ++known) {
+        size_t index = edge_slot(table->edges, table->mask, table->shift, state, keys[known]);
+        if (!table->edges[index].codepoint) {
+            break;
+        }
+        state = table->edges[index].target;
+    }
+    if (known == count && table->nodes[state].children > 0) {
+        return;
+    }
+    if (!builder_reserve(builder, count - known, text_length)) {
+        builder->failed = true;
+        return;
+    }
+
+    state = COMPOSE_START;
+    for (size_t i = 0; i < count; ++i) {
+        /* A shorter sequence on the way is now a prefix of this one, and loses. */
+        table->nodes[state].result = COMPOSE_NO_RESULT;
+        size_t index = edge_slot(table->edges, table->mask, table->shift, state, keys[i]);
+        if (i >= known) {
+            table->edges[index].state = state;
+            table->edges[index].codepoint = keys[i];
+            table->edges[index].target = builder_add_node(builder);
+            table->nodes[state].children++;
+            builder->edge_count++;
+        }
+        state = table->edges[index].target;
+    }
+    builder_set_result(builder, state, text, text_length);
+}
+
+static const char *skip_blanks(const char *pos, const char *end)
+{
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+static int octal_digit(char c)
+{
+    return (c >= '0' && c <= '7') ? c - '0' : -1;
+}
+
+/* A quoted XCompose string with \\, \", octal \ooo and hex \xhh escapes; returns the
+ * position after the closing quote, or NULL when it is malformed or too long. */
+static const char *parse_quoted(const char *pos, const char *end, char *text, size_t *length)
+{
+    size_t count = 0;
+    for (++pos; pos < end && *pos != '"'; ++pos) {
+        unsigned int byte = (unsigned char)*pos;
+        if (byte == '\\' && pos + 1 < end) {
+            ++pos;
+            if (*pos == 'x' || *pos == 'X') {
+                byte = 0;
+                for (int i = 0; i < 2 && pos + 1 < end && hex_digit_value(pos[1]) >= 0; ++i) {
+                    byte = byte * 16 + (unsigned int)hex_digit_value(*++pos);
+                }
+            } else if (octal_digit(*pos) >= 0) {
+                byte = (unsigned int)octal_digit(*pos);
+                for (int i = 0; i < 2 && pos + 1 < end && octal_digit(pos[1]) >= 0; ++i) {
+                    byte = byte * 8 + (unsigned int)octal_digit(*++pos);
+                }
+            } else {
+                byte = (unsigned char)*pos;
+            }
+        }
+        if (byte == 0 || byte > 0xFF || count + 1 >= COMPOSE_MAX_TEXT) {
+            return NULL;
+        }
+        text[count++] = (char)byte;
+    }
+    if (pos >= end) {
+        return NULL;
+    }
+    *length = count;
+    return pos + 1;
+}
+
+static const char *locale_directory(void)
+{
+    const char *directory = getenv("XLOCALEDIR");
+    return directory && *directory ? directory : "/usr/share/X11/locale";
+}
+
+/* The system table for the current locale, looked up in compose.dir like libX11 does. */
+static void locale_compose_path(char *path, size_t size)
+{
+    const char *names[] = {"LC_ALL", "LC_CTYPE", "LANG"};
+    const char *locale = COMPOSE_DEFAULT_LOCALE;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        const char *value = getenv(names[i]);
+        if (value && *value) {
+            locale = value;
+            break;
+        }
+    }
+
+    snprintf(path, size, "%s/compose.dir", locale_directory());
+    size_t length = 0;
+    char *data = read_file_to_buffer(path, &length);
+    snprintf(path, size, "%s/" COMPOSE_DEFAULT_LOCALE "/Compose", locale_directory());
+    if (!data) {
+        return;
+    }
+    size_t locale_length = strlen(locale);
+    for (char *line = data; line < data + length;) {
+        char *newline = memchr(line, '\n', (size_t)(data + length - line));
+        char *line_end = newline ? newline : data + length;
+        char *file = (char *)skip_blanks(line, line_end);
+        char *file_end = file;
+        while (file_end < line_end && *file_end != ' ' && *file_end != '\t' && *file_end != ':') {
+            file_end++;
+        }
+        const char *name = skip_blanks(file_end < line_end && *file_end == ':' ? file_end + 1 : file_end, line_end);
+        if (*file != '#' && file_end > file && (size_t)(line_end - name) >= locale_length &&
+            memcmp(name, locale, locale_length) == 0 &&
+            skip_blanks(name + locale_length, line_end) == line_end) {
+            snprintf(path, size, "%s/%.*s", locale_directory(), (int)(file_end - file), file);
+            break;
+        }
+        line = line_end + 1;
+    }
+    free(data);
+}
+
+/* Expands %L (the locale's system table), %S (the X11 locale directory), %H ($HOME) and %%. */
+static bool expand_compose_path(const char *spec, size_t length, char *path, size_t size)
+{
+    size_t used = 0;
+    for (size_t i = 0; i < length; ++i) {
+        char expansion[4096];
+        const char *piece = expansion;
+        if (spec[i] == '%' && i + 1 < length) {
+            switch (spec[++i]) {
+            case 'L': locale_compose_path(expansion, sizeof(expansion)); break;
+            case 'S': piece = locale_directory(); break;
+            case 'H': piece = getenv("HOME") ? getenv("HOME") : ""; break;
+            default: snprintf(expansion, sizeof(expansion), "%c", spec[i]); break;
+            }
+        } else {
+            snprintf(expansion, sizeof(expansion), "%c", spec[i]);
+        }
+        size_t piece_length = strlen(piece);
+        if (used + piece_length >= size) {
+            return false;
+        }
+        memcpy(path + used, piece, piece_length);
+        used += piece_length;
+    }
+    path[used] = '\0';
+    return true;
+}
+
+static void load_compose_file(ComposeBuilder *builder, const char *path, int depth);
+
+static void parse_include(ComposeBuilder *builder, const char *pos, const char *end, const char *file, int depth)
+{
+    char spec[COMPOSE_MAX_TEXT];
+    size_t length = 0;
+    char path[4096];
+    pos = skip_blanks(pos, end);
+    if (pos >= end || *pos != '"' || !parse_quoted(pos, end, spec, &length) ||
+        !expand_compose_path(spec, length, path, sizeof(path))) {
+        log_error("%s: malformed include", file);
+        return;
+    }
+    if (depth >= COMPOSE_MAX_INCLUDE_DEPTH) {
+        log_error("%s: includes nested too deeply at %s", file, path);
+        return;
+    }
+    load_compose_file(builder, path, depth + 1);
+}
+
+/* "<Multi_key> <o> <slash> : "ø" oslash # comment". Sequences that start with a dead key
+ * are left to the input method; lines with modifiers are not supported. */
+static void parse_line(ComposeBuilder *builder, const char *pos, const char *end, const char *file, int depth)
+{
+    pos = skip_blanks(pos, end);
+    if (pos == end || *pos == '#') {
+        return;
+    }
+    if ((size_t)(end - pos) > 7 && memcmp(pos, "include", 7) == 0) {
+        parse_include(builder, pos + 7, end, file, depth);
+        return;
+    }
+    if ((size_t)(end - pos) < 11 || memcmp(pos, "<Multi_key>", 11) != 0) {
+        return;
+    }
+    pos += 11;
+
+    uint32_t keys[COMPOSE_MAX_KEYS];
+    size_t count = 0;
+    bool typeable = true;
+    while ((pos = skip_blanks(pos, end)) < end && *pos == '<') {
+        const char *close = memchr(pos, '>', (size_t)(end - pos));
+        if (!close) {
+            return;
+        }
+        uint32_t codepoint = keysym_to_codepoint(pos + 1, (size_t)(close - pos - 1));
+        if (!codepoint || count == COMPOSE_MAX_KEYS) {
+            typeable = false;
+        } else {
+            keys[count++] = codepoint;
+        }
+        pos = close + 1;
+    }
+    if (pos == end || *pos != ':') {
+        return;
+    }
+
+    char text[COMPOSE_MAX_TEXT];
+    size_t text_length = 0;
+    pos = skip_blanks(pos + 1, end);
+    if (pos < end && *pos == '"' && !(pos = parse_quoted(pos, end, text, &text_length))) {
+        return;
+    }
+    if (text_length == 0) {
+        /* No string: the keysym names the result. */
+        pos = skip_blanks(pos, end);
+        const char *name = pos;
+        while (pos < end && *pos != ' ' && *pos != '\t' && *pos != '#' && *pos != '\r') {
+            pos++;
+        }
+        uint32_t codepoint = keysym_to_codepoint(name, (size_t)(pos - name));
+        if (codepoint) {
+            text_length = codepoint_to_utf8(codepoint, text);
+        }
+    }
+    if (!typeable || count == 0 || text_length == 0 || !text_validate_utf8(text, text_length, NULL)) {
+        builder->skipped++;
+        return;
+    }
+    builder_insert(builder, keys, count, text, text_length);
+}
+
+static void load_compose_file(ComposeBuilder *builder, const char *path, int depth)
+{
+    size_t length = 0;
+    char *data = read_file_to_buffer(path, &length);
+    if (!data) {
+        return;
+    }
+    for (const char *line = data; line < data + length && !builder->failed;) {
+        const char *newline = memchr(line, '\n', (size_t)(data + length - line));
+        const char *line_end = newline ? newline : data + length;
+        parse_line(builder, line, line_end, path, depth);
+        line = line_end + 1;
+    }
+    free(data);
+}
+
+/* Bases of two or more characters ("ae", or "o /" with spaces for readability) are compose
+ * sequences typing their first variant. */
+static void add_config_sequences(ComposeBuilder *builder, const AccentConfig *config)
+{
+    for (size_t i = 0; i < config->mapping_count && !builder->failed; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        uint32_t keys[COMPOSE_MAX_KEYS];
+        size_t count = 0;
+        bool valid = mapping->variant_count > 0;
+        for (const char *cursor = mapping->base; *cursor && valid;) {
+            uint32_t codepoint = 0;
+            size_t consumed = utf8_to_codepoint(cursor, &codepoint);
+            if (consumed == 0 || count == COMPOSE_MAX_KEYS) {
+                valid = false;
+                break;
+            }
+            cursor += consumed;
+            if (codepoint != ' ') {
+                keys[count++] = codepoint;
+            }
+        }
+        if (valid && count >= 2) {
+            builder_insert(builder, keys, count, mapping->variants[0], strlen(mapping->variants[0]));
+        }
+    }
+}
+
+/* Copies the finished trie into the arena, with the transition table sized for its edges. */
+static ComposeTable *builder_finish(ComposeBuilder *builder, Arena *arena)
+{
+    const ComposeTable *built = &builder->table;
+    ComposeTable *table = arena_alloc(arena, sizeof(ComposeTable));
+    unsigned int bits = edge_bits(builder->edge_count);
+    ComposeEdge *edges = arena_alloc(arena, ((size_t)1 << bits) * sizeof(ComposeEdge));
+    ComposeNode *nodes = arena_alloc(arena, built->node_count * sizeof(ComposeNode));
+    /* Only the results still reachable are copied: replaced ones and those of sequences that
+     * became prefixes stay behind in the scratch pool. */
+    size_t strings_size = 0;
+    for (size_t i = 0; i < built->node_count; ++i) {
+        if (built->nodes[i].result != COMPOSE_NO_RESULT) {
+            strings_size += strlen(built->strings + built->nodes[i].result) + 1;
+        }
+    }
+    char *strings = arena_alloc(arena, strings_size ? strings_size : 1);
+    if (!table || !edges || !nodes || !strings) {
+        return NULL;
+    }
+    edge_table_init(table, bits, edges);
+    edge_table_copy(table, built);
+    table->nodes = nodes;
+    table->node_count = built->node_count;
+    table->strings = strings;
+    for (size_t i = 0; i < table->node_count; ++i) {
+        nodes[i] = built->nodes[i];
+        if (nodes[i].result == COMPOSE_NO_RESULT) {
+            continue;
+        }
+        size_t length = strlen(built->strings + nodes[i].result) + 1;
+        memcpy(strings + table->strings_size, built->strings + nodes[i].result, length);
+        nodes[i].result = (uint32_t)table->strings_size;
+        table->strings_size += length;
+        table->sequence_count++;
+    }
+    return table;
+}
+
+bool compose_build(AccentConfig *config)
+{
+    config->compose = NULL;
+    ComposeBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    unsigned int bits = edge_bits(0);
+    ComposeEdge *edges = calloc((size_t)1 << bits, sizeof(ComposeEdge));
+    edge_table_init(&builder.table, bits, edges);
+    if (!edges || !builder_reserve(&builder, 1, 0) || builder_add_node(&builder) == COMPOSE_NONE) {
+        free(builder.table.edges);
+        free(builder.table.nodes);
+        return false;
+    }
+
+    char path[4096];
+    if (config->compose_file) {
+        if (expand_compose_path(config->compose_file, strlen(config->compose_file), path, sizeof(path))) {
+            load_compose_file(&builder, path, 0);
+        } else {
+            log_error("Compose file path too long: %s", config->compose_file);
+        }
+    }
+    add_config_sequences(&builder, config);
+
+    bool ok = !builder.failed;
+    if (ok && builder.edge_count > 0) {
+        config->compose = builder_finish(&builder, config->arena);
+        ok = config->compose != NULL;
+    }
+    if (ok && config->compose_file) {
+        log_info("Compose table: %zu sequences in %zu KiB, %zu skipped (keys that type no character)",
+                 compose_sequence_count(config->compose), compose_table_bytes(config->compose) / 1024,
+                 builder.skipped);
+    }
+    free(builder.table.edges);
+    free(builder.table.nodes);
+    free(builder.table.strings);
+    return ok;
+}
+
+uint32_t compose_step(const ComposeTable *table, uint32_t state, uint32_t codepoint)
+{
+    if (!codepoint) {
+        return COMPOSE_NONE;
+    }
+    const ComposeEdge *edge = &table->edges[edge_slot(table->edges, table->mask, table->shift, state, codepoint)];
+    return edge->codepoint ? edge->target : COMPOSE_NONE;
+}
+
+const char *compose_result(const ComposeTable *table, uint32_t state)
+{
+    uint32_t offset = table->nodes[state].result;
+    return offset == COMPOSE_NO_RESULT ? NULL : table->strings + offset;
+}
+
+size_t compose_sequence_count(const ComposeTable *table)
+{
+    return table ? table->sequence_count : 0;
+}
+
+size_t compose_state_count(const ComposeTable *table)
+{
+    return table ? table->node_count : 0;
+}
+
+size_t compose_table_bytes(const ComposeTable *table)
+{
+    if (!table) {
+        return 0;
+    }
+    return sizeof(ComposeTable) + (table->mask + 1) * sizeof(ComposeEdge) + table->node_count * sizeof(ComposeNode) +
+           table->strings_size;
+}
@@ -0,0 +1,540 @@
+#include "config_cache.h"
+#include "config.h"
+#include "arena.h"
+#include "layout.h"
+#include "mapper.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CONFIG_CACHE_MAGIC "AFCACHE"
+#define CONFIG_CACHE_VERSION 6u
+#define CONFIG_CACHE_NO_STRING UINT32_MAX
+
+enum {
+    CACHE_SETTING_INPUT_DEVICE,
+    CACHE_SETTING_DISPLAY_MODE,
+    CACHE_SETTING_OUTPUT_BACKEND,
+    CACHE_SETTING_XKB_LAYOUT,
+    CACHE_SETTING_XKB_VARIANT,
+    CACHE_SETTING_COMPOSE_FILE,
+    CACHE_SETTING_PROFILES_DIR,
+    CACHE_SETTING_STARTUP_PROFILE,
+    CACHE_SETTING_LOG_LEVEL,
+    CACHE_SETTING_LAYOUT,
+    CACHE_SETTING_COUNT
+};
+
+/* All offsets are bytes from the start of the image. */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+    uint64_t source_stamp;
+    uint64_t image_size;
+    uint32_t mapping_count;
+    uint32_t variant_count;
+    uint32_t event_count;
+    uint32_t include_count;
+    uint32_t exclude_count;
+    uint32_t layer_count;
+    uint32_t mappings_offset;
+    uint32_t variants_offset;
+    uint32_t events_offset;
+    uint32_t lists_offset;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    uint32_t settings[CACHE_SETTING_COUNT];
+} CacheHeader;
+
+typedef struct {
+    uint32_t base;
+    uint32_t first_variant;
+    uint32_t variant_count;
+    uint32_t layer;
+} CacheMapping;
+
+typedef struct {
+    uint32_t text;
+    uint32_t first_event;
+    uint32_t event_count;
+} CacheVariant;
+
+static char **setting_field(struct AccentConfig *config, int setting)
+{
+    switch (setting) {
+    case CACHE_SETTING_INPUT_DEVICE: return &config->input_device;
+    case CACHE_SETTING_DISPLAY_MODE: return &config->display_mode;
+    case CACHE_SETTING_OUTPUT_BACKEND: return &config->output_backend;
+    case CACHE_SETTING_XKB_LAYOUT: return &config->xkb_layout;
+    case CACHE_SETTING_XKB_VARIANT: return &config->xkb_variant;
+    case CACHE_SETTING_COMPOSE_FILE: return &config->compose_file;
+    case CACHE_SETTING_PROFILES_DIR: return &config->profiles_dir;
+    case CACHE_SETTING_LOG_LEVEL: return &config->log_level;
+    case CACHE_SETTING_LAYOUT: return &config->layout;
+    default: return &config->startup_profile;
+    }
+}
+
+static void set_error(char **error_message, const char *fmt, const char *detail)
+{
+    if (!error_message) {
+        return;
+    }
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), fmt, detail);
+    *error_message = duplicate_string(buffer);
+}
+
+static size_t align8(size_t value)
+{
+    return (value + 7u) & ~(size_t)7u;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+/* Path, size and mtime of every layer folded into one value, so adding, removing or
+ * editing any of them makes the image out of date. */
+static bool source_stamp(char *const *layers, size_t layer_count, uint64_t *stamp)
+{
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < layer_count; ++i) {
+        struct stat st;
+        if (stat(layers[i], &st) < 0) {
+            return false;
+        }
+        uint64_t fields[2] = {(uint64_t)st.st_mtim.tv_sec * 1000000000u + (uint64_t)st.st_mtim.tv_nsec,
+                              (uint64_t)st.st_size};
+        hash = hash_bytes(hash, layers[i], strlen(layers[i]) + 1);
+        hash = hash_bytes(hash, fields, sizeof(fields));
+    }
+    *stamp = hash;
+    return true;
+}
+
+typedef struct {
+    char *image;
+    uint32_t offset;
+} StringPool;
+
+static uint32_t pool_add(StringPool *pool, const char *text)
+{
+    if (!text) {
+        return CONFIG_CACHE_NO_STRING;
+    }
+    uint32_t offset = pool->offset;
+    size_t length = strlen(text) + 1;
+    memcpy(pool->image + offset, text, length);
+    pool->offset += (uint32_t)length;
+    return offset;
+}
+
+typedef struct {
+    const struct input_event *events;
+    uint32_t first_event;
+} EventSlot;
+
+/* Sequences shared in memory are written once; returns the slot for events. */
+static EventSlot *event_slot(EventSlot *slots, size_t mask, const struct input_event *events)
+{
+    size_t index = (size_t)(((uintptr_t)events >> 4) * 2654435761u) & mask;
+    while (slots[index].events && slots[index].events != events) {
+        index = (index + 1) & mask;
+    }
+    return &slots[index];
+}
+
+bool config_cache_write(const AccentConfig *config, const char *source_path, const char *cache_path,
+                        char **error_message)
+{
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONFIG_CACHE_MAGIC, sizeof(header.magic));
+    header.version = CONFIG_CACHE_VERSION;
+    header.event_size = sizeof(struct input_event);
+    if (!source_stamp(config->layers, config->layer_count, &header.source_stamp)) {
+        set_error(error_message, "Unable to stat the files merged into %s", source_path);
+        return false;
+    }
+
+    size_t variant_count = 0;
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        variant_count += config->mappings[i].variant_count;
+    }
+    size_t slot_capacity = 16;
+    while (slot_capacity < variant_count * 2) {
+        slot_capacity <<= 1;
+    }
+    EventSlot *slots = calloc(slot_capacity, sizeof(EventSlot));
+    if (!slots) {
+        set_error(error_message, "Out of memory while caching %s", source_path);
+        return false;
+    }
+
+    size_t event_count = 0;
+    size_t strings_size = 0;
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        strings_size += strlen(mapping->base) + 1;
+        for (size_t j = 0; j < mapping->variant_count; ++j) {
+            strings_size += strlen(mapping->variants[j]) + 1;
+            EventSlot *slot = event_slot(slots, slot_capacity - 1, mapping->sequences[j].events);
+            if (!slot->events) {
+                slot->events = mapping->sequences[j].events;
+                slot->first_event = (uint32_t)event_count;
+                event_count += mapping->sequences[j].event_count;
+            }
+        }
+    }
+    for (int setting = 0; setting < CACHE_SETTING_COUNT; ++setting) {
+        const char *value = *setting_field((AccentConfig *)config, setting);
+        strings_size += value ? strlen(value) + 1 : 0;
+    }
+    for (size_t i = 0; i < config->device_include_count; ++i) {
+        strings_size += strlen(config->device_include[i]) + 1;
+    }
+    for (size_t i = 0; i < config->device_exclude_count; ++i) {
+        strings_size += strlen(config->device_exclude[i]) + 1;
+    }
+    for (size_t i = 0; i < config->layer_count; ++i) {
+        strings_size += strlen(config->layers[i]) + 1;
+    }
+
+    size_t list_count = config->device_include_count + config->device_exclude_count + config->layer_count;
+    size_t mappings_offset = align8(sizeof(CacheHeader));
+    size_t variants_offset = mappings_offset + config->mapping_count * sizeof(CacheMapping);
+    size_t events_offset = align8(variants_offset + variant_count * sizeof(CacheVariant));
+    size_t lists_offset = events_offset + event_count * sizeof(struct input_event);
+    size_t strings_offset = lists_offset + list_count * sizeof(uint32_t);
+    size_t image_size = strings_offset + strings_size;
+    if (image_size > UINT32_MAX) {
+        free(slots);
+        set_error(error_message, "Configuration %s is too large to cache", source_path);
+        return false;
+    }
+
+    char *image = calloc(1, image_size);
+    if (!image) {
+        free(slots);
+        set_error(error_message, "Out of memory while caching %s", source_path);
+        return false;
+    }
+    header.image_size = image_size;
+    header.mapping_count = (uint32_t)config->mapping_count;
+    header.variant_count = (uint32_t)variant_count;
+    header.event_count = (uint32_t)event_count;
+    header.include_count = (uint32_t)config->device_include_count;
+    header.exclude_count = (uint32_t)config->device_exclude_count;
+    header.layer_count = (uint32_t)config->layer_count;
+    header.mappings_offset = (uint32_t)mappings_offset;
+    header.variants_offset = (uint32_t)variants_offset;
+    header.events_offset = (uint32_t)events_offset;
+    header.lists_offset = (uint32_t)lists_offset;
+    header.strings_offset = (uint32_t)strings_offset;
+    header.strings_size = (uint32_t)strings_size;
+
+    StringPool pool = {image + strings_offset, 0};
+    CacheMapping *mappings = (CacheMapping *)(image + mappings_offset);
+    CacheVariant *variants = (CacheVariant *)(image + variants_offset);
+    struct input_event *events = (struct input_event *)(image + events_offset);
+    uint32_t *lists = (uint32_t *)(image + lists_offset);
+    uint32_t next_variant = 0;
+
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        mappings[i].base = pool_add(&pool, mapping->base);
+        mappings[i].first_variant = next_variant;
+        mappings[i].variant_count = (uint32_t)mapping->variant_count;
+        mappings[i].layer = mapping->layer;
+        for (size_t j = 0; j < mapping->variant_count; ++j) {
+            const AccentSequence *sequence = &mapping->sequences[j];
+            CacheVariant *variant = &variants[next_variant++];
+            variant->text = pool_add(&pool, mapping->variants[j]);
+            variant->first_event = event_slot(slots, slot_capacity - 1, sequence->events)->first_event;
+            variant->event_count = (uint32_t)sequence->event_count;
+            memcpy(&events[variant->first_event], sequence->events, sequence->event_count * sizeof(struct input_event));
+        }
+    }
+    free(slots);
+    for (int setting = 0; setting < CACHE_SETTING_COUNT; ++setting) {
+        header.settings[setting] = pool_add(&pool, *setting_field((AccentConfig *)config, setting));
+    }
+    for (size_t i = 0; i < config->device_include_count; ++i) {
+        lists[i] = pool_add(&pool, config->device_include[i]);
+    }
+    for (size_t i = 0; i < config->device_exclude_count; ++i) {
+        lists[config->device_include_count + i] = pool_add(&pool, config->device_exclude[i]);
+    }
+    for (size_t i = 0; i < config->layer_count; ++i) {
+        lists[config->device_include_count + config->device_exclude_count + i] = pool_add(&pool, config->layers[i]);
+    }
+    memcpy(image, &header, sizeof(header));
+
+    /* Write beside the target and rename, so running daemons keep their mapping intact. */
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", cache_path, (long)getpid());
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        set_error(error_message, "Unable to create a temporary file next to %s", cache_path);
+        free(image);
+        return false;
+    }
+    size_t written = 0;
+    while (written < image_size) {
+        ssize_t rc = write(fd, image + written, image_size - written);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        written += (size_t)rc;
+    }
+    free(image);
+    if (close(fd) < 0 || written != image_size || rename(temp_path, cache_path) < 0) {
+        unlink(temp_path);
+        set_error(error_message, "Unable to write %s", cache_path);
+        return false;
+    }
+    return true;
+}
+
+static bool region_fits(const CacheHeader *header, uint64_t offset, uint64_t count, uint64_t element_size)
+{
+    return offset <= header->image_size && count * element_size <= header->image_size - offset;
+}
+
+static bool string_fits(const CacheHeader *header, uint32_t offset, bool optional)
+{
+    return (optional && offset == CONFIG_CACHE_NO_STRING) || offset < header->strings_size;
+}
+
+/* Bounds-checks every offset so a truncated or foreign file cannot send the daemon out of the image. */
+static bool validate_image(const CacheHeader *header, const char *image)
+{
+    uint64_t list_count = (uint64_t)header->include_count + header->exclude_count + header->layer_count;
+    if (!region_fits(header, header->mappings_offset, header->mapping_count, sizeof(CacheMapping)) ||
+        !region_fits(header, header->variants_offset, header->variant_count, sizeof(CacheVariant)) ||
+        !region_fits(header, header->events_offset, header->event_count, sizeof(struct input_event)) ||
+        !region_fits(header, header->lists_offset, list_count, sizeof(uint32_t)) ||
+        !region_fits(header, header->strings_offset, header->strings_size, 1) ||
+        header->mappings_offset % sizeof(uint32_t) != 0 || header->variants_offset % sizeof(uint32_t) != 0 ||
+        header->lists_offset % sizeof(uint32_t) != 0 || header->events_offset % 8 != 0) {
+        return false;
+    }
+    if (header->strings_size > 0 && image[header->strings_offset + header->strings_size - 1] != '\0') {
+        return false;
+    }
+
+    const CacheMapping *mappings = (const CacheMapping *)(image + header->mappings_offset);
+    const CacheVariant *variants = (const CacheVariant *)(image + header->variants_offset);
+    const uint32_t *lists = (const uint32_t *)(image + header->lists_offset);
+    for (uint32_t i = 0; i < header->mapping_count; ++i) {
+        if (!string_fits(header, mappings[i].base, false) || mappings[i].layer >= header->layer_count ||
+            (uint64_t)mappings[i].first_variant + mappings[i].variant_count > header->variant_count) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->variant_count; ++i) {
+        if (!string_fits(header, variants[i].text, false) ||
+            (uint64_t)variants[i].first_event + variants[i].event_count > header->event_count) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < list_count; ++i) {
+        if (!string_fits(header, lists[i], false)) {
+            return false;
+        }
+    }
+    for (int setting = 0; setting < CACHE_SETTING_COUNT; ++setting) {
+        if (!string_fits(header, header->settings[setting], true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The image is read-only; the const casts only adapt it to the shared AccentConfig type. */
+static char *image_string(const char *image, const CacheHeader *header, uint32_t offset)
+{
+    if (offset == CONFIG_CACHE_NO_STRING) {
+        return NULL;
+    }
+    return (char *)(image + header->strings_offset + offset);
+}
+
+/* The key sequences depend on the layout, which without xkb_layout is the system keyboard's,
+ * so the image is only current for the layout it was compiled for. */
+static bool layout_matches(const CacheHeader *header, const char *image)
+{
+    const char *compiled = image_string(image, header, header->settings[CACHE_SETTING_LAYOUT]);
+    char spec[160];
+    layout_resolve(image_string(image, header, header->settings[CACHE_SETTING_XKB_LAYOUT]),
+                   image_string(image, header, header->settings[CACHE_SETTING_XKB_VARIANT]), spec, sizeof(spec));
+    return compiled && strcmp(compiled, spec) == 0;
+}
+
+static AccentConfig *build_config(const char *image, size_t image_size)
+{
+    const CacheHeader *header = (const CacheHeader *)image;
+    const CacheMapping *mappings = (const CacheMapping *)(image + header->mappings_offset);
+    const CacheVariant *variants = (const CacheVariant *)(image + header->variants_offset);
+    const uint32_t *lists = (const uint32_t *)(image + header->lists_offset);
+    struct input_event *events = (struct input_event *)(image + header->events_offset);
+
+    Arena *arena = arena_create(4096);
+    AccentConfig *config = arena_alloc(arena, sizeof(AccentConfig));
+    if (!config) {
+        arena_destroy(arena);
+        return NULL;
+    }
+    config->arena = arena;
+    /* One block: mapping table, then variant pointers, sequences, device rule and layer pointers. */
+    size_t list_count = (size_t)header->include_count + header->exclude_count + header->layer_count;
+    size_t block_size = header->mapping_count * sizeof(AccentMapping) +
+                        header->variant_count * (sizeof(char *) + sizeof(AccentSequence)) +
+                        list_count * sizeof(char *);
+    char *block = arena_alloc(arena, block_size);
+    if (!block) {
+        arena_destroy(arena);
+        return NULL;
+    }
+    config->image = image;
+    config->image_size = image_size;
+    config->mappings = (AccentMapping *)block;
+    config->mapping_count = header->mapping_count;
+    char **variant_texts = (char **)(block + header->mapping_count * sizeof(AccentMapping));
+    AccentSequence *sequences = (AccentSequence *)(variant_texts + header->variant_count);
+    char **rules = (char **)(sequences + header->variant_count);
+
+    for (uint32_t i = 0; i < header->variant_count; ++i) {
+        variant_texts[i] = image_string(image, header, variants[i].text);
+        sequences[i].events = events + variants[i].first_event;
+        sequences[i].event_count = variants[i].event_count;
+    }
+    for (uint32_t i = 0; i < header->mapping_count; ++i) {
+        AccentMapping *mapping = &config->mappings[i];
+        mapping->base = image_string(image, header, mappings[i].base);
+        mapping->variants = variant_texts + mappings[i].first_variant;
+        mapping->variant_count = mappings[i].variant_count;
+        mapping->sequences = sequences + mappings[i].first_variant;
+        mapping->layer = mappings[i].layer;
+    }
+    for (size_t i = 0; i < list_count; ++i) {
+        rules[i] = image_string(image, header, lists[i]);
+    }
+    config->device_include = rules;
+    config->device_include_count = header->include_count;
+    config->device_exclude = rules + header->include_count;
+    config->device_exclude_count = header->exclude_count;
+    config->layers = rules + header->include_count + header->exclude_count;
+    config->layer_count = header->layer_count;
+    for (int setting = 0; setting < CACHE_SETTING_COUNT; ++setting) {
+        *setting_field(config, setting) = image_string(image, header, header->settings[setting]);
+    }
+    return config;
+}
+
+AccentConfig *config_cache_load(const char *cache_path, const char *source_path, char **error_message)
+{
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        set_error(error_message, "%s does not exist", cache_path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        set_error(error_message, "%s is not a configuration cache", cache_path);
+        return NULL;
+    }
+    size_t image_size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, image_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        set_error(error_message, "Unable to map %s", cache_path);
+        return NULL;
+    }
+
+    const CacheHeader *header = mapping;
+    size_t layer_count = 0;
+    char **layers = config_layer_paths(source_path, &layer_count);
+    uint64_t stamp = 0;
+    bool current = layers && source_stamp(layers, layer_count, &stamp) && header->source_stamp == stamp;
+    free(layers);
+    if (memcmp(header->magic, CONFIG_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CONFIG_CACHE_VERSION || header->event_size != sizeof(struct input_event) ||
+        header->image_size != image_size || !validate_image(header, mapping)) {
+        set_error(error_message, "%s is corrupt or from another version", cache_path);
+    } else if (!current) {
+        set_error(error_message, "%s is out of date", cache_path);
+    } else if (!layout_matches(header, mapping)) {
+        set_error(error_message, "%s was compiled for another keyboard layout", cache_path);
+    } else {
+        /* Profiles are not part of the image; their presets are read again. */
+        AccentConfig *config = build_config(mapping, image_size);
+        char *reason = NULL;
+        if (config && config_load_profiles(config, source_path, &reason) && mapper_compile(config)) {
+            return config;
+        }
+        if (reason) {
+            set_error(error_message, "%s", reason);
+            free(reason);
+        } else {
+            set_error(error_message, "Out of memory while loading %s", cache_path);
+        }
+        if (config) {
+            /* Releasing the configuration also unmaps the image. */
+            config_free(config);
+            return NULL;
+        }
+    }
+    munmap(mapping, image_size);
+    return NULL;
+}
+
+AccentConfig *config_load_cached(const char *source_path, const char *cache_path, char **error_message)
+{
+    char *reason = NULL;
+    AccentConfig *config = config_cache_load(cache_path, source_path, &reason);
+    if (config) {
+        free(reason);
+        return config;
+    }
+    log_info("Rebuilding configuration cache: %s", reason ? reason : "unknown error");
+    free(reason);
+
+    config = config_load(source_path, error_message);
+    if (!config) {
+        return NULL;
+    }
+    reason = NULL;
+    if (!config_cache_write(config, source_path, cache_path, &reason)) {
+        log_error("Unable to update configuration cache: %s", reason ? reason : "unknown error");
+        free(reason);
+    }
+    return config;
+}
+
+void config_cache_unmap(AccentConfig *config)
+{
+    munmap((void *)config->image, config->image_size);
+    config->image = NULL;
+}
@@ -0,0 +1,342 @@
+#include "config_embed.h"
+#include "compose.h"
+#include "config.h"
+#include "mapper.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <linux/input.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef ACCENTFLOW_EMBEDDED_CONFIG
+#include ACCENTFLOW_EMBEDDED_CONFIG
+#endif
+
+typedef struct {
+    const struct input_event *events;
+    size_t first_event;
+} EventSlot;
+
+/* Sequences shared in memory are written once; returns the slot for events. */
+static EventSlot *event_slot(EventSlot *slots, size_t mask, const struct input_event *events)
+{
+    size_t index = (size_t)(((uintptr_t)events >> 4) * 2654435761u) & mask;
+    while (slots[index].events && slots[index].events != events) {
+        index = (index + 1) & mask;
+    }
+    return &slots[index];
+}
+
+/* A C string literal of length bytes; octal escapes keep every byte exact, and '?' is
+ * escaped so no trigraph can form. */
+static void write_literal(FILE *out, const char *text, size_t length)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\' || c == '?') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+        if (i + 1 < length && i % 64 == 63) {
+            fputs("\"\n    \"", out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_string(FILE *out, const char *text)
+{
+    if (text) {
+        write_literal(out, text, strlen(text));
+    } else {
+        fputs("NULL", out);
+    }
+}
+
+static void write_string_array(FILE *out, const char *name, char *const *items, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    fprintf(out, "static char *const %s[] = {\n", name);
+    for (size_t i = 0; i < count; ++i) {
+        fputs("    ", out);
+        write_string(out, items[i]);
+        fputs(",\n", out);
+    }
+    fputs("};\n\n", out);
+}
+
+/* Events, sequences, variant texts and mappings, in the order the mapping table needs them. */
+static bool write_mappings(FILE *out, const AccentConfig *config)
+{
+    size_t variant_count = 0;
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        variant_count += config->mappings[i].variant_count;
+    }
+    if (variant_count == 0) {
+        return true;
+    }
+    size_t capacity = 16;
+    while (capacity < variant_count * 2) {
+        capacity <<= 1;
+    }
+    EventSlot *slots = calloc(capacity, sizeof(EventSlot));
+    if (!slots) {
+        return false;
+    }
+
+    size_t event_count = 0;
+    fputs("static const struct input_event embedded_events[] = {\n", out);
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        for (size_t j = 0; j < mapping->variant_count; ++j) {
+            const AccentSequence *sequence = &mapping->sequences[j];
+            EventSlot *slot = event_slot(slots, capacity - 1, sequence->events);
+            if (slot->events) {
+                continue;
+            }
+            slot->events = sequence->events;
+            slot->first_event = event_count;
+            event_count += sequence->event_count;
+            for (size_t k = 0; k < sequence->event_count; ++k) {
+                const struct input_event *event = &sequence->events[k];
+                fprintf(out, "    {.type = %u, .code = %u, .value = %d},\n", (unsigned int)event->type,
+                        (unsigned int)event->code, (int)event->value);
+            }
+        }
+    }
+    fputs("};\n\nstatic const AccentSequence embedded_sequences[] = {\n", out);
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        for (size_t j = 0; j < mapping->variant_count; ++j) {
+            const AccentSequence *sequence = &mapping->sequences[j];
+            fprintf(out, "    {(struct input_event *)&embedded_events[%zu], %zu},\n",
+                    event_slot(slots, capacity - 1, sequence->events)->first_event, sequence->event_count);
+        }
+    }
+    free(slots);
+
+    fputs("};\n\nstatic char *const embedded_variants[] = {\n", out);
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        fputs("    ", out);
+        for (size_t j = 0; j < mapping->variant_count; ++j) {
+            write_string(out, mapping->variants[j]);
+            fputs(j + 1 < mapping->variant_count ? ", " : ",\n", out);
+        }
+    }
+
+    fputs("};\n\nstatic const AccentMapping embedded_mappings[] = {\n", out);
+    size_t first_variant = 0;
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        fputs("    {", out);
+        write_string(out, mapping->base);
+        fprintf(out, ", (char **)&embedded_variants[%zu], %zu, (AccentSequence *)&embedded_sequences[%zu], %u},\n",
+                first_variant, mapping->variant_count, first_variant, (unsigned int)mapping->layer);
+        first_variant += mapping->variant_count;
+    }
+    fputs("};\n\n", out);
+    return true;
+}
+
+/* Only the keys that have a mapping or type a character are listed; the rest stay zero. */
+static void write_key_tables(FILE *out, const AccentConfig *config)
+{
+    size_t entries = (size_t)MAPPER_LAYER_COUNT * MAPPER_KEY_COUNT;
+    fputs("static const AccentMapping *const embedded_keymap[MAPPER_LAYER_COUNT * MAPPER_KEY_COUNT] = {\n", out);
+    bool empty = true;
+    for (size_t i = 0; config->keymap && i < entries; ++i) {
+        if (config->keymap[i]) {
+            fprintf(out, "    [%zu] = &embedded_mappings[%zu],\n", i, (size_t)(config->keymap[i] - config->mappings));
+            empty = false;
+        }
+    }
+    fputs(empty ? "    NULL,\n};\n\n" : "};\n\n", out);
+    if (!config->key_characters) {
+        return;
+    }
+    fputs("static const uint32_t embedded_key_characters[MAPPER_LAYER_COUNT * MAPPER_KEY_COUNT] = {\n", out);
+    empty = true;
+    for (size_t i = 0; i < entries; ++i) {
+        if (config->key_characters[i]) {
+            fprintf(out, "    [%zu] = 0x%X,\n", i, (unsigned int)config->key_characters[i]);
+            empty = false;
+        }
+    }
+    fputs(empty ? "    0,\n};\n\n" : "};\n\n", out);
+}
+
+static void write_compose(FILE *out, const ComposeTable *table)
+{
+    fprintf(out, "static const ComposeEdge embedded_compose_edges[%zu] = {\n", table->mask + 1);
+    for (size_t i = 0; i <= table->mask; ++i) {
+        const ComposeEdge *edge = &table->edges[i];
+        if (edge->codepoint) {
+            fprintf(out, "    [%zu] = {%u, 0x%X, %u},\n", i, (unsigned int)edge->state, (unsigned int)edge->codepoint,
+                    (unsigned int)edge->target);
+        }
+    }
+    fputs("};\n\nstatic const ComposeNode embedded_compose_nodes[] = {\n", out);
+    for (size_t i = 0; i < table->node_count; ++i) {
+        fprintf(out, "    {%uu, %uu},\n", (unsigned int)table->nodes[i].result, (unsigned int)table->nodes[i].children);
+    }
+    /* Bytes rather than one literal: the pool outgrows the string length C requires. */
+    fputs("};\n\nstatic const unsigned char embedded_compose_strings[] = {", out);
+    for (size_t i = 0; i < table->strings_size; ++i) {
+        fprintf(out, "%s0x%02X,", i % 16 == 0 ? "\n    " : " ", (unsigned char)table->strings[i]);
+    }
+    fprintf(out, "%s\n};\n\nstatic const ComposeTable embedded_compose = {\n"
+                 "    .edges = (ComposeEdge *)embedded_compose_edges,\n    .mask = %zu,\n    .shift = %u,\n"
+                 "    .nodes = (ComposeNode *)embedded_compose_nodes,\n    .node_count = %zu,\n"
+                 "    .strings = (char *)embedded_compose_strings,\n    .strings_size = %zu,\n"
+                 "    .sequence_count = %zu,\n};\n\n",
+            table->strings_size ? "" : "\n    0,", table->mask, table->shift, table->node_count, table->strings_size,
+            table->sequence_count);
+}
+
+static void write_setting(FILE *out, const char *field, const char *value)
+{
+    if (value) {
+        fprintf(out, "    .%s = ", field);
+        write_string(out, value);
+        fputs(",\n", out);
+    }
+}
+
+/* Everything after the mapping table, ending with the configuration itself. */
+static void write_config(FILE *out, const AccentConfig *config)
+{
+    write_key_tables(out, config);
+    if (config->compose) {
+        write_compose(out, config->compose);
+    }
+    size_t rule_count = config->device_include_count + config->device_exclude_count;
+    char **rules = rule_count ? malloc(rule_count * sizeof(char *)) : NULL;
+    if (rules) {
+        memcpy(rules, config->device_include, config->device_include_count * sizeof(char *));
+        memcpy(rules + config->device_include_count, config->device_exclude,
+               config->device_exclude_count * sizeof(char *));
+        write_string_array(out, "embedded_device_rules", rules, rule_count);
+        free(rules);
+    }
+    write_string_array(out, "embedded_layers", config->layers, config->layer_count);
+    if (config->unicode_keys) {
+        const UnicodeKeys *keys = config->unicode_keys;
+        fprintf(out, "static const UnicodeKeys embedded_unicode_keys = {%u, {", keys->u);
+        for (size_t i = 0; i < 16; ++i) {
+            fprintf(out, "%s%u", i > 0 ? ", " : "", keys->digits[i]);
+        }
+        fprintf(out, "}, 0x%04x};\n\n", keys->shifted_digits);
+    }
+
+    fputs("static AccentConfig embedded_config = {\n", out);
+    if (config->mapping_count > 0) {
+        fprintf(out, "    .mappings = (AccentMapping *)embedded_mappings,\n    .mapping_count = %zu,\n",
+                config->mapping_count);
+    }
+    fputs("    .keymap = (const AccentMapping **)embedded_keymap,\n", out);
+    if (config->compose) {
+        fputs("    .compose = &embedded_compose,\n", out);
+    }
+    if (config->key_characters) {
+        fputs("    .key_characters = (uint32_t *)embedded_key_characters,\n", out);
+    }
+    if (config->unicode_keys) {
+        fputs("    .unicode_keys = &embedded_unicode_keys,\n", out);
+    }
+    write_setting(out, "input_device", config->input_device);
+    write_setting(out, "display_mode", config->display_mode);
+    write_setting(out, "output_backend", config->output_backend);
+    write_setting(out, "xkb_layout", config->xkb_layout);
+    write_setting(out, "xkb_variant", config->xkb_variant);
+    write_setting(out, "layout", config->layout);
+    write_setting(out, "compose_file", config->compose_file);
+    write_setting(out, "log_level", config->log_level);
+    if (config->device_include_count > 0) {
+        fprintf(out, "    .device_include = (char **)embedded_device_rules,\n    .device_include_count = %zu,\n",
+                config->device_include_count);
+    }
+    if (config->device_exclude_count > 0) {
+        fprintf(out, "    .device_exclude = (char **)&embedded_device_rules[%zu],\n    .device_exclude_count = %zu,\n",
+                config->device_include_count, config->device_exclude_count);
+    }
+    fputs("    .root = &embedded_config,\n", out);
+    if (config->layer_count > 0) {
+        fprintf(out, "    .layers = (char **)embedded_layers,\n    .layer_count = %zu,\n", config->layer_count);
+    }
+    fputs("};\n", out);
+}
+
+bool config_embed_write(const AccentConfig *config, const char *source_path, const char *header_path,
+                        char **error_message)
+{
+    /* The keymap is compiled for one layout, which must not be whatever the build machine uses. */
+    if (!config->xkb_layout) {
+        if (error_message) {
+            char message[512];
+            snprintf(message, sizeof(message), "%s does not set xkb_layout; a built-in keymap needs an explicit layout",
+                     source_path);
+            *error_message = duplicate_string(message);
+        }
+        return false;
+    }
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", header_path, (long)getpid());
+    FILE *out = fopen(temp_path, "w");
+    if (!out) {
+        if (error_message) {
+            char message[512];
+            snprintf(message, sizeof(message), "Unable to create %s: %s", header_path, strerror(errno));
+            *error_message = duplicate_string(message);
+        }
+        return false;
+    }
+    if (config->profile_count > 1) {
+        log_info("Profiles are not embedded; only the main configuration is");
+    }
+    fputs("/* Generated by accentflowd --emit-c-header from ", out);
+    write_string(out, source_path);
+    fputs(" for the keyboard layout ", out);
+    write_string(out, config->layout);
+    fprintf(out, ". Do not edit. */\n\n"
+                 "_Static_assert(MAPPER_LAYER_COUNT == %u && MAPPER_KEY_COUNT == %u,\n"
+                 "               \"keymap layout changed; regenerate this header\");\n\n",
+            MAPPER_LAYER_COUNT, MAPPER_KEY_COUNT);
+    bool ok = write_mappings(out, config);
+    if (ok) {
+        write_config(out, config);
+    }
+    bool written = !ferror(out);
+    if (fclose(out) != 0 || !ok || !written || rename(temp_path, header_path) < 0) {
+        unlink(temp_path);
+        if (error_message) {
+            char message[512];
+            snprintf(message, sizeof(message), ok ? "Unable to write %s" : "Out of memory while writing %s",
+                     header_path);
+            *error_message = duplicate_string(message);
+        }
+        return false;
+    }
+    return true;
+}
+
+AccentConfig *config_embedded(void)
+{
+#ifdef ACCENTFLOW_EMBEDDED_CONFIG
+    return &embedded_config;
+#else
+    return NULL;
+#endif
+}
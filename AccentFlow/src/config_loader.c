@@ -1,30 +1,122 @@
 #include "config.h"
+#include "arena.h"
+#include "config_cache.h"
+#include "mapper.h"
+#include "text_scan.h"
+#include "unicode_sequence.h"
 #include "utils.h"
 
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#define CONFIG_ARENA_CHUNK_SIZE 16384
+
+/* Parses the source text in place, so data must stay writable and outlive the configuration. */
 typedef struct {
-    const char *data;
+    char *data;
     size_t length;
     size_t pos;
     char error[256];
 } JsonParser;
 
-static void skip_whitespace(JsonParser *parser)
+/* Set of the strings copied into a configuration's arena while it loads, so a variant that
+ * appears in several presets is stored once. The table itself is freed after loading. */
+typedef struct {
+    char **slots;
+    size_t mask;
+    size_t count;
+} StringInterner;
+
+/* A base's hash and its position + 1 in the mapping table; 0 marks a free slot. */
+typedef struct {
+    uint32_t hash;
+    uint32_t position;
+} MappingSlot;
+
+/* Everything a loaded configuration owns lives in its arena. The mapping table grows
+ * geometrically in a scratch buffer and is moved into the arena once every layer is parsed;
+ * index finds a base's mapping so a later layer replaces it in place. */
+typedef struct {
+    AccentConfig *config;
+    Arena *arena;
+    StringInterner *interner;
+    AccentMapping *mappings;
+    size_t mapping_capacity;
+    MappingSlot *index;
+    size_t index_mask;
+    uint32_t layer;
+    char **items;
+    size_t item_capacity;
+} ConfigBuilder;
+
+static uint32_t hash_bytes(const char *text, size_t length)
 {
-    while (parser->pos < parser->length) {
-        char c = parser->data[parser->pos];
-        if (!isspace((unsigned char)c)) {
-            break;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool interner_grow(StringInterner *interner)
+{
+    size_t capacity = interner->slots ? (interner->mask + 1) * 2 : 256;
+    char **slots = calloc(capacity, sizeof(char *));
+    if (!slots) {
+        return false;
+    }
+    for (size_t i = 0; interner->slots && i <= interner->mask; ++i) {
+        char *text = interner->slots[i];
+        if (text) {
+            size_t index = hash_bytes(text, strlen(text)) & (capacity - 1);
+            while (slots[index]) {
+                index = (index + 1) & (capacity - 1);
+            }
+            slots[index] = text;
         }
-        parser->pos++;
     }
+    free(interner->slots);
+    interner->slots = slots;
+    interner->mask = capacity - 1;
+    return true;
+}
+
+/* The arena copy of text, shared with every earlier string of the same bytes. */
+static char *intern_string(ConfigBuilder *builder, const char *text, size_t length)
+{
+    StringInterner *interner = builder->interner;
+    if ((interner->count + 1) * 2 > (interner->slots ? interner->mask + 1 : 0) && !interner_grow(interner)) {
+        return NULL;
+    }
+    size_t index = hash_bytes(text, length) & interner->mask;
+    while (interner->slots[index]) {
+        char *candidate = interner->slots[index];
+        if (strncmp(candidate, text, length) == 0 && candidate[length] == '\0') {
+            return candidate;
+        }
+        index = (index + 1) & interner->mask;
+    }
+    char *copy = arena_strndup(builder->arena, text, length);
+    if (copy) {
+        interner->slots[index] = copy;
+        interner->count++;
+    }
+    return copy;
+}
+
+static void skip_whitespace(JsonParser *parser)
+{
+    parser->pos = text_skip_whitespace(parser->data, parser->pos, parser->length);
 }
 
 static bool match_char(JsonParser *parser, char expected)
@@ -47,40 +139,95 @@ static int peek_char(JsonParser *parser)
     return parser->data[parser->pos];
 }
 
-static int advance_char(JsonParser *parser)
+/* Reads the four hex digits after "\u" at text[*pos]; *pos is left on the last digit. */
+static bool parse_hex4(JsonParser *parser, const char *text, size_t *pos, size_t end, uint32_t *value)
 {
-    if (parser->pos >= parser->length) {
-        return EOF;
+    if (end - *pos < 5) {
+        snprintf(parser->error, sizeof(parser->error), "Truncated \\u escape");
+        return false;
+    }
+    uint32_t result = 0;
+    for (size_t i = 1; i <= 4; ++i) {
+        int digit = hex_digit_value(text[*pos + i]);
+        if (digit < 0) {
+            snprintf(parser->error, sizeof(parser->error), "Invalid hex digit in \\u escape");
+            return false;
+        }
+        result = (result << 4) | (uint32_t)digit;
     }
-    return parser->data[parser->pos++];
+    *pos += 4;
+    *value = result;
+    return true;
+}
+
+/* "\uXXXX" at text[*pos], joining a UTF-16 surrogate pair spelled as two escapes. */
+static bool parse_unicode_escape(JsonParser *parser, const char *text, size_t *pos, size_t end,
+                                 uint32_t *codepoint)
+{
+    uint32_t unit = 0;
+    if (!parse_hex4(parser, text, pos, end, &unit)) {
+        return false;
+    }
+    if (unit >= 0xDC00 && unit <= 0xDFFF) {
+        snprintf(parser->error, sizeof(parser->error), "Unpaired low surrogate \\u%04X", (unsigned)unit);
+        return false;
+    }
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+        uint32_t low = 0;
+        if (end - *pos < 3 || text[*pos + 1] != '\\' || text[*pos + 2] != 'u') {
+            snprintf(parser->error, sizeof(parser->error), "Unpaired high surrogate \\u%04X", (unsigned)unit);
+            return false;
+        }
+        *pos += 2;
+        if (!parse_hex4(parser, text, pos, end, &low)) {
+            return false;
+        }
+        if (low < 0xDC00 || low > 0xDFFF) {
+            snprintf(parser->error, sizeof(parser->error), "Unpaired high surrogate \\u%04X", (unsigned)unit);
+            return false;
+        }
+        unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+    }
+    if (unit == 0) {
+        snprintf(parser->error, sizeof(parser->error), "\\u0000 is not allowed in configuration strings");
+        return false;
+    }
+    *codepoint = unit;
+    return true;
 }
 
+/* Strings are returned in place: the closing quote becomes the terminator, and the rare
+ * escaped string is decoded over its own source text, which escapes only ever shrink. */
 static char *parse_string(JsonParser *parser)
 {
     if (!match_char(parser, '"')) {
         return NULL;
     }
 
-    size_t capacity = 64;
-    size_t length = 0;
-    char *buffer = malloc(capacity);
-    if (!buffer) {
-        snprintf(parser->error, sizeof(parser->error), "Out of memory");
+    char *text = parser->data;
+    size_t start = parser->pos;
+    size_t end = text_find_string_delimiter(text, start, parser->length);
+    bool escaped = false;
+    while (end < parser->length && text[end] == '\\') {
+        escaped = true;
+        end = text_find_string_delimiter(text, end + 2, parser->length);
+    }
+    if (end >= parser->length) {
+        snprintf(parser->error, sizeof(parser->error), "Unterminated string");
         return NULL;
     }
+    parser->pos = end + 1;
 
-    while (parser->pos < parser->length) {
-        char c = advance_char(parser);
-        if (c == '"') {
-            break;
-        }
-        if (c == '\\') {
-            if (parser->pos >= parser->length) {
-                snprintf(parser->error, sizeof(parser->error), "Unexpected end of escape sequence");
-                free(buffer);
-                return NULL;
+    size_t length = end - start;
+    if (escaped) {
+        length = 0;
+        for (size_t i = start; i < end; ++i) {
+            char c = text[i];
+            if (c != '\\') {
+                text[start + length++] = c;
+                continue;
             }
-            char esc = advance_char(parser);
+            char esc = text[++i];
             switch (esc) {
             case '"': c = '"'; break;
             case '\\': c = '\\'; break;
@@ -90,42 +237,23 @@ static char *parse_string(JsonParser *parser)
             case 'n': c = '\n'; break;
             case 'r': c = '\r'; break;
             case 't': c = '\t'; break;
-            case 'u':
-                snprintf(parser->error, sizeof(parser->error), "\\u escapes are not supported in this configuration parser");
-                free(buffer);
-                return NULL;
+            case 'u': {
+                uint32_t codepoint = 0;
+                if (!parse_unicode_escape(parser, text, &i, end, &codepoint)) {
+                    return NULL;
+                }
+                length += codepoint_to_utf8(codepoint, text + start + length);
+                continue;
+            }
             default:
                 snprintf(parser->error, sizeof(parser->error), "Unknown escape character '%c'", esc);
-                free(buffer);
-                return NULL;
-            }
-        }
-
-        if (length + 1 >= capacity) {
-            capacity *= 2;
-            char *tmp = realloc(buffer, capacity);
-            if (!tmp) {
-                free(buffer);
-                snprintf(parser->error, sizeof(parser->error), "Out of memory");
                 return NULL;
             }
-            buffer = tmp;
+            text[start + length++] = c;
         }
-        buffer[length++] = c;
     }
-
-    if (length + 1 >= capacity) {
-        char *tmp = realloc(buffer, length + 1);
-        if (!tmp) {
-            free(buffer);
-            snprintf(parser->error, sizeof(parser->error), "Out of memory");
-            return NULL;
-        }
-        buffer = tmp;
-    }
-
-    buffer[length] = '\0';
-    return buffer;
+    text[start + length] = '\0';
+    return text + start;
 }
 
 static bool expect_token(JsonParser *parser, const char *token)
@@ -149,85 +277,244 @@ static bool parse_value_is_null(JsonParser *parser)
     return expect_token(parser, "null");
 }
 
-static char **parse_string_array(JsonParser *parser, size_t *count)
+/* Items are gathered in the builder's scratch array, then copied to an exact-size arena array. */
+static bool parse_string_array(JsonParser *parser, ConfigBuilder *builder, char ***items, size_t *count)
 {
     if (!match_char(parser, '[')) {
-        return NULL;
+        return false;
     }
 
-    size_t capacity = 4;
     size_t length = 0;
-    char **items = malloc(capacity * sizeof(char *));
-    if (!items) {
-        snprintf(parser->error, sizeof(parser->error), "Out of memory");
-        return NULL;
-    }
-
     if (peek_char(parser) == ']') {
         parser->pos++;
-        *count = 0;
-        return items;
-    }
-
-    while (parser->pos < parser->length) {
-        char *value = parse_string(parser);
-        if (!value) {
-            for (size_t i = 0; i < length; ++i) {
-                free(items[i]);
+    } else {
+        while (1) {
+            char *value = parse_string(parser);
+            if (!value) {
+                return false;
             }
-            free(items);
-            return NULL;
-        }
-
-        if (length >= capacity) {
-            capacity *= 2;
-            char **tmp = realloc(items, capacity * sizeof(char *));
-            if (!tmp) {
-                snprintf(parser->error, sizeof(parser->error), "Out of memory");
-                free(value);
-                for (size_t i = 0; i < length; ++i) {
-                    free(items[i]);
+            if (length >= builder->item_capacity) {
+                size_t capacity = builder->item_capacity ? builder->item_capacity * 2 : 16;
+                char **tmp = realloc(builder->items, capacity * sizeof(char *));
+                if (!tmp) {
+                    snprintf(parser->error, sizeof(parser->error), "Out of memory");
+                    return false;
                 }
-                free(items);
-                return NULL;
+                builder->items = tmp;
+                builder->item_capacity = capacity;
             }
-            items = tmp;
+            builder->items[length++] = value;
+
+            int next = peek_char(parser);
+            if (next == ',') {
+                parser->pos++;
+                continue;
+            }
+            if (next == ']') {
+                parser->pos++;
+                break;
+            }
+            snprintf(parser->error, sizeof(parser->error), "Expected ',' or ']' in array");
+            return false;
         }
-        items[length++] = value;
+    }
 
-        int next = peek_char(parser);
-        if (next == ',') {
-            parser->pos++;
-            continue;
+    *items = NULL;
+    if (length > 0) {
+        *items = arena_alloc(builder->arena, length * sizeof(char *));
+        if (!*items) {
+            snprintf(parser->error, sizeof(parser->error), "Out of memory");
+            return false;
         }
-        if (next == ']') {
-            parser->pos++;
+        memcpy(*items, builder->items, length * sizeof(char *));
+    }
+    *count = length;
+    return true;
+}
+
+/* Fibonacci hashing: the low bits of FNV barely differ between bases like "k1" and "k2". */
+static size_t index_slot(uint32_t hash, size_t mask)
+{
+    return (size_t)(((uint64_t)hash * 0x9E3779B97F4A7C15u) >> 32) & mask;
+}
+
+/* The slot holding base, or the free slot where it belongs. */
+static MappingSlot *index_find(const ConfigBuilder *builder, const char *base, uint32_t hash)
+{
+    size_t index = index_slot(hash, builder->index_mask);
+    while (builder->index[index].position) {
+        const MappingSlot *slot = &builder->index[index];
+        if (slot->hash == hash && strcmp(builder->config->mappings[slot->position - 1].base, base) == 0) {
             break;
         }
-        snprintf(parser->error, sizeof(parser->error), "Expected ',' or ']' in array");
-        for (size_t i = 0; i < length; ++i) {
-            free(items[i]);
+        index = (index + 1) & builder->index_mask;
+    }
+    return &builder->index[index];
+}
+
+/* The index is only built once an overlay is parsed. It starts from the main file's
+ * mappings, dropping a repeated base that lookups never reached anyway. */
+static bool index_grow(ConfigBuilder *builder)
+{
+    AccentConfig *config = builder->config;
+    size_t capacity = builder->index ? (builder->index_mask + 1) * 2 : 128;
+    while (capacity < (config->mapping_count + 1) * 2) {
+        capacity <<= 1;
+    }
+    MappingSlot *slots = calloc(capacity, sizeof(MappingSlot));
+    if (!slots) {
+        return false;
+    }
+    MappingSlot *previous = builder->index;
+    size_t previous_capacity = previous ? builder->index_mask + 1 : 0;
+    builder->index = slots;
+    builder->index_mask = capacity - 1;
+    for (size_t i = 0; i < previous_capacity; ++i) {
+        if (previous[i].position) {
+            size_t index = index_slot(previous[i].hash, builder->index_mask);
+            while (slots[index].position) {
+                index = (index + 1) & builder->index_mask;
+            }
+            slots[index] = previous[i];
+        }
+    }
+    for (size_t i = 0; !previous && i < config->mapping_count; ++i) {
+        AccentMapping *mapping = &config->mappings[i];
+        uint32_t hash = hash_bytes(mapping->base, strlen(mapping->base));
+        MappingSlot *slot = index_find(builder, mapping->base, hash);
+        if (slot->position) {
+            mapping->variants = NULL;
+            mapping->variant_count = 0;
+        } else {
+            *slot = (MappingSlot){hash, (uint32_t)i + 1};
         }
-        free(items);
-        return NULL;
     }
+    free(previous);
+    return true;
+}
 
-    *count = length;
-    return items;
+/* Adds mapping, or replaces the mapping an earlier layer gave the same base. Within one
+ * file the first definition is kept. A mapping without variants removes the base; it stays
+ * in the table until finish_mappings, so a later layer can bring the base back. */
+static bool append_mapping(ConfigBuilder *builder, AccentMapping mapping)
+{
+    AccentConfig *config = builder->config;
+    mapping.layer = builder->layer;
+    MappingSlot *slot = NULL;
+    uint32_t hash = 0;
+    if (mapping.layer > 0) {
+        if ((config->mapping_count + 1) * 2 > (builder->index ? builder->index_mask + 1 : 0) &&
+            !index_grow(builder)) {
+            return false;
+        }
+        hash = hash_bytes(mapping.base, strlen(mapping.base));
+        slot = index_find(builder, mapping.base, hash);
+        if (slot->position) {
+            AccentMapping *existing = &config->mappings[slot->position - 1];
+            if (existing->layer != mapping.layer) {
+                *existing = mapping;
+            }
+            return true;
+        }
+    }
+
+    if (config->mapping_count == builder->mapping_capacity) {
+        size_t capacity = builder->mapping_capacity ? builder->mapping_capacity * 2 : 64;
+        AccentMapping *tmp = realloc(builder->mappings, capacity * sizeof(AccentMapping));
+        if (!tmp) {
+            return false;
+        }
+        builder->mappings = tmp;
+        builder->mapping_capacity = capacity;
+        config->mappings = tmp;
+    }
+    config->mappings[config->mapping_count++] = mapping;
+    if (slot) {
+        *slot = (MappingSlot){hash, (uint32_t)config->mapping_count};
+    }
+    return true;
 }
 
-static bool append_mapping(AccentConfig *config, AccentMapping mapping)
+static bool store_string_array(JsonParser *parser, ConfigBuilder *builder, char *key, char **items, size_t count)
 {
-    AccentMapping *tmp = realloc(config->mappings, (config->mapping_count + 1) * sizeof(AccentMapping));
-    if (!tmp) {
+    AccentConfig *config = builder->config;
+    if (strcmp(key, "device_include") == 0) {
+        config->device_include = items;
+        config->device_include_count = count;
+        return true;
+    }
+    if (strcmp(key, "device_exclude") == 0) {
+        config->device_exclude = items;
+        config->device_exclude_count = count;
+        return true;
+    }
+
+    AccentMapping mapping = {0};
+    mapping.base = key;
+    mapping.variants = items;
+    mapping.variant_count = count;
+
+    if (!append_mapping(builder, mapping)) {
+        snprintf(parser->error, sizeof(parser->error), "Out of memory");
         return false;
     }
-    config->mappings = tmp;
-    config->mappings[config->mapping_count++] = mapping;
     return true;
 }
 
-static bool parse_object(JsonParser *parser, AccentConfig *config)
+static char **string_setting(AccentConfig *config, const char *key)
+{
+    if (strcmp(key, "input_device") == 0) {
+        return &config->input_device;
+    }
+    if (strcmp(key, "display_mode") == 0) {
+        return &config->display_mode;
+    }
+    if (strcmp(key, "output_backend") == 0) {
+        return &config->output_backend;
+    }
+    if (strcmp(key, "xkb_layout") == 0) {
+        return &config->xkb_layout;
+    }
+    if (strcmp(key, "xkb_variant") == 0) {
+        return &config->xkb_variant;
+    }
+    if (strcmp(key, "compose_file") == 0) {
+        return &config->compose_file;
+    }
+    if (strcmp(key, "profiles_dir") == 0) {
+        return &config->profiles_dir;
+    }
+    if (strcmp(key, "profile") == 0) {
+        return &config->startup_profile;
+    }
+    if (strcmp(key, "log_level") == 0) {
+        return &config->log_level;
+    }
+    return NULL;
+}
+
+/* null puts a setting back to its default, and in an overlay removes the base's mapping. */
+static bool clear_property(ConfigBuilder *builder, char *key)
+{
+    AccentConfig *config = builder->config;
+    char **setting = string_setting(config, key);
+    if (setting) {
+        *setting = NULL;
+    } else if (strcmp(key, "device_include") == 0) {
+        config->device_include = NULL;
+        config->device_include_count = 0;
+    } else if (strcmp(key, "device_exclude") == 0) {
+        config->device_exclude = NULL;
+        config->device_exclude_count = 0;
+    } else if (builder->layer > 0) {
+        AccentMapping removed = {0};
+        removed.base = key;
+        return append_mapping(builder, removed);
+    }
+    return true;
+}
+
+static bool parse_object(JsonParser *parser, ConfigBuilder *builder)
 {
     if (!match_char(parser, '{')) {
         return false;
@@ -244,68 +531,38 @@ static bool parse_object(JsonParser *parser, AccentConfig *config)
             return false;
         }
         if (!match_char(parser, ':')) {
-            free(key);
             return false;
         }
 
         int next = peek_char(parser);
         if (next == '[') {
             size_t count = 0;
-            char **variants = parse_string_array(parser, &count);
-            if (!variants) {
-                free(key);
-                return false;
-            }
-
-            AccentMapping mapping = {0};
-            mapping.base = key;
-            mapping.variants = variants;
-            mapping.variant_count = count;
-
-            if (!append_mapping(config, mapping)) {
-                snprintf(parser->error, sizeof(parser->error), "Out of memory");
-                free(key);
-                for (size_t i = 0; i < count; ++i) {
-                    free(variants[i]);
-                }
-                free(variants);
+            char **items = NULL;
+            if (!parse_string_array(parser, builder, &items, &count) ||
+                !store_string_array(parser, builder, key, items, count)) {
                 return false;
             }
         } else if (next == '"') {
             char *value = parse_string(parser);
             if (!value) {
-                free(key);
                 return false;
             }
-            if (strcmp(key, "input_device") == 0) {
-                free(config->input_device);
-                config->input_device = value;
-                free(key);
-            } else if (strcmp(key, "display_mode") == 0) {
-                free(config->display_mode);
-                config->display_mode = value;
-                free(key);
+            char **setting = string_setting(builder->config, key);
+            if (setting) {
+                *setting = value;
             } else {
                 log_error("Ignoring unexpected string property '%s' in configuration", key);
-                free(key);
-                free(value);
             }
         } else if (next == 'n') {
             if (!parse_value_is_null(parser)) {
-                free(key);
                 return false;
             }
-            if (strcmp(key, "input_device") == 0) {
-                free(config->input_device);
-                config->input_device = NULL;
-            } else if (strcmp(key, "display_mode") == 0) {
-                free(config->display_mode);
-                config->display_mode = NULL;
+            if (!clear_property(builder, key)) {
+                snprintf(parser->error, sizeof(parser->error), "Out of memory");
+                return false;
             }
-            free(key);
         } else {
             snprintf(parser->error, sizeof(parser->error), "Unsupported value type for key '%s'", key);
-            free(key);
             return false;
         }
 
@@ -325,60 +582,755 @@ static bool parse_object(JsonParser *parser, AccentConfig *config)
     return true;
 }
 
-AccentConfig *config_load(const char *path, char **error_message)
+typedef enum {
+    PRESET_SECTION_NONE,
+    PRESET_SECTION_MIN,
+    PRESET_SECTION_MAJ
+} PresetSection;
+
+static void trim_range(const char **start, const char **end)
 {
-    size_t length = 0;
-    char *buffer = read_file_to_buffer(path, &length);
-    if (!buffer) {
-        if (error_message) {
-            *error_message = duplicate_string("Unable to read configuration file");
+    while (*start < *end && isspace((unsigned char)**start)) {
+        (*start)++;
+    }
+    while (*end > *start && isspace((unsigned char)(*end)[-1])) {
+        (*end)--;
+    }
+}
+
+/* One "key = v1, v2" preset line; the section forces the case of an ASCII key like lockfree.ahk does. */
+static bool parse_preset_line(const char *line, const char *end, const char *equals, PresetSection section,
+                              ConfigBuilder *builder, char *error, size_t error_size, size_t line_number)
+{
+    const char *key_start = line;
+    const char *key_end = equals;
+    trim_range(&key_start, &key_end);
+    if (key_start == key_end) {
+        snprintf(error, error_size, "Line %zu: missing key before '='", line_number);
+        return false;
+    }
+
+    size_t capacity = 1;
+    for (const char *p = equals + 1; p < end; ++p) {
+        capacity += *p == ',';
+    }
+
+    /* Interned strings are shared, so the key's case is forced before it is stored. */
+    char letter[2] = {key_start[0], '\0'};
+    if (key_end - key_start == 1) {
+        if (section == PRESET_SECTION_MIN) {
+            letter[0] = (char)tolower((unsigned char)letter[0]);
+        } else if (section == PRESET_SECTION_MAJ) {
+            letter[0] = (char)toupper((unsigned char)letter[0]);
+        }
+        key_start = letter;
+        key_end = letter + 1;
+    }
+
+    AccentMapping mapping = {0};
+    mapping.base = intern_string(builder, key_start, (size_t)(key_end - key_start));
+    mapping.variants = arena_alloc(builder->arena, capacity * sizeof(char *));
+    if (!mapping.base || !mapping.variants) {
+        snprintf(error, error_size, "Out of memory");
+        return false;
+    }
+
+    const char *value = equals + 1;
+    while (value <= end) {
+        const char *comma = memchr(value, ',', (size_t)(end - value));
+        const char *value_end = comma ? comma : end;
+        const char *start = value;
+        trim_range(&start, &value_end);
+        if (start < value_end) {
+            char *variant = intern_string(builder, start, (size_t)(value_end - start));
+            if (!variant) {
+                snprintf(error, error_size, "Out of memory");
+                return false;
+            }
+            mapping.variants[mapping.variant_count++] = variant;
+        }
+        if (!comma) {
+            break;
+        }
+        value = comma + 1;
+    }
+
+    if (!append_mapping(builder, mapping)) {
+        snprintf(error, error_size, "Out of memory");
+        return false;
+    }
+    return true;
+}
+
+/* Language presets shared with lockfree.ahk: "min:" and "maj:" sections of "key = v1, v2" lines. */
+static bool parse_preset(const char *data, size_t length, ConfigBuilder *builder, char *error, size_t error_size)
+{
+    const char *pos = data;
+    const char *end = data + length;
+    PresetSection section = PRESET_SECTION_NONE;
+    size_t line_number = 0;
+
+    while (pos < end) {
+        const char *newline = memchr(pos, '\n', (size_t)(end - pos));
+        const char *line = pos;
+        const char *line_end = newline ? newline : end;
+        pos = newline ? newline + 1 : end;
+        line_number++;
+
+        trim_range(&line, &line_end);
+        size_t line_length = (size_t)(line_end - line);
+        if (line_length == 0) {
+            continue;
+        }
+        if (line_length == 4 && strncasecmp(line, "min:", 4) == 0) {
+            section = PRESET_SECTION_MIN;
+            continue;
+        }
+        if (line_length == 4 && strncasecmp(line, "maj:", 4) == 0) {
+            section = PRESET_SECTION_MAJ;
+            continue;
+        }
+
+        const char *equals = memchr(line, '=', line_length);
+        if (!equals) {
+            snprintf(error, error_size, "Line %zu: expected 'min:', 'maj:' or 'key = variants'", line_number);
+            return false;
         }
+        if (!parse_preset_line(line, line_end, equals, section, builder, error, error_size, line_number)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void describe_invalid_utf8(const char *data, size_t offset, char *error, size_t error_size)
+{
+    size_t line = 1;
+    const char *line_start = data;
+    for (const char *p = data; (p = memchr(p, '\n', (size_t)(data + offset - p))) != NULL; ++p) {
+        line++;
+        line_start = p + 1;
+    }
+    snprintf(error, error_size, "Invalid UTF-8 byte 0x%02X at line %zu, column %zu",
+             (unsigned char)data[offset], line, (size_t)(data + offset - line_start) + 1);
+}
+
+static bool is_json_document(const char *data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (!isspace((unsigned char)data[i])) {
+            return data[i] == '{';
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    const char *text;
+    const AccentSequence *sequence;
+} SequenceSlot;
+
+/* Builds every variant's key sequence into one arena pool; a variant text that occurs
+ * under several bases, or in several profiles, shares a single event array. The first
+ * `compiled` configurations already have their sequences and only seed the index. */
+static bool compile_sequences(AccentConfig *const *configs, size_t count, size_t compiled, Arena *arena,
+                              const UnicodeKeys *keys, char *error, size_t error_size)
+{
+    size_t variant_count = 0;
+    size_t new_count = 0;
+    for (size_t c = 0; c < count; ++c) {
+        for (size_t i = 0; i < configs[c]->mapping_count; ++i) {
+            variant_count += configs[c]->mappings[i].variant_count;
+            new_count += c >= compiled ? configs[c]->mappings[i].variant_count : 0;
+        }
+    }
+    if (new_count == 0) {
+        return true;
+    }
+
+    AccentSequence *pool = arena_alloc(arena, new_count * sizeof(AccentSequence));
+    size_t capacity = 16;
+    while (capacity < variant_count * 2) {
+        capacity <<= 1;
+    }
+    SequenceSlot *seen = calloc(capacity, sizeof(SequenceSlot));
+    if (!pool || !seen) {
+        free(seen);
+        snprintf(error, error_size, "Out of memory");
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t c = 0; c < count && ok; ++c) {
+        for (size_t i = 0; i < configs[c]->mapping_count && ok; ++i) {
+            AccentMapping *mapping = &configs[c]->mappings[i];
+            if (c >= compiled) {
+                mapping->sequences = pool;
+                pool += mapping->variant_count;
+            }
+            for (size_t j = 0; j < mapping->variant_count; ++j) {
+                const char *text = mapping->variants[j];
+                size_t index = hash_bytes(text, strlen(text)) & (capacity - 1);
+                while (seen[index].text && strcmp(seen[index].text, text) != 0) {
+                    index = (index + 1) & (capacity - 1);
+                }
+                if (seen[index].text) {
+                    if (c >= compiled) {
+                        mapping->sequences[j] = *seen[index].sequence;
+                    }
+                    continue;
+                }
+
+                char reason[128];
+                if (c >= compiled &&
+                    !unicode_sequence_build(text, keys, &mapping->sequences[j], arena, reason, sizeof(reason))) {
+                    if (mapping->layer > 0) {
+                        snprintf(error, error_size, "Invalid variant %zu for '%s' in %s: %s", j + 1, mapping->base,
+                                 configs[c]->layers[mapping->layer], reason);
+                    } else {
+                        snprintf(error, error_size, "Invalid variant %zu for '%s': %s", j + 1, mapping->base, reason);
+                    }
+                    ok = false;
+                    break;
+                }
+                seen[index].text = text;
+                seen[index].sequence = &mapping->sequences[j];
+            }
+        }
+    }
+    free(seen);
+    return ok;
+}
+
+/* Uppercases every letter of text that has a partner; NULL when out of memory. */
+static char *upper_case_string(ConfigBuilder *builder, const char *text)
+{
+    size_t length = strlen(text);
+    /* A partner is never more than one byte longer than its lowercase letter (ÿ -> Ÿ). */
+    char *upper = malloc(length * 2 + 1);
+    if (!upper) {
         return NULL;
     }
+    size_t out = 0;
+    for (size_t pos = 0; pos < length;) {
+        uint32_t codepoint = 0;
+        size_t consumed = utf8_to_codepoint(text + pos, &codepoint);
+        if (consumed == 0) {
+            upper[out++] = text[pos++];
+            continue;
+        }
+        uint32_t partner = codepoint_upper_case(codepoint);
+        out += codepoint_to_utf8(partner ? partner : codepoint, upper + out);
+        pos += consumed;
+    }
+    char *interned = intern_string(builder, upper, out);
+    free(upper);
+    return interned;
+}
 
-    AccentConfig *config = calloc(1, sizeof(AccentConfig));
-    if (!config) {
-        free(buffer);
-        if (error_message) {
-            *error_message = duplicate_string("Out of memory");
+/* Open-addressed set of the bases in the builder, removed ones included. */
+static bool base_seen(const char **set, size_t mask, const char *base, bool insert)
+{
+    size_t index = index_slot(hash_bytes(base, strlen(base)), mask);
+    while (set[index]) {
+        if (strcmp(set[index], base) == 0) {
+            return true;
+        }
+        index = (index + 1) & mask;
+    }
+    if (insert) {
+        set[index] = base;
+    }
+    return false;
+}
+
+/* A lowercase base with no uppercase one gets a derived mapping, its variants
+ * uppercased, so Shift and Caps Lock type capitals with lowercase-only files too. The
+ * derived mapping belongs to the layer of its lowercase base. A base that an overlay set
+ * to null counts as defined, so "E": null in an overlay turns the derivation off. */
+static bool derive_upper_case(ConfigBuilder *builder)
+{
+    AccentConfig *config = builder->config;
+    size_t count = config->mapping_count;
+    size_t capacity = 16;
+    while (capacity < count * 4) {
+        capacity <<= 1;
+    }
+    const char **set = calloc(capacity, sizeof(char *));
+    if (!set) {
+        return false;
+    }
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < count; ++i) {
+        base_seen(set, mask, builder->mappings[i].base, true);
+    }
+
+    bool ok = true;
+    uint32_t layer = builder->layer;
+    for (size_t i = 0; i < count && ok; ++i) {
+        const AccentMapping lower = builder->mappings[i];
+        uint32_t codepoint = 0;
+        size_t consumed = utf8_to_codepoint(lower.base, &codepoint);
+        uint32_t partner = consumed ? codepoint_upper_case(codepoint) : 0;
+        if (lower.variant_count == 0 || lower.base[consumed] != '\0' || partner == 0) {
+            continue;
+        }
+        char base[5];
+        size_t base_length = codepoint_to_utf8(partner, base);
+        AccentMapping upper = {0};
+        upper.base = intern_string(builder, base, base_length);
+        ok = upper.base != NULL;
+        if (!ok || base_seen(set, mask, upper.base, true)) {
+            continue;
+        }
+        upper.variants = arena_alloc(builder->arena, lower.variant_count * sizeof(char *));
+        upper.variant_count = lower.variant_count;
+        ok = upper.variants != NULL;
+        for (size_t j = 0; j < lower.variant_count && ok; ++j) {
+            upper.variants[j] = upper_case_string(builder, lower.variants[j]);
+            ok = upper.variants[j] != NULL;
+        }
+        /* Appended as the lowercase base's layer; the index is not consulted for it. */
+        builder->layer = 0;
+        ok = ok && append_mapping(builder, upper);
+        builder->mappings[config->mapping_count - 1].layer = lower.layer;
+    }
+    builder->layer = layer;
+    free(set);
+    return ok;
+}
+
+/* Moves the mapping table out of its growth buffer so the arena holds the whole
+ * configuration, leaving out the bases a layer removed. */
+static bool finish_mappings(ConfigBuilder *builder)
+{
+    AccentConfig *config = builder->config;
+    size_t count = 0;
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        count += builder->mappings[i].variant_count > 0;
+    }
+    config->mapping_count = count;
+    if (count == 0) {
+        config->mappings = NULL;
+        return true;
+    }
+    AccentMapping *mappings = arena_alloc(builder->arena, count * sizeof(AccentMapping));
+    if (!mappings) {
+        return false;
+    }
+    for (size_t i = 0, kept = 0; kept < count; ++i) {
+        if (builder->mappings[i].variant_count > 0) {
+            mappings[kept++] = builder->mappings[i];
         }
+    }
+    config->mappings = mappings;
+    return true;
+}
+
+/* The source text is read straight into the arena: the parser works on it in place and the
+ * configuration's strings point into it. (A private mapping would take a copy-on-write
+ * fault on nearly every page once string terminators are written.) */
+static char *load_source(const char *path, Arena *arena, size_t *length)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_error("Failed to open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        log_error("%s is not a regular file", path);
+        close(fd);
         return NULL;
     }
 
+    size_t size = (size_t)st.st_size;
+    char *data = arena_alloc(arena, size + 1);
+    size_t done = 0;
+    while (data && done < size) {
+        ssize_t rc = read(fd, data + done, size - done);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        done += (size_t)rc;
+    }
+    close(fd);
+    if (!data || done != size) {
+        log_error("Failed to read %s", path);
+        return NULL;
+    }
+    *length = size;
+    return data;
+}
+
+/* Presets saved by Windows editors start with a UTF-8 byte order mark. */
+static size_t byte_order_mark_length(const char *data, size_t length)
+{
+    return (length >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) ? 3 : 0;
+}
+
+/* Parses a JSON configuration or a preset into the builder's mappings; JSON is parsed in
+ * place, so its strings point into data. */
+static bool parse_source(ConfigBuilder *builder, char *data, size_t length, char *error, size_t error_size)
+{
+    size_t bom = byte_order_mark_length(data, length);
+    data += bom;
+    length -= bom;
+
     JsonParser parser = {0};
-    parser.data = buffer;
+    parser.data = data;
     parser.length = length;
 
-    if (!parse_object(&parser, config)) {
+    /* One vectorized pass up front, so a bad byte is reported where it is rather than
+     * when its variant fails to build. */
+    size_t invalid = 0;
+    bool parsed = text_validate_utf8(data, length, &invalid);
+    if (!parsed) {
+        describe_invalid_utf8(data, invalid, error, error_size);
+    } else if (is_json_document(data, length)) {
+        parsed = parse_object(&parser, builder);
+        if (!parsed) {
+            snprintf(error, error_size, "%s", parser.error[0] ? parser.error : "Failed to parse configuration");
+        }
+    } else {
+        parsed = parse_preset(data, length, builder, error, error_size);
+    }
+    return parsed;
+}
+
+AccentConfig *config_load(const char *path, char **error_message)
+{
+    StringInterner interner = {0};
+    ConfigBuilder builder = {0};
+    builder.interner = &interner;
+    builder.arena = arena_create(CONFIG_ARENA_CHUNK_SIZE);
+    builder.config = arena_alloc(builder.arena, sizeof(AccentConfig));
+    if (!builder.config) {
+        arena_destroy(builder.arena);
+        if (error_message) {
+            *error_message = duplicate_string("Out of memory");
+        }
+        return NULL;
+    }
+    AccentConfig *config = builder.config;
+    config->arena = builder.arena;
+
+    char error[512] = "Out of memory";
+    size_t layer_count = 0;
+    char **layers = config_layer_paths(path, &layer_count);
+    config->layers = layers ? arena_alloc(builder.arena, layer_count * sizeof(char *)) : NULL;
+    bool parsed = config->layers != NULL;
+    for (size_t i = 0; i < layer_count && parsed; ++i) {
+        config->layers[i] = arena_strndup(builder.arena, layers[i], strlen(layers[i]));
+        config->layer_count = i + 1;
+        size_t length = 0;
+        char *data = config->layers[i] ? load_source(layers[i], builder.arena, &length) : NULL;
+        if (!data) {
+            snprintf(error, sizeof(error), "Unable to read configuration file%s%s", i > 0 ? " " : "",
+                     i > 0 ? layers[i] : "");
+            parsed = false;
+            break;
+        }
+        /* Errors in an overlay name the file; the main file's keep their usual form. */
+        char reason[384] = "";
+        builder.layer = (uint32_t)i;
+        parsed = parse_source(&builder, data, length, reason, sizeof(reason));
+        if (!parsed) {
+            snprintf(error, sizeof(error), "%s%s%s", i > 0 ? layers[i] : "", i > 0 ? ": " : "", reason);
+        }
+    }
+    if (parsed && (!derive_upper_case(&builder) || !finish_mappings(&builder))) {
+        snprintf(error, sizeof(error), "Out of memory");
+        parsed = false;
+    }
+    free(layers);
+    free(builder.mappings);
+    free(builder.index);
+    free(builder.items);
+    free(interner.slots);
+    if (!parsed) {
         if (error_message) {
-            *error_message = duplicate_string(parser.error[0] ? parser.error : "Failed to parse configuration");
+            *error_message = duplicate_string(error);
         }
         config_free(config);
-        free(buffer);
         return NULL;
     }
 
-    free(buffer);
+    if (!compile_sequences(&config, 1, 0, builder.arena, NULL, error, sizeof(error)) ||
+        !config_load_profiles(config, path, error_message) || !mapper_compile(config)) {
+        if (error_message && !*error_message) {
+            *error_message = duplicate_string(error[0] ? error : "Out of memory");
+        }
+        config_free(config);
+        return NULL;
+    }
     return config;
 }
 
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Sorted names of the .json files in directory, and of the .conf presets too when asked. */
+static bool list_config_files(const char *directory, bool presets, char ***files, size_t *count, char *error,
+                              size_t error_size)
+{
+    *files = NULL;
+    *count = 0;
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        snprintf(error, error_size, "Unable to open profiles directory %s: %s", directory, strerror(errno));
+        return false;
+    }
+    char **names = NULL;
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *extension = strrchr(entry->d_name, '.');
+        if (!extension || extension == entry->d_name ||
+            (strcmp(extension, ".json") != 0 && (!presets || strcmp(extension, ".conf") != 0))) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            char **grown = realloc(names, capacity * sizeof(char *));
+            if (!grown) {
+                break;
+            }
+            names = grown;
+        }
+        names[*count] = duplicate_string(entry->d_name);
+        if (!names[*count]) {
+            break;
+        }
+        (*count)++;
+    }
+    closedir(dir);
+    if (entry) {
+        snprintf(error, error_size, "Out of memory");
+        for (size_t i = 0; i < *count; ++i) {
+            free(names[i]);
+        }
+        free(names);
+        *count = 0;
+        return false;
+    }
+    if (names) {
+        qsort(names, *count, sizeof(char *), compare_names);
+    }
+    *files = names;
+    return true;
+}
+
+/* Set once at startup, before any loader thread runs. */
+static const char *user_file;
+
+void config_set_user_file(const char *path)
+{
+    user_file = path && path[0] ? path : NULL;
+}
+
+const char *config_get_user_file(void)
+{
+    return user_file;
+}
+
+char **config_layer_paths(const char *path, size_t *count)
+{
+    const char *slash = strrchr(path, '/');
+    char overlays[4096];
+    snprintf(overlays, sizeof(overlays), "%.*s%s", slash ? (int)(slash - path + 1) : 0, path,
+             CONFIG_OVERLAY_DIRECTORY);
+    char **names = NULL;
+    size_t name_count = 0;
+    struct stat st;
+    if (stat(overlays, &st) == 0 && S_ISDIR(st.st_mode)) {
+        char error[256];
+        if (!list_config_files(overlays, false, &names, &name_count, error, sizeof(error))) {
+            log_error("Skipping configuration overlays: %s", error);
+        }
+    }
+
+    /* The user file is left out when it is the main file already. */
+    char user[4096] = "";
+    struct stat main_st;
+    if (user_file) {
+        snprintf(user, sizeof(user), "%s", user_file);
+        if (stat(user, &st) != 0 || !S_ISREG(st.st_mode) ||
+            (stat(path, &main_st) == 0 && main_st.st_dev == st.st_dev && main_st.st_ino == st.st_ino)) {
+            user[0] = '\0';
+        }
+    }
+
+    size_t overlays_length = strlen(overlays);
+    *count = 1 + name_count + (user[0] != '\0');
+    size_t size = *count * sizeof(char *) + strlen(path) + 1 + strlen(user) + 1;
+    for (size_t i = 0; i < name_count; ++i) {
+        size += overlays_length + 1 + strlen(names[i]) + 1;
+    }
+    char **layers = malloc(size);
+    if (layers) {
+        char *text = (char *)(layers + *count);
+        char *end = (char *)layers + size;
+        size_t n = 0;
+        layers[n++] = text;
+        text += snprintf(text, (size_t)(end - text), "%s", path) + 1;
+        for (size_t i = 0; i < name_count; ++i) {
+            layers[n++] = text;
+            text += snprintf(text, (size_t)(end - text), "%s/%s", overlays, names[i]) + 1;
+        }
+        if (user[0]) {
+            layers[n++] = text;
+            snprintf(text, (size_t)(end - text), "%s", user);
+        }
+    }
+    for (size_t i = 0; i < name_count; ++i) {
+        free(names[i]);
+    }
+    free(names);
+    return layers;
+}
+
+/* A profile only brings mappings; its other settings are the main configuration's. */
+static bool load_profile(ConfigBuilder *builder, AccentConfig *profile, const AccentConfig *config,
+                         const char *file_name, size_t name_length, char *error, size_t error_size)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", config->profiles_dir, file_name);
+    /* Read into the arena like the configuration's own files, so JSON is parsed in place. */
+    size_t length = 0;
+    char *data = load_source(path, builder->arena, &length);
+    if (!data) {
+        snprintf(error, error_size, "Unable to read profile %s", file_name);
+        return false;
+    }
+
+    builder->config = profile;
+    profile->mappings = builder->mappings;
+    char reason[256] = "Out of memory";
+    bool parsed = parse_source(builder, data, length, reason, sizeof(reason)) &&
+                  derive_upper_case(builder) && finish_mappings(builder);
+    if (!parsed) {
+        snprintf(error, error_size, "Profile %s: %s", file_name, reason);
+        return false;
+    }
+
+    AccentMapping *mappings = profile->mappings;
+    size_t mapping_count = profile->mapping_count;
+    *profile = *config;
+    profile->mappings = mappings;
+    profile->mapping_count = mapping_count;
+    profile->keymap = NULL;
+    profile->compose = NULL;
+    profile->key_characters = NULL;
+    profile->profile_name = arena_strndup(builder->arena, file_name, name_length);
+    profile->layers = arena_alloc(builder->arena, sizeof(char *));
+    if (!profile->profile_name || !profile->layers) {
+        return false;
+    }
+    profile->layers[0] = arena_strndup(builder->arena, path, strlen(path));
+    profile->layer_count = 1;
+    return profile->layers[0] != NULL;
+}
+
+bool config_load_profiles(AccentConfig *config, const char *source_path, char **error_message)
+{
+    config->root = config;
+    if (!config->profiles_dir) {
+        if (config->startup_profile && error_message) {
+            *error_message = duplicate_string("\"profile\" needs a \"profiles_dir\"");
+        }
+        return !config->startup_profile;
+    }
+
+    const char *slash = strrchr(source_path, '/');
+    const char *file_name = slash ? slash + 1 : source_path;
+    const char *extension = strrchr(file_name, '.');
+    size_t name_length = extension && extension != file_name ? (size_t)(extension - file_name) : strlen(file_name);
+    config->profile_name = arena_strndup(config->arena, file_name, name_length);
+
+    char error[512] = "Out of memory";
+    char **files = NULL;
+    size_t file_count = 0;
+    bool ok = list_config_files(config->profiles_dir, true, &files, &file_count, error, sizeof(error));
+    AccentConfig **profiles = ok ? arena_alloc(config->arena, (file_count + 1) * sizeof(AccentConfig *)) : NULL;
+    ok = ok && profiles && config->profile_name;
+    size_t loaded = 0;
+    if (profiles) {
+        profiles[loaded++] = config;
+    }
+
+    StringInterner interner = {0};
+    ConfigBuilder builder = {0};
+    builder.arena = config->arena;
+    builder.interner = &interner;
+    for (size_t i = 0; i < file_count && ok; ++i) {
+        size_t length = (size_t)(strrchr(files[i], '.') - files[i]);
+        /* The main file may live in the profiles directory too. */
+        if (length == name_length && strncmp(files[i], config->profile_name, length) == 0) {
+            continue;
+        }
+        AccentConfig *profile = arena_alloc(config->arena, sizeof(AccentConfig));
+        ok = profile && load_profile(&builder, profile, config, files[i], length, error, sizeof(error));
+        if (ok) {
+            profile->profile_index = loaded;
+            profiles[loaded++] = profile;
+        }
+    }
+    for (size_t i = 0; i < file_count; ++i) {
+        free(files[i]);
+    }
+    free(files);
+    free(builder.mappings);
+    free(builder.items);
+    free(interner.slots);
+
+    ok = ok && compile_sequences(profiles, loaded, 1, config->arena, config->unicode_keys, error, sizeof(error));
+    if (ok) {
+        for (size_t i = 0; i < loaded; ++i) {
+            profiles[i]->profiles = profiles;
+            profiles[i]->profile_count = loaded;
+        }
+        if (config->startup_profile && !config_find_profile(config, config->startup_profile)) {
+            snprintf(error, sizeof(error), "No profile named '%s' in %s", config->startup_profile,
+                     config->profiles_dir);
+            ok = false;
+        }
+    }
+    if (!ok && error_message) {
+        *error_message = duplicate_string(error);
+    }
+    return ok;
+}
+
+bool config_compile_sequences(AccentConfig *config, char **error_message)
+{
+    char error[512] = "";
+    AccentConfig *const *configs = config->profiles ? config->profiles : &config;
+    size_t count = config->profiles ? config->profile_count : 1;
+    if (!compile_sequences(configs, count, 0, config->arena, config->unicode_keys, error, sizeof(error))) {
+        if (error_message) {
+            *error_message = duplicate_string(error);
+        }
+        return false;
+    }
+    return true;
+}
+
+/* The configuration itself lives in its arena, so this is one release (plus the cache mapping). */
 void config_free(AccentConfig *config)
 {
     if (!config) {
         return;
     }
-    for (size_t i = 0; i < config->mapping_count; ++i) {
-        AccentMapping *mapping = &config->mappings[i];
-        free(mapping->base);
-        for (size_t j = 0; j < mapping->variant_count; ++j) {
-            free(mapping->variants[j]);
-        }
-        free(mapping->variants);
+    if (config->image) {
+        config_cache_unmap(config);
     }
-    free(config->mappings);
-    free(config->input_device);
-    free(config->display_mode);
-    free(config);
+    arena_destroy(config->arena);
 }
 
 const AccentMapping *config_find_mapping(const AccentConfig *config, const char *base)
@@ -394,11 +1346,44 @@ const AccentMapping *config_find_mapping(const AccentConfig *config, const char
     return NULL;
 }
 
+const AccentConfig *config_find_profile(const AccentConfig *config, const char *name)
+{
+    if (!config || !name) {
+        return NULL;
+    }
+    for (size_t i = 0; i < config->profile_count; ++i) {
+        if (strcmp(config->profiles[i]->profile_name, name) == 0) {
+            return config->profiles[i];
+        }
+    }
+    return NULL;
+}
+
 const char *config_get_input_device(const AccentConfig *config)
 {
     return config ? config->input_device : NULL;
 }
 
+const char *config_get_output_backend(const AccentConfig *config)
+{
+    return config ? config->output_backend : NULL;
+}
+
+const char *config_get_log_level(const AccentConfig *config)
+{
+    return config ? config->log_level : NULL;
+}
+
+const char *const *config_get_device_rules(const AccentConfig *config, bool exclude, size_t *count)
+{
+    if (!config) {
+        *count = 0;
+        return NULL;
+    }
+    *count = exclude ? config->device_exclude_count : config->device_include_count;
+    return (const char *const *)(exclude ? config->device_exclude : config->device_include);
+}
+
 const char *config_get_display_mode(const AccentConfig *config)
 {
     return config ? config->display_mode : NULL;
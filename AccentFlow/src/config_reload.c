@@ -0,0 +1,307 @@
+#include "config_reload.h"
+#include "config.h"
+#include "config_cache.h"
+#include "input_engine.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* A watched directory and the file in it that matters; NULL stands for any .json file. */
+typedef struct {
+    int wd;
+    const char *name;
+} ConfigWatch;
+
+#define CONFIG_WATCH_COUNT 3
+
+struct ConfigReloader {
+    InputEngine *engine;
+    char *config_path;
+    char *cache_path;
+    const char *file_name;  /* points into config_path */
+    int inotify_fd;
+    ConfigWatch watches[CONFIG_WATCH_COUNT]; /* main file, overlay directory, user file */
+    size_t watch_count;
+    int request_fd;
+    int stop_fd;
+    pthread_t thread;
+    bool thread_started;
+
+    /* Owned by the reload thread while it runs. current is the latest published
+     * configuration; previous is set while the engine may still be using it. */
+    AccentConfig *current;
+    AccentConfig *previous;
+};
+
+static void drain_eventfd(int fd)
+{
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0) {
+    }
+}
+
+static bool watched_file(const ConfigReloader *reloader, const struct inotify_event *event)
+{
+    for (size_t i = 0; i < reloader->watch_count && event->len > 0; ++i) {
+        const ConfigWatch *watch = &reloader->watches[i];
+        if (watch->wd != event->wd) {
+            continue;
+        }
+        const char *extension = strrchr(event->name, '.');
+        if (watch->name ? strcmp(event->name, watch->name) == 0 : extension && strcmp(extension, ".json") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* True when a queued inotify event names one of the configuration's files. */
+static bool drain_inotify(ConfigReloader *reloader)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    while (1) {
+        ssize_t length = read(reloader->inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return changed;
+        }
+        for (char *ptr = buffer; ptr < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            if (watched_file(reloader, event)) {
+                changed = true;
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/* Waits for the engine to report it runs on config; false when asked to stop first. */
+static bool wait_for_switch(ConfigReloader *reloader, const AccentConfig *config)
+{
+    struct pollfd fds[2] = {
+        {.fd = reloader->stop_fd, .events = POLLIN},
+        {.fd = input_engine_config_switch_fd(reloader->engine), .events = POLLIN},
+    };
+    while (input_engine_active_config(reloader->engine) != config) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Configuration reload wait failed: %s", strerror(errno));
+            return false;
+        }
+        if (fds[0].revents & POLLIN) {
+            return false;
+        }
+        drain_eventfd(fds[1].fd);
+    }
+    return true;
+}
+
+static bool reload(ConfigReloader *reloader)
+{
+    uint64_t start = monotonic_time_ns();
+    char *error_message = NULL;
+    AccentConfig *config = reloader->cache_path
+                               ? config_load_cached(reloader->config_path, reloader->cache_path, &error_message)
+                               : config_load(reloader->config_path, &error_message);
+    if (!config) {
+        log_error("Reload of %s failed, keeping the current configuration: %s", reloader->config_path,
+                  error_message ? error_message : "unknown error");
+        free(error_message);
+        return true;
+    }
+    free(error_message);
+    if (!log_set_level(config_get_log_level(config))) {
+        log_warn("Unknown log_level '%s', keeping the current level", config_get_log_level(config));
+    }
+    log_info("Reloaded %zu mappings from %s in %.1f ms", config->mapping_count, reloader->config_path,
+             (double)(monotonic_time_ns() - start) / 1e6);
+
+    reloader->previous = reloader->current;
+    reloader->current = config;
+    input_engine_publish_config(reloader->engine, config);
+    if (!wait_for_switch(reloader, config)) {
+        return false;
+    }
+    config_free(reloader->previous);
+    reloader->previous = NULL;
+    return true;
+}
+
+static void *reload_thread(void *userdata)
+{
+    ConfigReloader *reloader = userdata;
+    struct pollfd fds[3] = {
+        {.fd = reloader->stop_fd, .events = POLLIN},
+        {.fd = reloader->request_fd, .events = POLLIN},
+        {.fd = reloader->inotify_fd, .events = POLLIN},
+    };
+    nfds_t count = reloader->inotify_fd >= 0 ? 3 : 2;
+
+    while (1) {
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Configuration watch failed: %s", strerror(errno));
+            return NULL;
+        }
+        if (fds[0].revents & POLLIN) {
+            return NULL;
+        }
+        bool wanted = false;
+        if (fds[1].revents & POLLIN) {
+            drain_eventfd(reloader->request_fd);
+            wanted = true;
+        }
+        if (count > 2 && (fds[2].revents & POLLIN) && drain_inotify(reloader)) {
+            wanted = true;
+        }
+        if (wanted && !reload(reloader)) {
+            return NULL;
+        }
+    }
+}
+
+static bool add_watch(ConfigReloader *reloader, const char *directory, const char *name, uint32_t mask)
+{
+    int wd = inotify_add_watch(reloader->inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MASK_ADD | mask);
+    if (wd < 0) {
+        return false;
+    }
+    reloader->watches[reloader->watch_count++] = (ConfigWatch){.wd = wd, .name = name};
+    return true;
+}
+
+/* The directory part of path into directory; returns the file name in path. */
+static const char *split_path(const char *path, char *directory, size_t size)
+{
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(directory, size, ".");
+    } else if (slash == path) {
+        snprintf(directory, size, "/");
+    } else {
+        snprintf(directory, size, "%.*s", (int)(slash - path), path);
+    }
+    return slash ? slash + 1 : path;
+}
+
+/* Watches directories rather than files: saving by rename replaces the inode. Overlays are
+ * also watched for removal; an overlay directory created later needs a SIGHUP. */
+static void watch_config_file(ConfigReloader *reloader)
+{
+    char directory[4096];
+    reloader->file_name = split_path(reloader->config_path, directory, sizeof(directory));
+
+    reloader->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reloader->inotify_fd < 0 || !add_watch(reloader, directory, reloader->file_name, 0)) {
+        log_error("Unable to watch %s for changes, reload with SIGHUP instead: %s", directory, strerror(errno));
+        if (reloader->inotify_fd >= 0) {
+            close(reloader->inotify_fd);
+            reloader->inotify_fd = -1;
+        }
+        return;
+    }
+
+    char overlays[sizeof(directory) + sizeof(CONFIG_OVERLAY_DIRECTORY) + 1];
+    snprintf(overlays, sizeof(overlays), "%s/" CONFIG_OVERLAY_DIRECTORY, directory);
+    if (access(overlays, F_OK) == 0 && !add_watch(reloader, overlays, NULL, IN_DELETE | IN_MOVED_FROM)) {
+        log_error("Unable to watch %s for changes: %s", overlays, strerror(errno));
+    }
+    const char *user_file = config_get_user_file();
+    if (user_file) {
+        const char *user_name = split_path(user_file, directory, sizeof(directory));
+        if (!add_watch(reloader, directory, user_name, IN_DELETE | IN_MOVED_FROM)) {
+            log_error("Unable to watch %s for changes: %s", directory, strerror(errno));
+        }
+    }
+}
+
+ConfigReloader *config_reloader_create(InputEngine *engine, AccentConfig *config, const char *config_path,
+                                       const char *cache_path)
+{
+    ConfigReloader *reloader = calloc(1, sizeof(ConfigReloader));
+    if (!reloader) {
+        return NULL;
+    }
+    reloader->engine = engine;
+    reloader->current = config;
+    reloader->inotify_fd = -1;
+    reloader->config_path = duplicate_string(config_path);
+    reloader->cache_path = duplicate_string(cache_path);
+    reloader->request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reloader->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!reloader->config_path || (cache_path && !reloader->cache_path) || reloader->request_fd < 0 ||
+        reloader->stop_fd < 0) {
+        log_error("Unable to set up configuration reload");
+        reloader->current = NULL;
+        config_reloader_destroy(reloader);
+        return NULL;
+    }
+
+    watch_config_file(reloader);
+    /* The thread starts with every signal blocked so they all reach the event loop's signalfd. */
+    sigset_t all_signals;
+    sigset_t previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+    int rc = pthread_create(&reloader->thread, NULL, reload_thread, reloader);
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    if (rc != 0) {
+        log_error("Unable to start configuration reload thread: %s", strerror(rc));
+        reloader->current = NULL;
+        config_reloader_destroy(reloader);
+        return NULL;
+    }
+    reloader->thread_started = true;
+    return reloader;
+}
+
+void config_reloader_destroy(ConfigReloader *reloader)
+{
+    if (!reloader) {
+        return;
+    }
+    if (reloader->thread_started) {
+        uint64_t one = 1;
+        if (write(reloader->stop_fd, &one, sizeof(one)) < 0) {
+            log_error("Unable to stop configuration reload thread: %s", strerror(errno));
+        }
+        pthread_join(reloader->thread, NULL);
+    }
+    config_free(reloader->previous);
+    config_free(reloader->current);
+    if (reloader->inotify_fd >= 0) {
+        close(reloader->inotify_fd);
+    }
+    if (reloader->request_fd >= 0) {
+        close(reloader->request_fd);
+    }
+    if (reloader->stop_fd >= 0) {
+        close(reloader->stop_fd);
+    }
+    free(reloader->config_path);
+    free(reloader->cache_path);
+    free(reloader);
+}
+
+void config_reloader_request(ConfigReloader *reloader)
+{
+    uint64_t one = 1;
+    if (reloader && write(reloader->request_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Unable to request configuration reload: %s", strerror(errno));
+    }
+}
@@ -0,0 +1,296 @@
+#include "device_monitor.h"
+#include "config.h"
+#include "event_loop.h"
+#include "input_engine.h"
+#include "output_backend.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define DEVICE_MONITOR_DIR "/dev/input"
+#define DEVICE_MONITOR_KEY_WORDS ((KEY_CNT + 63) / 64)
+
+struct DeviceMonitor {
+    InputEngine *engine;
+    EventLoop *loop;
+    int inotify_fd;
+    /* Readable while paths are queued, so probing runs one device per loop pass. */
+    int probe_fd;
+    char **queue;
+    size_t queue_head;
+    size_t queue_count;
+    size_t queue_capacity;
+};
+
+static bool enqueue_path(DeviceMonitor *monitor, const char *name)
+{
+    if (strncmp(name, "event", 5) != 0) {
+        return true;
+    }
+
+    if (monitor->queue_head + monitor->queue_count == monitor->queue_capacity) {
+        if (monitor->queue_head > 0) {
+            memmove(monitor->queue, monitor->queue + monitor->queue_head, monitor->queue_count * sizeof(char *));
+            monitor->queue_head = 0;
+        } else {
+            size_t capacity = monitor->queue_capacity ? monitor->queue_capacity * 2 : 16;
+            char **queue = realloc(monitor->queue, capacity * sizeof(char *));
+            if (!queue) {
+                return false;
+            }
+            monitor->queue = queue;
+            monitor->queue_capacity = capacity;
+        }
+    }
+
+    char path[sizeof(DEVICE_MONITOR_DIR) + 256];
+    snprintf(path, sizeof(path), DEVICE_MONITOR_DIR "/%s", name);
+    char *copy = duplicate_string(path);
+    if (!copy) {
+        return false;
+    }
+    monitor->queue[monitor->queue_head + monitor->queue_count++] = copy;
+
+    uint64_t one = 1;
+    if (write(monitor->probe_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Unable to schedule device probe: %s", strerror(errno));
+    }
+    return true;
+}
+
+static bool has_key(const uint64_t *keys, int code)
+{
+    return (keys[code / 64] >> (code % 64)) & 1u;
+}
+
+static bool rule_matches(const char *rule, const char *name, const struct input_id *id)
+{
+    if (strncmp(rule, "name:", 5) == 0) {
+        return fnmatch(rule + 5, name, FNM_CASEFOLD) == 0;
+    }
+    if (strncmp(rule, "id:", 3) == 0) {
+        char vendor[8];
+        char product[8];
+        snprintf(vendor, sizeof(vendor), "%04x", id->vendor);
+        snprintf(product, sizeof(product), "%04x", id->product);
+        const char *separator = strchr(rule + 3, ':');
+        if (!separator) {
+            return fnmatch(rule + 3, vendor, FNM_CASEFOLD) == 0;
+        }
+        char pattern[32];
+        snprintf(pattern, sizeof(pattern), "%.*s", (int)(separator - rule - 3), rule + 3);
+        return fnmatch(pattern, vendor, FNM_CASEFOLD) == 0 && fnmatch(separator + 1, product, FNM_CASEFOLD) == 0;
+    }
+    return false;
+}
+
+static bool rules_match(const AccentConfig *config, bool exclude, const char *name, const struct input_id *id)
+{
+    size_t count = 0;
+    const char *const *rules = config_get_device_rules(config, exclude, &count);
+    for (size_t i = 0; i < count; ++i) {
+        if (rule_matches(rules[i], name, id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_wanted_keyboard(DeviceMonitor *monitor, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        /* udev may not have fixed permissions yet; IN_ATTRIB queues a retry. */
+        return false;
+    }
+
+    uint64_t keys[DEVICE_MONITOR_KEY_WORDS];
+    memset(keys, 0, sizeof(keys));
+    struct input_id id;
+    char name[256] = "";
+    bool probed = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0 &&
+                  ioctl(fd, EVIOCGID, &id) >= 0 &&
+                  ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) >= 0;
+    close(fd);
+
+    if (!probed) {
+        return false;
+    }
+    if (id.vendor == ACCENTFLOW_UINPUT_VENDOR && id.product == ACCENTFLOW_UINPUT_PRODUCT) {
+        return false;
+    }
+    if (!has_key(keys, KEY_A) || !has_key(keys, KEY_Z) || !has_key(keys, KEY_ENTER)) {
+        return false;
+    }
+
+    /* Rules come from the engine's current configuration, so a reload applies to new devices. */
+    const AccentConfig *config = input_engine_active_config(monitor->engine);
+    size_t include_count = 0;
+    config_get_device_rules(config, false, &include_count);
+    if (include_count > 0 && !rules_match(config, false, name, &id)) {
+        return false;
+    }
+    if (rules_match(config, true, name, &id)) {
+        log_info("Skipping excluded keyboard %s (%s, %04x:%04x)", path, name, id.vendor, id.product);
+        return false;
+    }
+
+    log_info("Discovered keyboard %s (%s, %04x:%04x)", path, name, id.vendor, id.product);
+    return true;
+}
+
+static int handle_probe(EventLoop *loop, int fd, uint32_t events, void *userdata)
+{
+    (void)loop;
+    (void)events;
+    DeviceMonitor *monitor = userdata;
+
+    if (monitor->queue_count == 0) {
+        uint64_t pending;
+        if (read(fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN) {
+            log_error("Device probe queue read error: %s", strerror(errno));
+        }
+        return 0;
+    }
+
+    char *path = monitor->queue[monitor->queue_head++];
+    monitor->queue_count--;
+    if (monitor->queue_count == 0) {
+        monitor->queue_head = 0;
+    }
+
+    if (!input_engine_has_device(monitor->engine, path) && is_wanted_keyboard(monitor, path)) {
+        input_engine_add_device(monitor->engine, path);
+    }
+    free(path);
+    return 0;
+}
+
+static int handle_inotify(EventLoop *loop, int fd, uint32_t events, void *userdata)
+{
+    (void)loop;
+    (void)events;
+    DeviceMonitor *monitor = userdata;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (1) {
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+            log_error("inotify read error: %s", strerror(errno));
+            return -1;
+        }
+
+        for (char *cursor = buffer; cursor < buffer + bytes;) {
+            const struct inotify_event *event = (const struct inotify_event *)cursor;
+            cursor += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                char path[sizeof(DEVICE_MONITOR_DIR) + 256];
+                snprintf(path, sizeof(path), DEVICE_MONITOR_DIR "/%s", event->name);
+                input_engine_remove_device(monitor->engine, path);
+            } else if (!enqueue_path(monitor, event->name)) {
+                return -1;
+            }
+        }
+    }
+}
+
+static bool scan_existing(DeviceMonitor *monitor)
+{
+    DIR *dir = opendir(DEVICE_MONITOR_DIR);
+    if (!dir) {
+        log_error("Unable to list %s: %s", DEVICE_MONITOR_DIR, strerror(errno));
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!enqueue_path(monitor, entry->d_name)) {
+            closedir(dir);
+            return false;
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+DeviceMonitor *device_monitor_create(InputEngine *engine)
+{
+    DeviceMonitor *monitor = calloc(1, sizeof(DeviceMonitor));
+    if (!monitor) {
+        return NULL;
+    }
+    monitor->engine = engine;
+    monitor->loop = input_engine_get_loop(engine);
+    monitor->inotify_fd = -1;
+
+    monitor->probe_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (monitor->probe_fd < 0) {
+        log_error("Unable to create device probe queue: %s", strerror(errno));
+        free(monitor);
+        return NULL;
+    }
+
+    monitor->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (monitor->inotify_fd < 0 ||
+        inotify_add_watch(monitor->inotify_fd, DEVICE_MONITOR_DIR, IN_CREATE | IN_ATTRIB | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+        log_error("Unable to watch %s: %s", DEVICE_MONITOR_DIR, strerror(errno));
+        device_monitor_destroy(monitor);
+        return NULL;
+    }
+
+    if (event_loop_add(monitor->loop, monitor->probe_fd, EPOLLIN, handle_probe, monitor) < 0) {
+        device_monitor_destroy(monitor);
+        return NULL;
+    }
+    if (event_loop_add(monitor->loop, monitor->inotify_fd, EPOLLIN, handle_inotify, monitor) < 0) {
+        device_monitor_destroy(monitor);
+        return NULL;
+    }
+
+    if (!scan_existing(monitor)) {
+        device_monitor_destroy(monitor);
+        return NULL;
+    }
+
+    input_engine_set_hotplug(engine, true);
+    return monitor;
+}
+
+void device_monitor_destroy(DeviceMonitor *monitor)
+{
+    if (!monitor) {
+        return;
+    }
+    if (monitor->probe_fd >= 0) {
+        event_loop_remove(monitor->loop, monitor->probe_fd);
+        close(monitor->probe_fd);
+    }
+    if (monitor->inotify_fd >= 0) {
+        event_loop_remove(monitor->loop, monitor->inotify_fd);
+        close(monitor->inotify_fd);
+    }
+    for (size_t i = 0; i < monitor->queue_count; ++i) {
+        free(monitor->queue[monitor->queue_head + i]);
+    }
+    free(monitor->queue);
+    free(monitor);
+}
@@ -1,39 +1,286 @@
 #include "display.h"
 #include "config.h"
+#include "spsc_ring.h"
+#include "utils.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* The input thread only formats records into the ring; the display thread writes them to
+ * stderr, which may be a journald pipe that blocks. When the ring is full a record is
+ * dropped rather than making the input thread wait. The preview line is registered with
+ * the logger as a partial line, so log lines written meanwhile start on a clean line. */
+#define DISPLAY_RING_SLOTS 256
+#define DISPLAY_RECORD_TEXT 232
+
+typedef enum {
+    DISPLAY_RECORD_VARIANTS,
+    DISPLAY_RECORD_COMMITTED,
+    DISPLAY_RECORD_CLEAR,
+} DisplayRecordKind;
+
+typedef struct {
+    unsigned char kind;
+    char text[DISPLAY_RECORD_TEXT];
+} DisplayRecord;
 
 struct Display {
-    size_t last_columns;
+    SpscRing *ring;
+    FILE *stream;
+    /* display_create_stream: records are rendered as they are published. */
+    bool synchronous;
+    size_t partial_columns; /* preview width on a stream other than stderr */
+    int wake_fd;
+    pthread_t thread;
+    bool thread_started;
+    /* Set by the display thread before it blocks on wake_fd; the producer writes wake_fd
+     * only when it finds the flag set, so a busy display costs no system calls. */
+    _Atomic bool sleeping;
+    _Atomic bool stopping;
+    _Atomic size_t dropped;
+
+    size_t dropped_reported; /* display thread only */
 };
 
+/* The logger keeps track of a preview on stderr, since its lines wipe it as well. */
+static void set_partial_line(Display *display, size_t columns)
+{
+    if (display->stream == stderr) {
+        log_partial_line(columns);
+    } else {
+        display->partial_columns = columns;
+    }
+}
+
+/* Called with the stream locked. */
 static void clear_previous(Display *display)
 {
-    if (!display || display->last_columns == 0) {
+    size_t columns = display->partial_columns;
+    if (display->stream == stderr) {
+        columns = log_take_partial_line();
+    }
+    display->partial_columns = 0;
+    if (columns == 0) {
+        return;
+    }
+    fprintf(display->stream, "\r");
+    for (size_t i = 0; i < columns; ++i) {
+        fputc(' ', display->stream);
+    }
+    fprintf(display->stream, "\r");
+}
+
+static void render(Display *display, const DisplayRecord *record)
+{
+    flockfile(display->stream);
+    clear_previous(display);
+    switch ((DisplayRecordKind)record->kind) {
+    case DISPLAY_RECORD_VARIANTS:
+        fprintf(display->stream, "%s", record->text);
+        set_partial_line(display, strlen(record->text));
+        break;
+    case DISPLAY_RECORD_COMMITTED:
+        fprintf(display->stream, "AccentFlow committed: %s\n", record->text);
+        break;
+    case DISPLAY_RECORD_CLEAR:
+        break;
+    }
+    funlockfile(display->stream);
+}
+
+/* A variants line followed by another record would only be overwritten. */
+static bool superseded(Display *display, const DisplayRecord *record)
+{
+    return record->kind == DISPLAY_RECORD_VARIANTS && spsc_ring_peek(display->ring, 1) != NULL;
+}
+
+static void report_dropped(Display *display)
+{
+    size_t dropped = atomic_load_explicit(&display->dropped, memory_order_relaxed);
+    if (dropped != display->dropped_reported) {
+        log_error("Display fell behind; dropped %zu updates", dropped - display->dropped_reported);
+        display->dropped_reported = dropped;
+    }
+}
+
+/* Blocks until the producer publishes or the display is stopping. */
+static void wait_for_records(Display *display)
+{
+    atomic_store(&display->sleeping, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!spsc_ring_empty(display->ring) || atomic_load(&display->stopping)) {
+        atomic_store(&display->sleeping, false);
+        return;
+    }
+    struct pollfd pfd = {.fd = display->wake_fd, .events = POLLIN};
+    if (poll(&pfd, 1, -1) > 0) {
+        uint64_t count;
+        if (read(display->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            log_error("Display wakeup failed: %s", strerror(errno));
+        }
+    }
+    atomic_store(&display->sleeping, false);
+}
+
+static void *display_thread(void *userdata)
+{
+    Display *display = userdata;
+    while (1) {
+        const DisplayRecord *record = spsc_ring_peek(display->ring, 0);
+        if (!record) {
+            report_dropped(display);
+            if (atomic_load(&display->stopping)) {
+                break;
+            }
+            wait_for_records(display);
+            continue;
+        }
+        if (!superseded(display, record)) {
+            render(display, record);
+        }
+        spsc_ring_pop(display->ring);
+    }
+    flockfile(display->stream);
+    clear_previous(display);
+    funlockfile(display->stream);
+    return NULL;
+}
+
+static void wake(Display *display)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&display->sleeping, memory_order_relaxed) &&
+        atomic_exchange(&display->sleeping, false)) {
+        uint64_t one = 1;
+        if (write(display->wake_fd, &one, sizeof(one)) < 0) {
+            /* The display thread still drains the ring on its next wakeup. */
+        }
+    }
+}
+
+static DisplayRecord *reserve(Display *display, DisplayRecordKind kind)
+{
+    DisplayRecord *record = spsc_ring_reserve(display->ring);
+    if (!record) {
+        atomic_fetch_add_explicit(&display->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    record->kind = (unsigned char)kind;
+    return record;
+}
+
+static void publish(Display *display)
+{
+    spsc_ring_publish(display->ring);
+    if (display->synchronous) {
+        render(display, spsc_ring_peek(display->ring, 0));
+        spsc_ring_pop(display->ring);
         return;
     }
-    fprintf(stderr, "\r");
-    for (size_t i = 0; i < display->last_columns; ++i) {
-        fputc(' ', stderr);
+    wake(display);
+}
+
+/* Appends text at *offset, truncated to the record before a character that does not fit
+ * whole; returns false once it is full. */
+static bool append(char *buffer, size_t *offset, const char *text)
+{
+    size_t length = strlen(text);
+    size_t room = DISPLAY_RECORD_TEXT - 1 - *offset;
+    bool truncated = length > room;
+    if (truncated) {
+        length = room;
+        while (length > 0 && ((unsigned char)text[length] & 0xC0) == 0x80) {
+            length--;
+        }
     }
-    fprintf(stderr, "\r");
-    display->last_columns = 0;
+    memcpy(buffer + *offset, text, length);
+    *offset += length;
+    buffer[*offset] = '\0';
+    return !truncated && *offset < DISPLAY_RECORD_TEXT - 1;
 }
 
 Display *display_create_tui(void)
 {
     Display *display = calloc(1, sizeof(Display));
+    if (!display) {
+        return NULL;
+    }
+    display->stream = stderr;
+    display->wake_fd = eventfd(0, EFD_CLOEXEC);
+    display->ring = spsc_ring_create(sizeof(DisplayRecord), DISPLAY_RING_SLOTS);
+    if (display->wake_fd < 0 || !display->ring) {
+        log_error("Unable to set up the display queue");
+        display_destroy(display);
+        return NULL;
+    }
+
+    /* Signals stay with the event loop's signalfd, as for the reload thread. */
+    sigset_t all_signals;
+    sigset_t previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+    int rc = pthread_create(&display->thread, NULL, display_thread, display);
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    if (rc != 0) {
+        log_error("Unable to start display thread: %s", strerror(rc));
+        display_destroy(display);
+        return NULL;
+    }
+    display->thread_started = true;
+    return display;
+}
+
+Display *display_create_stream(FILE *stream)
+{
+    Display *display = calloc(1, sizeof(Display));
+    if (!display) {
+        return NULL;
+    }
+    display->stream = stream;
+    display->synchronous = true;
+    display->wake_fd = -1;
+    display->ring = spsc_ring_create(sizeof(DisplayRecord), 1);
+    if (!display->ring) {
+        log_error("Unable to set up the display queue");
+        free(display);
+        return NULL;
+    }
     return display;
 }
 
+/* Renders everything still queued, then stops the display thread. */
 void display_destroy(Display *display)
 {
     if (!display) {
         return;
     }
-    clear_previous(display);
+    if (display->synchronous) {
+        flockfile(display->stream);
+        clear_previous(display);
+        funlockfile(display->stream);
+    }
+    if (display->thread_started) {
+        atomic_store(&display->stopping, true);
+        uint64_t one = 1;
+        if (write(display->wake_fd, &one, sizeof(one)) < 0) {
+            log_error("Unable to stop display thread: %s", strerror(errno));
+        }
+        pthread_join(display->thread, NULL);
+    }
+    if (display->wake_fd >= 0) {
+        close(display->wake_fd);
+    }
+    spsc_ring_destroy(display->ring);
     free(display);
 }
 
@@ -42,28 +289,31 @@ void display_show_variants(Display *display, const char *base, const struct Acce
     if (!display) {
         return;
     }
-    clear_previous(display);
     if (!mapping || mapping->variant_count == 0) {
+        display_clear(display);
+        return;
+    }
+    DisplayRecord *record = reserve(display, DISPLAY_RECORD_VARIANTS);
+    if (!record) {
         return;
     }
 
-    char buffer[512];
+    /* The mapping may belong to a configuration that is freed after a reload, so the
+     * line is formatted here rather than on the display thread. */
     size_t offset = 0;
-    offset += (size_t)snprintf(buffer + offset, sizeof(buffer) - offset, "AccentFlow %s: ", base ? base : "");
-    for (size_t i = 0; i < mapping->variant_count && offset < sizeof(buffer); ++i) {
+    record->text[0] = '\0';
+    bool room = append(record->text, &offset, "AccentFlow ") && append(record->text, &offset, base ? base : "") &&
+                append(record->text, &offset, ": ");
+    for (size_t i = 0; i < mapping->variant_count && room; ++i) {
         const char *variant = mapping->variants[i];
         if (!variant) {
             continue;
         }
-        if (i == active_index) {
-            offset += (size_t)snprintf(buffer + offset, sizeof(buffer) - offset, "[%s]", variant);
-        } else {
-            offset += (size_t)snprintf(buffer + offset, sizeof(buffer) - offset, " %s ", variant);
-        }
+        bool active = i == active_index;
+        room = append(record->text, &offset, active ? "[" : " ") && append(record->text, &offset, variant) &&
+               append(record->text, &offset, active ? "]" : " ");
     }
-
-    fprintf(stderr, "%s", buffer);
-    display->last_columns = strlen(buffer);
+    publish(display);
 }
 
 void display_show_committed(Display *display, const char *text)
@@ -71,13 +321,18 @@ void display_show_committed(Display *display, const char *text)
     if (!display) {
         return;
     }
-    clear_previous(display);
     if (!text) {
+        display_clear(display);
         return;
     }
-    char buffer[256];
-    snprintf(buffer, sizeof(buffer), "AccentFlow committed: %s", text);
-    fprintf(stderr, "%s\n", buffer);
+    DisplayRecord *record = reserve(display, DISPLAY_RECORD_COMMITTED);
+    if (!record) {
+        return;
+    }
+    size_t offset = 0;
+    record->text[0] = '\0';
+    append(record->text, &offset, text);
+    publish(display);
 }
 
 void display_clear(Display *display)
@@ -85,5 +340,7 @@ void display_clear(Display *display)
     if (!display) {
         return;
     }
-    clear_previous(display);
+    if (reserve(display, DISPLAY_RECORD_CLEAR)) {
+        publish(display);
+    }
 }
@@ -0,0 +1,255 @@
+#include "event_loop.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#define EVENT_LOOP_MAX_EVENTS 16
+
+typedef struct EventSource {
+    int fd;
+    EventLoopHandler handler;
+    void *userdata;
+    struct EventSource *next;
+} EventSource;
+
+typedef struct {
+    EventLoopSignalHandler handler;
+    void *userdata;
+} SignalSlot;
+
+struct EventLoop {
+    int epoll_fd;
+    int signal_fd;
+    sigset_t signal_mask;
+    SignalSlot signals[_NSIG];
+    EventSource *sources;
+    EventSource *retired;
+    unsigned int spin_usec;
+    bool running;
+};
+
+EventLoop *event_loop_create(void)
+{
+    EventLoop *loop = calloc(1, sizeof(EventLoop));
+    if (!loop) {
+        return NULL;
+    }
+    loop->signal_fd = -1;
+    sigemptyset(&loop->signal_mask);
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        log_error("Unable to create epoll instance: %s", strerror(errno));
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+static void release_retired(EventLoop *loop)
+{
+    while (loop->retired) {
+        EventSource *source = loop->retired;
+        loop->retired = source->next;
+        free(source);
+    }
+}
+
+void event_loop_destroy(EventLoop *loop)
+{
+    if (!loop) {
+        return;
+    }
+    while (loop->sources) {
+        EventSource *source = loop->sources;
+        loop->sources = source->next;
+        free(source);
+    }
+    release_retired(loop);
+    if (loop->signal_fd >= 0) {
+        close(loop->signal_fd);
+        sigprocmask(SIG_UNBLOCK, &loop->signal_mask, NULL);
+    }
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+int event_loop_add(EventLoop *loop, int fd, uint32_t events, EventLoopHandler handler, void *userdata)
+{
+    if (!loop || fd < 0 || !handler) {
+        return -1;
+    }
+
+    EventSource *source = calloc(1, sizeof(EventSource));
+    if (!source) {
+        return -1;
+    }
+    source->fd = fd;
+    source->handler = handler;
+    source->userdata = userdata;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = source;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        log_error("Unable to watch fd %d: %s", fd, strerror(errno));
+        free(source);
+        return -1;
+    }
+
+    source->next = loop->sources;
+    loop->sources = source;
+    return 0;
+}
+
+int event_loop_remove(EventLoop *loop, int fd)
+{
+    if (!loop) {
+        return -1;
+    }
+    for (EventSource **link = &loop->sources; *link; link = &(*link)->next) {
+        EventSource *source = *link;
+        if (source->fd != fd) {
+            continue;
+        }
+        *link = source->next;
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        /* The source may still be referenced by the batch being dispatched. */
+        source->handler = NULL;
+        source->next = loop->retired;
+        loop->retired = source;
+        return 0;
+    }
+    return -1;
+}
+
+static int dispatch_signals(EventLoop *loop, int fd, uint32_t events, void *userdata)
+{
+    (void)events;
+    (void)userdata;
+
+    while (1) {
+        struct signalfd_siginfo info;
+        ssize_t bytes = read(fd, &info, sizeof(info));
+        if (bytes < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+            log_error("Signal read error: %s", strerror(errno));
+            return -1;
+        }
+        if (bytes != sizeof(info) || info.ssi_signo >= _NSIG) {
+            continue;
+        }
+        SignalSlot *slot = &loop->signals[info.ssi_signo];
+        if (slot->handler && slot->handler(loop, (int)info.ssi_signo, slot->userdata) < 0) {
+            return -1;
+        }
+    }
+}
+
+int event_loop_add_signal(EventLoop *loop, int signo, EventLoopSignalHandler handler, void *userdata)
+{
+    if (!loop || signo <= 0 || signo >= _NSIG || !handler) {
+        return -1;
+    }
+
+    sigset_t mask = loop->signal_mask;
+    sigaddset(&mask, signo);
+    int fd = signalfd(loop->signal_fd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        log_error("Unable to watch signal %d: %s", signo, strerror(errno));
+        return -1;
+    }
+    if (loop->signal_fd < 0) {
+        if (event_loop_add(loop, fd, EPOLLIN, dispatch_signals, NULL) < 0) {
+            close(fd);
+            return -1;
+        }
+        loop->signal_fd = fd;
+    }
+
+    sigset_t single;
+    sigemptyset(&single);
+    sigaddset(&single, signo);
+    sigprocmask(SIG_BLOCK, &single, NULL);
+
+    loop->signal_mask = mask;
+    loop->signals[signo].handler = handler;
+    loop->signals[signo].userdata = userdata;
+    return 0;
+}
+
+void event_loop_set_spin(EventLoop *loop, unsigned int spin_usec)
+{
+    if (loop) {
+        loop->spin_usec = spin_usec;
+    }
+}
+
+static int wait_for_events(EventLoop *loop, struct epoll_event *events, int max_events)
+{
+    if (loop->spin_usec > 0) {
+        uint64_t deadline = monotonic_time_ns() + (uint64_t)loop->spin_usec * 1000u;
+        do {
+            int count = epoll_wait(loop->epoll_fd, events, max_events, 0);
+            if (count != 0) {
+                return count;
+            }
+        } while (monotonic_time_ns() < deadline);
+    }
+    return epoll_wait(loop->epoll_fd, events, max_events, -1);
+}
+
+int event_loop_run(EventLoop *loop)
+{
+    if (!loop) {
+        return -1;
+    }
+
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    int rc = 0;
+    loop->running = true;
+
+    while (loop->running) {
+        int count = wait_for_events(loop, events, EVENT_LOOP_MAX_EVENTS);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("epoll_wait failed: %s", strerror(errno));
+            rc = -1;
+            break;
+        }
+
+        for (int i = 0; i < count && loop->running; ++i) {
+            EventSource *source = events[i].data.ptr;
+            if (!source->handler) {
+                continue;
+            }
+            if (source->handler(loop, source->fd, events[i].events, source->userdata) < 0) {
+                rc = -1;
+                loop->running = false;
+            }
+        }
+        release_retired(loop);
+    }
+
+    loop->running = false;
+    return rc;
+}
+
+void event_loop_stop(EventLoop *loop)
+{
+    if (loop) {
+        loop->running = false;
+    }
+}
@@ -0,0 +1,57 @@
+#include "histogram.h"
+
+#include <string.h>
+
+static unsigned int bucket_of(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned int)value;
+    }
+    unsigned int exponent = 63u - (unsigned int)__builtin_clzll(value);
+    unsigned int shift = exponent - HISTOGRAM_SUB_BITS;
+    return (shift + 1u) * HISTOGRAM_SUB_BUCKETS + (unsigned int)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1u));
+}
+
+static uint64_t bucket_upper_bound(unsigned int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1u;
+    uint64_t lower = (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + ((1ull << shift) - 1u);
+}
+
+void histogram_record(Histogram *histogram, uint64_t value)
+{
+    histogram->buckets[bucket_of(value)]++;
+    histogram->count++;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+void histogram_reset(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+uint64_t histogram_percentile(const Histogram *histogram, double fraction)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(fraction * (double)histogram->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            uint64_t bound = bucket_upper_bound(bucket);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
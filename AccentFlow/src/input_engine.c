@@ -1,294 +1,580 @@
 #include "input_engine.h"
+#include "arena.h"
+#include "compose.h"
 #include "config.h"
 #include "display.h"
+#include "event_loop.h"
+#include "histogram.h"
 #include "mapper.h"
+#include "output_backend.h"
+#include "trace.h"
+#include "unicode_sequence.h"
 #include "utils.h"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/input-event-codes.h>
 #include <linux/input.h>
-#include <linux/uinput.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
-#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
-#define ACCENTFLOW_MAX_BASE 8
+#define ACCENTFLOW_READ_BATCH 64
 
-struct InputEngine {
-    int input_fd;
-    int uinput_fd;
-    bool grab;
-    const struct AccentConfig *config;
-    struct Display *display;
+#define ACCENTFLOW_KEY_WORDS ((KEY_CNT + 63) / 64)
+
+/* Latency from the kernel's event timestamp until the output write returns, by what the
+ * daemon did with the key. */
+enum {
+    LATENCY_PASSTHROUGH, /* forwarded as is */
+    LATENCY_CYCLE,       /* swallowed to show or advance the preview */
+    LATENCY_COMMIT,      /* release of the accent key or end of a compose sequence, typing the result */
+    LATENCY_KIND_COUNT
+};
+
+static const char *const latency_names[LATENCY_KIND_COUNT] = {"passthrough", "cycle", "commit"};
+
+/* What happened to the events of the frame up to the next SYN_REPORT. */
+#define FRAME_FORWARDED 1u
+#define FRAME_CYCLED 2u
+#define FRAME_COMMITTED 4u
+
+/* Accent-mode state is per keyboard so boards can cycle independently. */
+typedef struct InputDevice {
+    struct InputEngine *engine;
+    int fd;  /* -1 for a replay device, fed through input_engine_feed */
+    char *path;
+    uint16_t id;  /* order of opening, written to traces */
+    /* Clock of the event timestamps: CLOCK_MONOTONIC once EVIOCSCLOCKID succeeds. */
+    clockid_t clock;
+    unsigned int frame;
+
+    /* Events drained per read(); a trailing partial event is carried over. */
+    struct input_event read_buffer[ACCENTFLOW_READ_BATCH];
+    size_t read_pending_bytes;
+
+    /* Keys forwarded as pressed, released on uinput if the device goes away. */
+    uint64_t keys_down[ACCENTFLOW_KEY_WORDS];
+
+    /* Shift keys held (bit 0 left, bit 1 right) and Caps Lock, folded into a mapper layer. */
+    unsigned int shift_keys;
+    bool caps_lock;
+    unsigned int layer;
 
     bool accent_mode;
     bool has_active_key;
     uint16_t active_keycode;
     size_t variant_index;
     const struct AccentMapping *active_mapping;
-    char base[ACCENTFLOW_MAX_BASE];
+
+    /* Compose sequence being typed after the Compose key: a state of config->compose. */
+    bool composing;
+    uint32_t compose_state;
+    /* Keys whose press went to a compose sequence; their repeats and release are dropped too. */
+    uint64_t keys_consumed[ACCENTFLOW_KEY_WORDS];
+} InputDevice;
+
+struct InputEngine {
+    OutputBackend *backend;
+    bool grab;
+    /* Only the engine thread reads this; other threads go through published/active. */
+    const struct AccentConfig *config;
+    /* Profile to switch to, taken up by adopt_published_config like a reload. */
+    const struct AccentConfig *requested;
+    struct Display *display;
+    EventLoop *loop;
+    /* Key sequences for compose results, built when one is typed rather than for the whole table. */
+    Arena *scratch;
+
+    /* Configuration handoff (see input_engine_publish_config). The engine adopts the
+     * published configuration at a batch boundary and mirrors it into active. */
+    _Atomic(const struct AccentConfig *) published;
+    _Atomic(const struct AccentConfig *) active;
+    int publish_fd;  /* wakes an idle loop so it adopts without waiting for input */
+    int switch_fd;   /* signalled after every adoption */
+
+    InputDevice **devices;
+    size_t device_count;
+    size_t device_capacity;
+    bool hotplug;
+    uint16_t next_device_id;
+    TraceWriter *trace;
+
+    Histogram latency[LATENCY_KIND_COUNT];
 };
 
-static int emit_event(int fd, uint16_t type, uint16_t code, int32_t value)
+static void record_latency(InputEngine *engine, const InputDevice *device, const struct input_event *event, int kind)
 {
-    struct input_event event;
-    memset(&event, 0, sizeof(event));
-    gettimeofday(&event.time, NULL);
-    event.type = type;
-    event.code = code;
-    event.value = value;
-    if (write(fd, &event, sizeof(event)) < 0) {
-        return -1;
+    if (device->fd < 0) {
+        return;  /* replayed timestamps are not from this clock */
+    }
+    struct timespec now;
+    clock_gettime(device->clock, &now);
+    int64_t ns = ((int64_t)now.tv_sec - (int64_t)event->input_event_sec) * 1000000000 +
+                 ((int64_t)now.tv_nsec - (int64_t)event->input_event_usec * 1000);
+    if (ns >= 0) {
+        histogram_record(&engine->latency[kind], (uint64_t)ns);
     }
-    return 0;
 }
 
-static int emit_syn(int fd)
+static int forward_event(InputEngine *engine, InputDevice *device, const struct input_event *event)
 {
-    return emit_event(fd, EV_SYN, SYN_REPORT, 0);
+    if (event->type == EV_KEY && event->code < KEY_CNT) {
+        uint64_t bit = 1ull << (event->code % 64);
+        if (event->value == 0) {
+            device->keys_down[event->code / 64] &= ~bit;
+        } else {
+            device->keys_down[event->code / 64] |= bit;
+        }
+    }
+
+    int rc = output_backend_forward(engine->backend, event);
+    if (event->type != EV_SYN || event->code != SYN_REPORT) {
+        device->frame |= FRAME_FORWARDED;
+        return rc;
+    }
+    /* The frame is written out at its SYN_REPORT. Commits were timed when they were typed. */
+    unsigned int frame = device->frame;
+    device->frame = 0;
+    if (rc == 0 && !(frame & FRAME_COMMITTED)) {
+        if (frame & FRAME_CYCLED) {
+            record_latency(engine, device, event, LATENCY_CYCLE);
+        } else if (frame & FRAME_FORWARDED) {
+            record_latency(engine, device, event, LATENCY_PASSTHROUGH);
+        }
+    }
+    return rc;
 }
 
-static int send_key(int fd, uint16_t code, int value)
+static bool key_is_down(const InputDevice *device, uint16_t code)
 {
-    if (emit_event(fd, EV_KEY, code, value) < 0) {
-        return -1;
+    return (device->keys_down[code / 64] >> (code % 64)) & 1u;
+}
+
+/* Every Ctrl and Shift key the user holds, for the backend to lift around a commit.
+ * keys_down keeps tracking the physical keys. */
+static void held_modifiers(const InputDevice *device, OutputModifiers *held)
+{
+    static const uint16_t modifiers[] = {KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTSHIFT, KEY_RIGHTSHIFT};
+    held->count = 0;
+    for (size_t i = 0; i < sizeof(modifiers) / sizeof(modifiers[0]); ++i) {
+        if (key_is_down(device, modifiers[i])) {
+            held->keys[held->count++] = modifiers[i];
+        }
     }
-    if (emit_syn(fd) < 0) {
-        return -1;
+}
+
+static void reset_state(InputEngine *engine, InputDevice *device)
+{
+    device->has_active_key = false;
+    device->active_keycode = 0;
+    device->variant_index = 0;
+    device->active_mapping = NULL;
+    if (engine->display) {
+        display_clear(engine->display);
     }
-    return 0;
 }
 
-static uint16_t hex_char_to_keycode(char c)
+static void handle_accent_key(InputEngine *engine, InputDevice *device, const struct input_event *event)
 {
-    if (c >= '0' && c <= '9') {
-        return KEY_0 + (c - '0');
+    if (event->value == 1) {
+        device->accent_mode = true;
+        reset_state(engine, device);
+        log_info("Accent mode engaged");
+    } else if (event->value == 0 && device->accent_mode) {
+        device->accent_mode = false;
+        const struct AccentMapping *mapping = device->active_mapping;
+        if (mapping && mapping->variant_count > 0) {
+            size_t index = device->variant_index % mapping->variant_count;
+            const char *variant = mapper_select_variant(mapping, index);
+            OutputModifiers held;
+            held_modifiers(device, &held);
+            if (output_backend_commit(engine->backend, variant, &mapping->sequences[index], &held) == 0) {
+                record_latency(engine, device, event, LATENCY_COMMIT);
+                device->frame |= FRAME_COMMITTED;
+                if (engine->display) {
+                    display_show_committed(engine->display, variant);
+                }
+                log_info("Committed variant '%s'", variant);
+            }
+        }
+        reset_state(engine, device);
+        log_info("Accent mode released");
     }
-    if (c >= 'a' && c <= 'f') {
-        return KEY_A + (c - 'a');
+}
+
+static void update_preview(InputEngine *engine, InputDevice *device)
+{
+    if (!engine->display || !device->active_mapping) {
+        return;
     }
-    if (c >= 'A' && c <= 'F') {
-        return KEY_A + (c - 'A');
+    device->frame |= FRAME_CYCLED;
+    size_t index = device->active_mapping->variant_count > 0 ? device->variant_index % device->active_mapping->variant_count : 0;
+    display_show_variants(engine->display, device->active_mapping->base, device->active_mapping, index);
+}
+
+static void commit_composed(InputEngine *engine, InputDevice *device, const struct input_event *event, const char *text)
+{
+    AccentSequence sequence;
+    char reason[128];
+    arena_reset(engine->scratch);
+    if (!unicode_sequence_build(text, engine->config->unicode_keys, &sequence, engine->scratch, reason, sizeof(reason))) {
+        log_error("Unable to type composed '%s': %s", text, reason);
+        return;
+    }
+    OutputModifiers held;
+    held_modifiers(device, &held);
+    if (output_backend_commit(engine->backend, text, &sequence, &held) == 0) {
+        record_latency(engine, device, event, LATENCY_COMMIT);
+        device->frame |= FRAME_COMMITTED;
+        if (engine->display) {
+            display_show_committed(engine->display, text);
+        }
+        log_info("Composed '%s'", text);
     }
-    return 0;
 }
 
-static bool utf8_to_codepoint(const char *utf8, uint32_t *codepoint)
+/* The Compose key starts a sequence; each key that types a character then takes one step
+ * through the trie. Other keys (modifiers, arrows) pass through, and Escape cancels. */
+static bool handle_compose(InputEngine *engine, InputDevice *device, const struct input_event *event)
 {
-    if (!utf8 || !codepoint) {
+    uint16_t code = event->code;
+    if (code >= KEY_CNT) {
         return false;
     }
-    const unsigned char *s = (const unsigned char *)utf8;
-    if (s[0] < 0x80) {
-        *codepoint = s[0];
-        return true;
-    }
-    if ((s[0] & 0xE0) == 0xC0) {
-        if ((s[1] & 0xC0) != 0x80) {
+    uint64_t bit = 1ull << (code % 64);
+    if (event->value != 1) {
+        if (!(device->keys_consumed[code / 64] & bit)) {
             return false;
         }
-        *codepoint = ((uint32_t)(s[0] & 0x1F) << 6) | (uint32_t)(s[1] & 0x3F);
+        if (event->value == 0) {
+            device->keys_consumed[code / 64] &= ~bit;
+        }
         return true;
     }
-    if ((s[0] & 0xF0) == 0xE0) {
-        if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80) {
-            return false;
-        }
-        *codepoint = ((uint32_t)(s[0] & 0x0F) << 12) | ((uint32_t)(s[1] & 0x3F) << 6) | (uint32_t)(s[2] & 0x3F);
+
+    const ComposeTable *table = engine->config->compose;
+    if (code == KEY_COMPOSE && table) {
+        device->keys_consumed[code / 64] |= bit;
+        device->composing = true;
+        device->compose_state = COMPOSE_START;
         return true;
     }
-    if ((s[0] & 0xF8) == 0xF0) {
-        if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80) {
-            return false;
-        }
-        *codepoint = ((uint32_t)(s[0] & 0x07) << 18) |
-                     ((uint32_t)(s[1] & 0x3F) << 12) |
-                     ((uint32_t)(s[2] & 0x3F) << 6) |
-                     (uint32_t)(s[3] & 0x3F);
+    if (!device->composing) {
+        return false;
+    }
+    uint32_t character = mapper_character_from_keycode(engine->config, code, device->layer);
+    if (!character && code != KEY_ESC) {
+        return false;
+    }
+
+    device->keys_consumed[code / 64] |= bit;
+    uint32_t state = compose_step(table, device->compose_state, character);
+    const char *result = state != COMPOSE_NONE ? compose_result(table, state) : NULL;
+    if (state != COMPOSE_NONE && !result) {
+        device->compose_state = state;
         return true;
     }
-    return false;
+    device->composing = false;
+    if (result) {
+        commit_composed(engine, device, event, result);
+    } else if (code != KEY_ESC) {
+        log_info("No compose sequence continues with U+%04X", character);
+    }
+    return true;
 }
 
-static int send_unicode(InputEngine *engine, const char *utf8)
+/* Alt_R+Tab selects the next profile, Alt_R+Shift+Tab the previous one. */
+static bool handle_profile_key(InputEngine *engine, InputDevice *device, const struct input_event *event)
 {
-    uint32_t codepoint = 0;
-    if (!utf8_to_codepoint(utf8, &codepoint)) {
-        log_error("Unable to convert '%s' to a Unicode codepoint", utf8);
-        return -1;
+    const struct AccentConfig *config = engine->requested;
+    if (!device->accent_mode || event->code != KEY_TAB || config->profile_count < 2) {
+        return false;
     }
+    if (event->value == 1) {
+        size_t step = device->shift_keys ? config->profile_count - 1 : 1;
+        engine->requested = config->profiles[(config->profile_index + step) % config->profile_count];
+        log_info("Switching to profile '%s'", engine->requested->profile_name);
+        device->keys_consumed[KEY_TAB / 64] |= 1ull << (KEY_TAB % 64);
+    }
+    return true;
+}
 
-    char hex[9];
-    snprintf(hex, sizeof(hex), "%x", codepoint);
-
-    if (send_key(engine->uinput_fd, KEY_LEFTCTRL, 1) < 0 ||
-        send_key(engine->uinput_fd, KEY_LEFTSHIFT, 1) < 0 ||
-        send_key(engine->uinput_fd, KEY_U, 1) < 0 ||
-        send_key(engine->uinput_fd, KEY_U, 0) < 0) {
-        return -1;
+static bool handle_accentable_key(InputEngine *engine, InputDevice *device, const struct input_event *event)
+{
+    if (!device->accent_mode) {
+        return false;
     }
-    if (send_key(engine->uinput_fd, KEY_LEFTCTRL, 0) < 0 ||
-        send_key(engine->uinput_fd, KEY_LEFTSHIFT, 0) < 0) {
-        return -1;
+    if (event->value != 1 && event->value != 2) {
+        if (device->has_active_key && event->code == device->active_keycode) {
+            return true;
+        }
+        return false;
     }
 
-    for (size_t i = 0; hex[i] != '\0'; ++i) {
-        uint16_t keycode = hex_char_to_keycode(hex[i]);
-        if (!keycode) {
-            log_error("Unsupported hex digit '%c' in Unicode sequence", hex[i]);
-            return -1;
-        }
-        if (send_key(engine->uinput_fd, keycode, 1) < 0 ||
-            send_key(engine->uinput_fd, keycode, 0) < 0) {
-            return -1;
-        }
+    const struct AccentMapping *mapping = mapper_from_keycode(engine->config, event->code, device->layer);
+    if (!mapping) {
+        return false;
     }
 
-    if (send_key(engine->uinput_fd, KEY_ENTER, 1) < 0 ||
-        send_key(engine->uinput_fd, KEY_ENTER, 0) < 0) {
-        return -1;
+    if (!device->has_active_key || device->active_keycode != event->code) {
+        device->has_active_key = true;
+        device->active_keycode = event->code;
+        device->active_mapping = mapping;
+        device->variant_index = 0;
+    } else {
+        device->variant_index++;
     }
 
-    return 0;
+    update_preview(engine, device);
+    return true;
 }
 
-static int forward_event(InputEngine *engine, const struct input_event *event)
+static void track_modifiers(InputEngine *engine, InputDevice *device, const struct input_event *event)
 {
-    if (write(engine->uinput_fd, event, sizeof(*event)) < 0) {
-        return -1;
+    switch (event->code) {
+    case KEY_LEFTSHIFT:
+    case KEY_RIGHTSHIFT: {
+        unsigned int bit = event->code == KEY_LEFTSHIFT ? 1u : 2u;
+        device->shift_keys = event->value ? (device->shift_keys | bit) : (device->shift_keys & ~bit);
+        break;
+    }
+    case KEY_CAPSLOCK:
+        if (event->value == 1) {
+            device->caps_lock = !device->caps_lock;
+        }
+        break;
+    default:
+        return;
     }
-    return 0;
-}
 
-static bool setup_uinput_device(InputEngine *engine)
-{
-    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (fd < 0) {
-        log_error("Unable to open /dev/uinput: %s", strerror(errno));
-        return false;
+    unsigned int layer = (device->shift_keys ? MAPPER_LAYER_SHIFT : 0u) | (device->caps_lock ? MAPPER_LAYER_CAPS : 0u);
+    if (layer == device->layer) {
+        return;
     }
+    device->layer = layer;
 
-    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0 ||
-        ioctl(fd, UI_SET_EVBIT, EV_SYN) < 0) {
-        log_error("Failed to configure uinput events: %s", strerror(errno));
-        close(fd);
-        return false;
+    /* Shift changed mid-cycle: keep the position, switch to the other case's variants. */
+    if (device->accent_mode && device->has_active_key) {
+        const struct AccentMapping *mapping = mapper_from_keycode(engine->config, device->active_keycode, layer);
+        if (mapping && mapping != device->active_mapping) {
+            device->active_mapping = mapping;
+            update_preview(engine, device);
+        }
     }
+}
 
-    for (int key = KEY_ESC; key <= KEY_MICMUTE; ++key) {
-        ioctl(fd, UI_SET_KEYBIT, key);
+static int process_event(InputEngine *engine, InputDevice *device, const struct input_event *event)
+{
+    if (event->type == EV_KEY) {
+        track_modifiers(engine, device, event);
+        if (handle_compose(engine, device, event)) {
+            return 0;
+        }
     }
 
-    struct uinput_setup setup;
-    memset(&setup, 0, sizeof(setup));
-    snprintf(setup.name, sizeof(setup.name), "AccentFlow Virtual Keyboard");
-    setup.id.bustype = BUS_USB;
-    setup.id.vendor = 0x1fed;
-    setup.id.product = 0x0001;
-    setup.id.version = 1;
+    if (event->type == EV_KEY && event->code == KEY_RIGHTALT) {
+        handle_accent_key(engine, device, event);
+        return 0;
+    }
 
-    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0) {
-        log_error("Failed to setup uinput device: %s", strerror(errno));
-        close(fd);
-        return false;
+    if (event->type == EV_KEY) {
+        if (handle_profile_key(engine, device, event) || handle_accentable_key(engine, device, event)) {
+            return 0;
+        }
     }
-    if (ioctl(fd, UI_DEV_CREATE) < 0) {
-        log_error("Failed to create uinput device: %s", strerror(errno));
-        close(fd);
-        return false;
+
+    if (!device->accent_mode || !device->has_active_key || event->code != device->active_keycode) {
+        if (forward_event(engine, device, event) < 0) {
+            return -1;
+        }
     }
 
-    engine->uinput_fd = fd;
-    return true;
+    return 0;
 }
 
-static void reset_state(InputEngine *engine)
+static int process_events(InputEngine *engine, InputDevice *device, const struct input_event *events, size_t count)
 {
-    engine->has_active_key = false;
-    engine->active_keycode = 0;
-    engine->variant_index = 0;
-    engine->active_mapping = NULL;
-    engine->base[0] = '\0';
-    if (engine->display) {
-        display_clear(engine->display);
+    for (size_t i = 0; i < count; ++i) {
+        if (process_event(engine, device, &events[i]) < 0) {
+            return -1;
+        }
     }
+    return 0;
 }
 
-static void handle_accent_key(InputEngine *engine, const struct input_event *event)
+static void release_held_keys(InputEngine *engine, InputDevice *device)
 {
-    if (event->value == 1) {
-        engine->accent_mode = true;
-        reset_state(engine);
-        log_info("Accent mode engaged");
-    } else if (event->value == 0 && engine->accent_mode) {
-        engine->accent_mode = false;
-        if (engine->active_mapping) {
-            const char *variant = mapper_select_variant(engine->active_mapping, engine->variant_index);
-            if (variant) {
-                if (send_unicode(engine, variant) == 0) {
-                    if (engine->display) {
-                        display_show_committed(engine->display, variant);
-                    }
-                    log_info("Committed variant '%s'", variant);
-                }
-            }
+    bool released = false;
+    for (size_t word = 0; word < ACCENTFLOW_KEY_WORDS; ++word) {
+        while (device->keys_down[word]) {
+            int bit = __builtin_ctzll(device->keys_down[word]);
+            device->keys_down[word] &= device->keys_down[word] - 1;
+            struct input_event release;
+            memset(&release, 0, sizeof(release));
+            release.type = EV_KEY;
+            release.code = (uint16_t)(word * 64 + (size_t)bit);
+            output_backend_forward(engine->backend, &release);
+            released = true;
         }
-        reset_state(engine);
-        log_info("Accent mode released");
+    }
+    if (released) {
+        struct input_event syn;
+        memset(&syn, 0, sizeof(syn));
+        syn.type = EV_SYN;
+        syn.code = SYN_REPORT;
+        output_backend_forward(engine->backend, &syn);
     }
 }
 
-static void update_preview(InputEngine *engine)
+static void close_device(InputEngine *engine, InputDevice *device)
 {
-    if (!engine->display || !engine->active_mapping) {
-        return;
+    release_held_keys(engine, device);
+    if (device->accent_mode && engine->display) {
+        display_clear(engine->display);
+    }
+    if (device->fd >= 0) {
+        event_loop_remove(engine->loop, device->fd);
+        if (engine->grab) {
+            ioctl(device->fd, EVIOCGRAB, 0);
+        }
+        close(device->fd);
     }
-    size_t index = engine->active_mapping->variant_count > 0 ? engine->variant_index % engine->active_mapping->variant_count : 0;
-    display_show_variants(engine->display, engine->base, engine->active_mapping, index);
+    free(device->path);
+    free(device);
 }
 
-static bool handle_accentable_key(InputEngine *engine, const struct input_event *event)
+static void detach_device(InputEngine *engine, InputDevice *device)
 {
-    if (!engine->accent_mode) {
-        return false;
+    for (size_t i = 0; i < engine->device_count; ++i) {
+        if (engine->devices[i] == device) {
+            engine->devices[i] = engine->devices[--engine->device_count];
+            break;
+        }
     }
-    if (event->value != 1 && event->value != 2) {
-        if (engine->has_active_key && event->code == engine->active_keycode) {
+    log_info("Input device %s detached", device->path);
+    close_device(engine, device);
+}
+
+static bool config_in_use(const InputEngine *engine)
+{
+    for (size_t i = 0; i < engine->device_count; ++i) {
+        if (engine->devices[i]->active_mapping || engine->devices[i]->composing) {
             return true;
         }
-        return false;
     }
+    return false;
+}
 
-    char base[ACCENTFLOW_MAX_BASE] = {0};
-    const struct AccentMapping *mapping = mapper_from_keycode(engine->config, event->code, base);
-    if (!mapping) {
-        return false;
+/* The profile to use after a reload: the same one as before, unless the file now names
+ * another startup profile. */
+static const struct AccentConfig *reloaded_profile(const struct AccentConfig *current, const struct AccentConfig *next)
+{
+    const char *before = current->root->startup_profile;
+    const char *after = next->startup_profile;
+    bool changed = (before == NULL) != (after == NULL) || (before && strcmp(before, after) != 0);
+    const struct AccentConfig *profile = config_find_profile(next, changed ? after : current->profile_name);
+    return profile ? profile : next;
+}
+
+/* The grace period of the handoff: an accent cycle keeps its mapping until the key is
+ * released and a compose sequence its trie state until it ends, so the switch waits until
+ * no keyboard holds a pointer into the old config. Profile switches wait the same way and
+ * are applied together with a pending reload. */
+static void adopt_published_config(InputEngine *engine)
+{
+    const struct AccentConfig *next = atomic_load_explicit(&engine->published, memory_order_acquire);
+    const struct AccentConfig *profile = engine->requested;
+    bool reloaded = next != engine->config->root;
+    if ((!reloaded && profile == engine->config) || config_in_use(engine)) {
+        return;
+    }
+    engine->config = next == profile->root ? profile : reloaded_profile(profile, next);
+    engine->requested = engine->config;
+    if (!reloaded) {
+        return;
     }
+    atomic_store_explicit(&engine->active, next, memory_order_release);
+    uint64_t one = 1;
+    if (write(engine->switch_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Unable to signal configuration switch: %s", strerror(errno));
+    }
+}
 
-    if (!engine->has_active_key || engine->active_keycode != event->code) {
-        engine->has_active_key = true;
-        engine->active_keycode = event->code;
-        engine->active_mapping = mapping;
-        snprintf(engine->base, sizeof(engine->base), "%s", base);
-        engine->variant_index = 0;
-    } else {
-        engine->variant_index++;
+static int handle_config_published(EventLoop *loop, int fd, uint32_t events, void *userdata)
+{
+    (void)loop;
+    (void)events;
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        log_error("Unable to read configuration notification: %s", strerror(errno));
     }
+    adopt_published_config(userdata);
+    return 0;
+}
 
-    update_preview(engine);
-    return true;
+static int handle_input_ready(EventLoop *loop, int fd, uint32_t events, void *userdata)
+{
+    (void)loop;
+    (void)events;
+    InputDevice *device = userdata;
+    InputEngine *engine = device->engine;
+    char *buffer = (char *)device->read_buffer;
+
+    while (1) {
+        size_t space = sizeof(device->read_buffer) - device->read_pending_bytes;
+        ssize_t bytes = read(fd, buffer + device->read_pending_bytes, space);
+        if (bytes < 0) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                return 0;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Read error on %s: %s", device->path, strerror(errno));
+            bytes = 0;
+        }
+        if (bytes == 0) {
+            detach_device(engine, device);
+            if (engine->device_count == 0 && !engine->hotplug) {
+                log_error("No input devices left");
+                return -1;
+            }
+            return 0;
+        }
+
+        size_t available = device->read_pending_bytes + (size_t)bytes;
+        size_t count = available / sizeof(struct input_event);
+        device->read_pending_bytes = available % sizeof(struct input_event);
+
+        trace_writer_append(engine->trace, device->id, device->read_buffer, count);
+        if (process_events(engine, device, device->read_buffer, count) < 0) {
+            return -1;
+        }
+        adopt_published_config(engine);
+        if (device->read_pending_bytes > 0) {
+            memmove(buffer, buffer + count * sizeof(struct input_event), device->read_pending_bytes);
+        }
+
+        /* A short read means the kernel queue is drained; epoll reports new data. */
+        if ((size_t)bytes < space) {
+            return 0;
+        }
+    }
 }
 
-InputEngine *input_engine_create(const char *device_path, const struct AccentConfig *config, struct Display *display, bool grab_device)
+InputEngine *input_engine_create(const struct AccentConfig *config, struct Display *display, OutputBackend *backend, bool grab_devices)
 {
-    if (!device_path) {
-        log_error("No input device specified");
+    if (!backend) {
+        log_error("No output backend specified");
         return NULL;
     }
 
@@ -297,79 +583,207 @@ InputEngine *input_engine_create(const char *device_path, const struct AccentCon
         return NULL;
     }
 
-    engine->input_fd = -1;
-    engine->uinput_fd = -1;
-    engine->config = config;
+    engine->backend = backend;
+    engine->config = config_find_profile(config, config->startup_profile);
+    if (!engine->config) {
+        engine->config = config;
+    }
+    engine->requested = engine->config;
     engine->display = display;
-    engine->grab = grab_device;
-
-    engine->input_fd = open(device_path, O_RDONLY | O_NONBLOCK);
-    if (engine->input_fd < 0) {
-        log_error("Unable to open %s: %s", device_path, strerror(errno));
-        free(engine);
+    engine->grab = grab_devices;
+    atomic_init(&engine->published, config);
+    atomic_init(&engine->active, config);
+    engine->switch_fd = -1;
+
+    engine->loop = event_loop_create();
+    engine->scratch = arena_create(4096);
+    engine->publish_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (engine->publish_fd >= 0) {
+        engine->switch_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    if (!engine->loop || !engine->scratch || engine->switch_fd < 0 ||
+        event_loop_add(engine->loop, engine->publish_fd, EPOLLIN, handle_config_published, engine) < 0) {
+        if (engine->publish_fd < 0 || engine->switch_fd < 0) {
+            log_error("Unable to create configuration eventfd: %s", strerror(errno));
+        }
+        input_engine_destroy(engine);
         return NULL;
     }
+    return engine;
+}
 
-    if (grab_device) {
-        if (ioctl(engine->input_fd, EVIOCGRAB, 1) < 0) {
-            log_error("Failed to grab input device %s: %s", device_path, strerror(errno));
-            close(engine->input_fd);
-            free(engine);
+/* Allocates a device and room for it in engine->devices; the caller appends it. */
+static InputDevice *new_device(InputEngine *engine, const char *path)
+{
+    if (engine->device_count == engine->device_capacity) {
+        size_t capacity = engine->device_capacity ? engine->device_capacity * 2 : 4;
+        InputDevice **devices = realloc(engine->devices, capacity * sizeof(InputDevice *));
+        if (!devices) {
             return NULL;
         }
+        engine->devices = devices;
+        engine->device_capacity = capacity;
     }
 
-    if (!setup_uinput_device(engine)) {
-        if (grab_device) {
-            ioctl(engine->input_fd, EVIOCGRAB, 0);
-        }
-        close(engine->input_fd);
-        free(engine);
+    InputDevice *device = calloc(1, sizeof(InputDevice));
+    if (!device) {
+        return NULL;
+    }
+    device->engine = engine;
+    device->fd = -1;
+    device->id = engine->next_device_id;
+    device->path = duplicate_string(path);
+    if (!device->path) {
+        free(device);
         return NULL;
     }
+    return device;
+}
+
+int input_engine_add_device(InputEngine *engine, const char *device_path)
+{
+    if (!engine || !device_path) {
+        log_error("No input device specified");
+        return -1;
+    }
+
+    InputDevice *device = new_device(engine, device_path);
+    if (!device) {
+        return -1;
+    }
+    device->fd = open(device_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (device->fd < 0) {
+        log_error("Unable to open %s: %s", device_path, strerror(errno));
+        free(device->path);
+        free(device);
+        return -1;
+    }
+
+    if (engine->grab && ioctl(device->fd, EVIOCGRAB, 1) < 0) {
+        log_error("Failed to grab input device %s: %s", device_path, strerror(errno));
+        close(device->fd);
+        free(device->path);
+        free(device);
+        return -1;
+    }
+
+    /* Event timestamps on the clock latency is measured with. Devices that cannot switch
+     * (a FIFO in tests) keep the evdev default, CLOCK_REALTIME. */
+    int clock = CLOCK_MONOTONIC;
+    device->clock = ioctl(device->fd, EVIOCSCLOCKID, &clock) == 0 ? CLOCK_MONOTONIC : CLOCK_REALTIME;
+
+    uint64_t leds = 0;
+    if (ioctl(device->fd, EVIOCGLED(sizeof(leds)), &leds) >= 0) {
+        device->caps_lock = (leds >> LED_CAPSL) & 1u;
+        device->layer = device->caps_lock ? MAPPER_LAYER_CAPS : 0u;
+    }
+
+    if (event_loop_add(engine->loop, device->fd, EPOLLIN, handle_input_ready, device) < 0) {
+        if (engine->grab) {
+            ioctl(device->fd, EVIOCGRAB, 0);
+        }
+        close(device->fd);
+        free(device->path);
+        free(device);
+        return -1;
+    }
 
+    engine->devices[engine->device_count++] = device;
+    engine->next_device_id++;
     log_info("AccentFlow listening on %s", device_path);
-    return engine;
+    return 0;
 }
 
-void input_engine_destroy(InputEngine *engine)
+int input_engine_add_replay_device(InputEngine *engine, const char *name)
 {
-    if (!engine) {
-        return;
+    if (!engine || !name) {
+        return -1;
     }
-    if (engine->grab && engine->input_fd >= 0) {
-        ioctl(engine->input_fd, EVIOCGRAB, 0);
+    InputDevice *device = new_device(engine, name);
+    if (!device) {
+        return -1;
     }
-    if (engine->input_fd >= 0) {
-        close(engine->input_fd);
+    device->clock = CLOCK_MONOTONIC;
+    engine->devices[engine->device_count++] = device;
+    engine->next_device_id++;
+    return (int)engine->device_count - 1;
+}
+
+int input_engine_feed(InputEngine *engine, size_t device_index, const struct input_event *events, size_t count)
+{
+    if (!engine || device_index >= engine->device_count || engine->devices[device_index]->fd >= 0) {
+        return -1;
     }
-    if (engine->uinput_fd >= 0) {
-        ioctl(engine->uinput_fd, UI_DEV_DESTROY);
-        close(engine->uinput_fd);
+    if (process_events(engine, engine->devices[device_index], events, count) < 0) {
+        return -1;
     }
-    free(engine);
+    adopt_published_config(engine);
+    return 0;
 }
 
-static int process_event(InputEngine *engine, const struct input_event *event)
+void input_engine_set_trace(InputEngine *engine, struct TraceWriter *trace)
 {
-    if (event->type == EV_KEY && event->code == KEY_RIGHTALT) {
-        handle_accent_key(engine, event);
-        return 0;
+    if (engine) {
+        engine->trace = trace;
     }
+}
 
-    if (event->type == EV_KEY) {
-        if (handle_accentable_key(engine, event)) {
-            return 0;
+static InputDevice *find_device(const InputEngine *engine, const char *device_path)
+{
+    for (size_t i = 0; i < engine->device_count; ++i) {
+        if (strcmp(engine->devices[i]->path, device_path) == 0) {
+            return engine->devices[i];
         }
     }
+    return NULL;
+}
 
-    if (!engine->accent_mode || !engine->has_active_key || event->code != engine->active_keycode) {
-        if (forward_event(engine, event) < 0) {
-            return -1;
-        }
+bool input_engine_has_device(const InputEngine *engine, const char *device_path)
+{
+    return engine && device_path && find_device(engine, device_path) != NULL;
+}
+
+void input_engine_remove_device(InputEngine *engine, const char *device_path)
+{
+    if (!engine || !device_path) {
+        return;
+    }
+    InputDevice *device = find_device(engine, device_path);
+    if (device) {
+        detach_device(engine, device);
+    }
+}
+
+size_t input_engine_device_count(const InputEngine *engine)
+{
+    return engine ? engine->device_count : 0;
+}
+
+void input_engine_set_hotplug(InputEngine *engine, bool enabled)
+{
+    if (engine) {
+        engine->hotplug = enabled;
     }
+}
 
-    return 0;
+void input_engine_destroy(InputEngine *engine)
+{
+    if (!engine) {
+        return;
+    }
+    for (size_t i = 0; i < engine->device_count; ++i) {
+        close_device(engine, engine->devices[i]);
+    }
+    free(engine->devices);
+    event_loop_destroy(engine->loop);
+    arena_destroy(engine->scratch);
+    if (engine->publish_fd >= 0) {
+        close(engine->publish_fd);
+    }
+    if (engine->switch_fd >= 0) {
+        close(engine->switch_fd);
+    }
+    free(engine);
 }
 
 int input_engine_run(InputEngine *engine)
@@ -377,26 +791,69 @@ int input_engine_run(InputEngine *engine)
     if (!engine) {
         return -1;
     }
+    return event_loop_run(engine->loop);
+}
 
-    while (1) {
-        struct input_event event;
-        ssize_t bytes = read(engine->input_fd, &event, sizeof(event));
-        if (bytes < 0) {
-            if (errno == EWOULDBLOCK || errno == EAGAIN) {
-                usleep(1000);
-                continue;
-            }
-            log_error("Read error: %s", strerror(errno));
-            return -1;
-        }
-        if (bytes != sizeof(event)) {
-            continue;
-        }
+EventLoop *input_engine_get_loop(InputEngine *engine)
+{
+    return engine ? engine->loop : NULL;
+}
 
-        if (process_event(engine, &event) < 0) {
-            return -1;
-        }
+void input_engine_publish_config(InputEngine *engine, const struct AccentConfig *config)
+{
+    atomic_store_explicit(&engine->published, config, memory_order_release);
+    uint64_t one = 1;
+    if (write(engine->publish_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_error("Unable to wake the input engine: %s", strerror(errno));
     }
+}
 
-    return 0;
+const struct AccentConfig *input_engine_active_config(InputEngine *engine)
+{
+    return engine ? atomic_load_explicit(&engine->active, memory_order_acquire) : NULL;
+}
+
+int input_engine_config_switch_fd(const InputEngine *engine)
+{
+    return engine ? engine->switch_fd : -1;
+}
+
+const char *input_engine_select_profile(InputEngine *engine, const char *name)
+{
+    const struct AccentConfig *profile = engine ? config_find_profile(engine->requested->root, name) : NULL;
+    if (!profile) {
+        return NULL;
+    }
+    engine->requested = profile;
+    adopt_published_config(engine);
+    return profile->profile_name;
+}
+
+const char *input_engine_next_profile(InputEngine *engine)
+{
+    const struct AccentConfig *config = engine ? engine->requested : NULL;
+    if (!config || config->profile_count < 2) {
+        return NULL;
+    }
+    engine->requested = config->profiles[(config->profile_index + 1) % config->profile_count];
+    adopt_published_config(engine);
+    return engine->requested->profile_name;
+}
+
+void input_engine_log_latency(const InputEngine *engine)
+{
+    if (!engine) {
+        return;
+    }
+    for (int kind = 0; kind < LATENCY_KIND_COUNT; ++kind) {
+        const Histogram *histogram = &engine->latency[kind];
+        if (histogram->count == 0) {
+            log_info("Latency %-11s no events", latency_names[kind]);
+            continue;
+        }
+        log_info("Latency %-11s %llu events, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us",
+                 latency_names[kind], (unsigned long long)histogram->count,
+                 (double)histogram_percentile(histogram, 0.5) / 1e3, (double)histogram_percentile(histogram, 0.99) / 1e3,
+                 (double)histogram_percentile(histogram, 0.999) / 1e3, (double)histogram->max / 1e3);
+    }
 }
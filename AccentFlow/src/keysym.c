@@ -0,0 +1,141 @@
+#include "keysym.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYSYM_REPORTED_MAX 64 /* distinct unknown names logged; later ones are not */
+#define KEYSYM_NAME_MAX 64
+
+typedef struct {
+    const char *name;
+    uint32_t codepoint;
+} KeysymName;
+
+/* Every keysym name of keysymdef.h with the character it types, 0 for none. */
+#include "keysym_names.h"
+
+/* Dead keys type nothing themselves; they resolve to their spacing accent so they can
+ * still serve as bases. Sorted bytewise. */
+static const KeysymName dead_keys[] = {
+    {"dead_abovedot", 0x02d9}, {"dead_abovering", 0x02da}, {"dead_acute", 0x00b4}, {"dead_belowdot", 0x0323},
+    {"dead_breve", 0x02d8}, {"dead_caron", 0x02c7}, {"dead_cedilla", 0x00b8}, {"dead_circumflex", 0x005e},
+    {"dead_diaeresis", 0x00a8}, {"dead_doubleacute", 0x02dd}, {"dead_grave", 0x0060}, {"dead_hook", 0x0309},
+    {"dead_horn", 0x031b}, {"dead_iota", 0x037a}, {"dead_macron", 0x00af}, {"dead_ogonek", 0x02db},
+    {"dead_stroke", 0x0335}, {"dead_tilde", 0x007e},
+};
+
+typedef struct {
+    const char *name;
+    size_t length;
+} KeysymKey;
+
+static int compare_keysym(const void *key, const void *element)
+{
+    const KeysymKey *lookup = key;
+    const KeysymName *entry = element;
+    int rc = strncmp(lookup->name, entry->name, lookup->length);
+    if (rc != 0) {
+        return rc;
+    }
+    return entry->name[lookup->length] == '\0' ? 0 : -1;
+}
+
+static uint32_t parse_hex(const char *digits, size_t length)
+{
+    if (length == 0 || length > 8) {
+        return 0;
+    }
+    uint32_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        int digit = hex_digit_value(digits[i]);
+        if (digit < 0) {
+            return 0;
+        }
+        value = (value << 4) | (uint32_t)digit;
+    }
+    return value;
+}
+
+static uint32_t valid_codepoint(uint32_t codepoint)
+{
+    if (codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        return 0;
+    }
+    return codepoint;
+}
+
+/* Logs a name missing from keysymdef.h the first time it is seen. Layouts and compose
+ * files are parsed on the reload thread as well as at startup, hence the lock. */
+static void report_unknown(const char *name, size_t length)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static char reported[KEYSYM_REPORTED_MAX][KEYSYM_NAME_MAX];
+    static size_t reported_count;
+
+    if (length >= KEYSYM_NAME_MAX) {
+        length = KEYSYM_NAME_MAX - 1;
+    }
+    pthread_mutex_lock(&lock);
+    bool seen = false;
+    for (size_t i = 0; i < reported_count && !seen; ++i) {
+        seen = strncmp(reported[i], name, length) == 0 && reported[i][length] == '\0';
+    }
+    bool full = reported_count == KEYSYM_REPORTED_MAX;
+    if (!seen && !full) {
+        memcpy(reported[reported_count], name, length);
+        reported[reported_count][length] = '\0';
+        reported_count++;
+    }
+    pthread_mutex_unlock(&lock);
+    if (!seen && !full) {
+        log_warn("Unknown keysym %.*s; it types nothing", (int)length, name);
+    }
+}
+
+uint32_t keysym_to_codepoint(const char *name, size_t length)
+{
+    if (!name || length == 0) {
+        return 0;
+    }
+    /* Single printable ASCII characters name themselves: "a", "7". */
+    if (length == 1) {
+        unsigned char c = (unsigned char)name[0];
+        return (c > 0x20 && c < 0x7f) ? c : 0;
+    }
+    if (name[0] == 'U' && length <= 7) {
+        uint32_t codepoint = parse_hex(name + 1, length - 1);
+        if (codepoint) {
+            return valid_codepoint(codepoint);
+        }
+    }
+    if (name[0] == '0' && (name[1] == 'x' || name[1] == 'X')) {
+        uint32_t keysym = parse_hex(name + 2, length - 2);
+        if (keysym >= 0x01000100 && keysym <= 0x0110FFFF) {
+            return valid_codepoint(keysym - 0x01000000);
+        }
+        /* Latin-1 keysyms equal their code point. */
+        if ((keysym >= 0x20 && keysym < 0x7f) || (keysym >= 0xa0 && keysym <= 0xff)) {
+            return keysym;
+        }
+        return 0;
+    }
+
+    KeysymKey key = {name, length};
+    const KeysymName *entry = NULL;
+    if (length > 5 && memcmp(name, "dead_", 5) == 0) {
+        entry = bsearch(&key, dead_keys, sizeof(dead_keys) / sizeof(dead_keys[0]), sizeof(dead_keys[0]),
+                        compare_keysym);
+    }
+    if (!entry) {
+        entry = bsearch(&key, keysym_names, sizeof(keysym_names) / sizeof(keysym_names[0]),
+                        sizeof(keysym_names[0]), compare_keysym);
+    }
+    if (!entry) {
+        report_unknown(name, length);
+        return 0;
+    }
+    return entry->codepoint;
+}
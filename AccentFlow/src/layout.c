@@ -0,0 +1,699 @@
+#include "layout.h"
+#include "keysym.h"
+#include "utils.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LAYOUT_DEFAULT_XKB_ROOT "/usr/share/X11/xkb"
+#define LAYOUT_SYSTEM_KEYBOARD "/etc/default/keyboard"
+#define LAYOUT_MAX_INCLUDE_DEPTH 8
+
+typedef struct {
+    const char name[5];
+    uint16_t keycode;
+} KeyName;
+
+/* XKB names of the alphanumeric block, as defined by keycodes/evdev. */
+static const KeyName key_names[] = {
+    {"TLDE", KEY_GRAVE}, {"AE01", KEY_1}, {"AE02", KEY_2}, {"AE03", KEY_3}, {"AE04", KEY_4},
+    {"AE05", KEY_5}, {"AE06", KEY_6}, {"AE07", KEY_7}, {"AE08", KEY_8}, {"AE09", KEY_9},
+    {"AE10", KEY_0}, {"AE11", KEY_MINUS}, {"AE12", KEY_EQUAL},
+    {"AD01", KEY_Q}, {"AD02", KEY_W}, {"AD03", KEY_E}, {"AD04", KEY_R}, {"AD05", KEY_T},
+    {"AD06", KEY_Y}, {"AD07", KEY_U}, {"AD08", KEY_I}, {"AD09", KEY_O}, {"AD10", KEY_P},
+    {"AD11", KEY_LEFTBRACE}, {"AD12", KEY_RIGHTBRACE},
+    {"AC01", KEY_A}, {"AC02", KEY_S}, {"AC03", KEY_D}, {"AC04", KEY_F}, {"AC05", KEY_G},
+    {"AC06", KEY_H}, {"AC07", KEY_J}, {"AC08", KEY_K}, {"AC09", KEY_L}, {"AC10", KEY_SEMICOLON},
+    {"AC11", KEY_APOSTROPHE}, {"AC12", KEY_BACKSLASH}, {"BKSL", KEY_BACKSLASH},
+    {"AB01", KEY_Z}, {"AB02", KEY_X}, {"AB03", KEY_C}, {"AB04", KEY_V}, {"AB05", KEY_B},
+    {"AB06", KEY_N}, {"AB07", KEY_M}, {"AB08", KEY_COMMA}, {"AB09", KEY_DOT}, {"AB10", KEY_SLASH},
+    {"LSGT", KEY_102ND},
+};
+
+/* Used when no XKB data is installed. */
+static const struct {
+    uint16_t keycode;
+    char levels[2];
+} us_keys[] = {
+    {KEY_GRAVE, "`~"}, {KEY_1, "1!"}, {KEY_2, "2@"}, {KEY_3, "3#"}, {KEY_4, "4$"}, {KEY_5, "5%"},
+    {KEY_6, "6^"}, {KEY_7, "7&"}, {KEY_8, "8*"}, {KEY_9, "9("}, {KEY_0, "0)"}, {KEY_MINUS, "-_"},
+    {KEY_EQUAL, "=+"}, {KEY_Q, "qQ"}, {KEY_W, "wW"}, {KEY_E, "eE"}, {KEY_R, "rR"}, {KEY_T, "tT"},
+    {KEY_Y, "yY"}, {KEY_U, "uU"}, {KEY_I, "iI"}, {KEY_O, "oO"}, {KEY_P, "pP"}, {KEY_LEFTBRACE, "[{"},
+    {KEY_RIGHTBRACE, "]}"}, {KEY_A, "aA"}, {KEY_S, "sS"}, {KEY_D, "dD"}, {KEY_F, "fF"}, {KEY_G, "gG"},
+    {KEY_H, "hH"}, {KEY_J, "jJ"}, {KEY_K, "kK"}, {KEY_L, "lL"}, {KEY_SEMICOLON, ";:"},
+    {KEY_APOSTROPHE, "'\""}, {KEY_BACKSLASH, "\\|"}, {KEY_Z, "zZ"}, {KEY_X, "xX"}, {KEY_C, "cC"},
+    {KEY_V, "vV"}, {KEY_B, "bB"}, {KEY_N, "nN"}, {KEY_M, "mM"}, {KEY_COMMA, ",<"}, {KEY_DOT, ".>"},
+    {KEY_SLASH, "/?"},
+};
+
+typedef struct {
+    KeyboardLayout *layout;
+    const char *root;
+    char *error;
+    size_t error_size;
+} LayoutCompiler;
+
+typedef struct {
+    const char *pos;
+    const char *end;
+} Scanner;
+
+/* Key types whose first two levels are the unmodified key and Shift, as the keycode table
+ * assumes. Levels 3 and up may be anything: they are never read. */
+static const char *const supported_types[] = {
+    "ONE_LEVEL", "TWO_LEVEL", "ALPHABETIC", "THREE_LEVEL",
+    "FOUR_LEVEL", "FOUR_LEVEL_ALPHABETIC", "FOUR_LEVEL_SEMIALPHABETIC", "FOUR_LEVEL_PLUS_LOCK",
+    "EIGHT_LEVEL", "EIGHT_LEVEL_ALPHABETIC", "EIGHT_LEVEL_SEMIALPHABETIC",
+    "EIGHT_LEVEL_LEVEL_FIVE_LOCK", "EIGHT_LEVEL_ALPHABETIC_LEVEL_FIVE_LOCK",
+};
+
+/* Keysyms that make another key type its higher levels while held or locked. Mode_switch
+ * is not one: it selects another group, and only the first group is read anyway. */
+static const char *const level_keysyms[] = {
+    "ISO_Level3_Shift", "ISO_Level3_Latch", "ISO_Level3_Lock",
+    "ISO_Level5_Shift", "ISO_Level5_Latch", "ISO_Level5_Lock",
+};
+
+/* Keys that may carry those keysyms: Right Alt, which AccentFlow takes over, and the
+ * virtual keys xkeyboard-config binds them to for the modifier mapping. */
+static const char *const level_key_names[] = {"RALT", "LVL3", "LVL5", "MDSW"};
+
+static bool load_symbols(LayoutCompiler *compiler, const char *file, size_t file_length,
+                         const char *section, size_t section_length, bool augment, int depth);
+
+static void skip_space(Scanner *scanner)
+{
+    while (scanner->pos < scanner->end) {
+        char c = *scanner->pos;
+        if (isspace((unsigned char)c)) {
+            scanner->pos++;
+        } else if (c == '/' && scanner->pos + 1 < scanner->end && scanner->pos[1] == '/') {
+            while (scanner->pos < scanner->end && *scanner->pos != '\n') {
+                scanner->pos++;
+            }
+        } else {
+            break;
+        }
+    }
+}
+
+static bool is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static size_t scan_word(Scanner *scanner, const char **word)
+{
+    skip_space(scanner);
+    *word = scanner->pos;
+    while (scanner->pos < scanner->end && is_word_char(*scanner->pos)) {
+        scanner->pos++;
+    }
+    return (size_t)(scanner->pos - *word);
+}
+
+static bool word_is(const char *word, size_t length, const char *expected)
+{
+    return strlen(expected) == length && memcmp(word, expected, length) == 0;
+}
+
+static bool scan_string(Scanner *scanner, const char **start, size_t *length)
+{
+    skip_space(scanner);
+    if (scanner->pos >= scanner->end || *scanner->pos != '"') {
+        return false;
+    }
+    const char *close = memchr(scanner->pos + 1, '"', (size_t)(scanner->end - scanner->pos - 1));
+    if (!close) {
+        return false;
+    }
+    *start = scanner->pos + 1;
+    *length = (size_t)(close - *start);
+    scanner->pos = close + 1;
+    return true;
+}
+
+/* Matching '}' or ']' for the bracket at open, skipping strings and comments. */
+static const char *find_closing(const char *open, const char *end)
+{
+    int depth = 0;
+    for (const char *p = open; p < end; ++p) {
+        if (*p == '"') {
+            p = memchr(p + 1, '"', (size_t)(end - p - 1));
+            if (!p) {
+                return NULL;
+            }
+        } else if (*p == '/' && p + 1 < end && p[1] == '/') {
+            p = memchr(p, '\n', (size_t)(end - p));
+            if (!p) {
+                return NULL;
+            }
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) {
+                return p;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Skips to just past the next ';' outside brackets, or to the end. */
+static void skip_statement(Scanner *scanner)
+{
+    while (scanner->pos < scanner->end) {
+        skip_space(scanner);
+        if (scanner->pos >= scanner->end) {
+            return;
+        }
+        char c = *scanner->pos;
+        if (c == ';') {
+            scanner->pos++;
+            return;
+        }
+        if (c == '{' || c == '[' || c == '"') {
+            const char *close = c == '"' ? memchr(scanner->pos + 1, '"', (size_t)(scanner->end - scanner->pos - 1))
+                                         : find_closing(scanner->pos, scanner->end);
+            scanner->pos = close ? close + 1 : scanner->end;
+            continue;
+        }
+        scanner->pos++;
+    }
+}
+
+static const KeyName *find_key_name(const char *name, size_t length)
+{
+    for (size_t i = 0; i < sizeof(key_names) / sizeof(key_names[0]); ++i) {
+        if (word_is(name, length, key_names[i].name)) {
+            return &key_names[i];
+        }
+    }
+    return NULL;
+}
+
+/* Applies the first two levels of a "[ sym, sym, ... ]" list; NoSymbol keeps the previous level. */
+static void apply_symbol_list(uint32_t levels[2], const char *pos, const char *end)
+{
+    Scanner scanner = {pos, end};
+    uint32_t symbols[2] = {0, 0};
+    bool assigned[2] = {false, false};
+    size_t count = 0;
+
+    while (count < 2) {
+        const char *word;
+        size_t length = scan_word(&scanner, &word);
+        if (length > 0 && !word_is(word, length, "NoSymbol")) {
+            symbols[count] = keysym_to_codepoint(word, length);
+            assigned[count] = true;
+        }
+        count++;
+        skip_space(&scanner);
+        if (scanner.pos >= scanner.end || *scanner.pos != ',') {
+            break;
+        }
+        scanner.pos++;
+    }
+
+    for (int level = 0; level < 2; ++level) {
+        if (assigned[level]) {
+            levels[level] = symbols[level];
+        }
+    }
+    /* A one-level letter key still types its capital with Shift, as XKB's ALPHABETIC type does. */
+    if (count == 1 && assigned[0]) {
+        uint32_t upper = codepoint_upper_case(levels[0]);
+        levels[1] = upper ? upper : levels[0];
+    }
+}
+
+static bool word_in(const char *word, size_t length, const char *const *words, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (word_is(word, length, words[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Rejects a key whose first two levels select level 3 or 5, unless it is one of
+ * level_key_names: with any other such key held, keys type characters the keycode table
+ * does not have. Higher levels are only reached through Right Alt, so they do not count. */
+static bool check_level_key(LayoutCompiler *compiler, const char *name, size_t name_length,
+                            const char *body, const char *end)
+{
+    if (word_in(name, name_length, level_key_names, sizeof(level_key_names) / sizeof(level_key_names[0]))) {
+        return true;
+    }
+    for (const char *list = memchr(body, '[', (size_t)(end - body)); list;
+         list = memchr(list + 1, '[', (size_t)(end - list - 1))) {
+        const char *close = find_closing(list, end);
+        Scanner scanner = {list + 1, close ? close : end};
+        for (int level = 0; level < 2; ++level) {
+            const char *word;
+            size_t length = scan_word(&scanner, &word);
+            if (word_in(word, length, level_keysyms, sizeof(level_keysyms) / sizeof(level_keysyms[0]))) {
+                snprintf(compiler->error, compiler->error_size,
+                         "XKB layout makes <%.*s> %.*s; only Right Alt may select another level",
+                         (int)name_length, name, (int)length, word);
+                return false;
+            }
+            skip_space(&scanner);
+            if (scanner.pos >= scanner.end || *scanner.pos != ',') {
+                break;
+            }
+            scanner.pos++;
+        }
+        if (!close) {
+            break;
+        }
+        list = close;
+    }
+    return true;
+}
+
+/* Reads the string of "type[GroupN] = "..."" after the word type; false for another group. */
+static bool scan_key_type(Scanner *scanner, const char **type, size_t *type_length)
+{
+    skip_space(scanner);
+    bool first_group = true;
+    if (scanner->pos < scanner->end && *scanner->pos == '[') {
+        const char *close = find_closing(scanner->pos, scanner->end);
+        first_group = close && close[-1] == '1';
+        scanner->pos = close ? close + 1 : scanner->end;
+        skip_space(scanner);
+    }
+    if (scanner->pos < scanner->end && *scanner->pos == '=') {
+        scanner->pos++;
+    }
+    return scan_string(scanner, type, type_length) && first_group;
+}
+
+/* type is the section's key.type default, or NULL; a type set on the key replaces it. */
+static bool apply_key(LayoutCompiler *compiler, const char *name, size_t name_length,
+                      const char *body, const char *end, bool augment, const char *type, size_t type_length)
+{
+    if (!check_level_key(compiler, name, name_length, body, end)) {
+        return false;
+    }
+    const KeyName *key = find_key_name(name, name_length);
+    if (!key) {
+        return true;
+    }
+    uint32_t *levels = compiler->layout->levels[key->keycode];
+    if (augment && (levels[0] || levels[1])) {
+        return true;
+    }
+
+    Scanner scanner = {body, end};
+    while (1) {
+        skip_space(&scanner);
+        if (scanner.pos >= scanner.end) {
+            break;
+        }
+        const char *list = NULL;
+        if (*scanner.pos == '[') {
+            list = scanner.pos;
+        } else {
+            const char *word;
+            size_t length = scan_word(&scanner, &word);
+            skip_space(&scanner);
+            if (word_is(word, length, "type")) {
+                scan_key_type(&scanner, &type, &type_length);
+            } else if (word_is(word, length, "symbols") && scanner.pos < scanner.end && *scanner.pos == '[') {
+                /* symbols[GroupN] = [ ... ]; only the first group matters. */
+                const char *group_end = find_closing(scanner.pos, scanner.end);
+                bool first_group = group_end && group_end[-1] == '1';
+                scanner.pos = group_end ? group_end + 1 : scanner.end;
+                skip_space(&scanner);
+                if (scanner.pos < scanner.end && *scanner.pos == '=') {
+                    scanner.pos++;
+                    skip_space(&scanner);
+                }
+                if (first_group && scanner.pos < scanner.end && *scanner.pos == '[') {
+                    list = scanner.pos;
+                }
+            }
+        }
+
+        if (list) {
+            const char *close = find_closing(list, scanner.end);
+            if (!close) {
+                break;
+            }
+            apply_symbol_list(levels, list + 1, close);
+            scanner.pos = close + 1;
+        }
+
+        /* Move on to the next comma-separated entry of the key body. */
+        while (scanner.pos < scanner.end && *scanner.pos != ',') {
+            if (*scanner.pos == '[' || *scanner.pos == '{') {
+                const char *close = find_closing(scanner.pos, scanner.end);
+                scanner.pos = close ? close : scanner.end;
+            }
+            if (scanner.pos < scanner.end) {
+                scanner.pos++;
+            }
+        }
+        if (scanner.pos < scanner.end) {
+            scanner.pos++;
+        }
+    }
+
+    if (type && !word_in(type, type_length, supported_types, sizeof(supported_types) / sizeof(supported_types[0]))) {
+        snprintf(compiler->error, compiler->error_size,
+                 "XKB key <%.*s> has type \"%.*s\"; only types whose second level is Shift alone are supported", (int)name_length, name,
+                 (int)type_length, type);
+        return false;
+    }
+    return true;
+}
+
+/* Include specs look like "latin(type4)+level3(ralt_switch)"; '|' merges in augment mode. */
+static bool apply_include(LayoutCompiler *compiler, const char *spec, size_t length, bool augment, int depth)
+{
+    const char *pos = spec;
+    const char *end = spec + length;
+    bool part_augment = augment;
+
+    while (pos < end) {
+        const char *file = pos;
+        while (pos < end && *pos != '(' && *pos != ':' && *pos != '+' && *pos != '|') {
+            pos++;
+        }
+        size_t file_length = (size_t)(pos - file);
+        const char *section = NULL;
+        size_t section_length = 0;
+        if (pos < end && *pos == '(') {
+            section = ++pos;
+            while (pos < end && *pos != ')') {
+                pos++;
+            }
+            section_length = (size_t)(pos - section);
+            if (pos < end) {
+                pos++;
+            }
+        }
+        bool first_group = true;
+        if (pos < end && *pos == ':') {
+            first_group = pos + 1 < end && pos[1] == '1';
+            while (pos < end && *pos != '+' && *pos != '|') {
+                pos++;
+            }
+        }
+
+        if (file_length > 0 && first_group &&
+            !load_symbols(compiler, file, file_length, section, section_length, part_augment, depth)) {
+            return false;
+        }
+
+        if (pos < end) {
+            part_augment = augment || *pos == '|';
+            pos++;
+        }
+    }
+    return true;
+}
+
+static bool apply_section(LayoutCompiler *compiler, const char *body, const char *end, bool augment, int depth)
+{
+    Scanner scanner = {body, end};
+    const char *type = NULL;
+    size_t type_length = 0;
+    while (1) {
+        skip_space(&scanner);
+        if (scanner.pos >= scanner.end) {
+            return true;
+        }
+
+        const char *word;
+        size_t length = scan_word(&scanner, &word);
+        bool key_augment = augment;
+        if (word_is(word, length, "include") || word_is(word, length, "augment") ||
+            word_is(word, length, "override") || word_is(word, length, "replace")) {
+            bool merge_augment = augment || word_is(word, length, "augment");
+            const char *spec;
+            size_t spec_length;
+            if (scan_string(&scanner, &spec, &spec_length)) {
+                if (!apply_include(compiler, spec, spec_length, merge_augment, depth + 1)) {
+                    return false;
+                }
+                continue;
+            }
+            key_augment = merge_augment;
+            length = scan_word(&scanner, &word);
+        }
+
+        if (word_is(word, length, "key")) {
+            skip_space(&scanner);
+            if (scanner.pos < scanner.end && *scanner.pos == '.') {
+                /* key.type = "..." sets the type of the keys that follow in the section. */
+                scanner.pos++;
+                length = scan_word(&scanner, &word);
+                if (word_is(word, length, "type")) {
+                    scan_key_type(&scanner, &type, &type_length);
+                }
+            } else if (scanner.pos < scanner.end && *scanner.pos == '<') {
+                const char *name = ++scanner.pos;
+                while (scanner.pos < scanner.end && *scanner.pos != '>') {
+                    scanner.pos++;
+                }
+                size_t name_length = (size_t)(scanner.pos - name);
+                scanner.pos = scanner.pos < scanner.end ? scanner.pos + 1 : scanner.end;
+                skip_space(&scanner);
+                if (scanner.pos < scanner.end && *scanner.pos == '{') {
+                    const char *close = find_closing(scanner.pos, scanner.end);
+                    if (close) {
+                        if (!apply_key(compiler, name, name_length, scanner.pos + 1, close, key_augment, type,
+                                       type_length)) {
+                            return false;
+                        }
+                        scanner.pos = close + 1;
+                    }
+                }
+            }
+        }
+        skip_statement(&scanner);
+    }
+}
+
+/* Locates the body of xkb_symbols "section", or the default (else first) one when section is NULL. */
+static bool find_section(const char *data, size_t length, const char *section, size_t section_length,
+                         const char **body, const char **body_end)
+{
+    Scanner scanner = {data, data + length};
+    const char *first = NULL;
+    const char *first_end = NULL;
+    bool is_default = false;
+
+    while (1) {
+        skip_space(&scanner);
+        if (scanner.pos >= scanner.end) {
+            break;
+        }
+        const char *word;
+        size_t word_length = scan_word(&scanner, &word);
+        if (word_length == 0) {
+            scanner.pos++;
+            continue;
+        }
+        if (word_is(word, word_length, "default")) {
+            is_default = true;
+            continue;
+        }
+        if (!word_is(word, word_length, "xkb_symbols")) {
+            continue;
+        }
+
+        const char *name;
+        size_t name_length;
+        if (!scan_string(&scanner, &name, &name_length)) {
+            return false;
+        }
+        skip_space(&scanner);
+        if (scanner.pos >= scanner.end || *scanner.pos != '{') {
+            return false;
+        }
+        const char *close = find_closing(scanner.pos, scanner.end);
+        if (!close) {
+            return false;
+        }
+
+        bool match = section ? (name_length == section_length && memcmp(name, section, name_length) == 0)
+                             : is_default;
+        if (match) {
+            *body = scanner.pos + 1;
+            *body_end = close;
+            return true;
+        }
+        if (!first) {
+            first = scanner.pos + 1;
+            first_end = close;
+        }
+        scanner.pos = close + 1;
+        is_default = false;
+    }
+
+    if (!section && first) {
+        *body = first;
+        *body_end = first_end;
+        return true;
+    }
+    return false;
+}
+
+static bool load_symbols(LayoutCompiler *compiler, const char *file, size_t file_length,
+                         const char *section, size_t section_length, bool augment, int depth)
+{
+    if (depth > LAYOUT_MAX_INCLUDE_DEPTH) {
+        snprintf(compiler->error, compiler->error_size, "XKB includes nested too deeply at '%.*s'",
+                 (int)file_length, file);
+        return false;
+    }
+    if (file[0] == '.' || memchr(file, '/', file_length)) {
+        snprintf(compiler->error, compiler->error_size, "Invalid XKB symbols name '%.*s'", (int)file_length, file);
+        return false;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/symbols/%.*s", compiler->root, (int)file_length, file);
+    size_t length = 0;
+    char *data = read_file_to_buffer(path, &length);
+    if (!data) {
+        snprintf(compiler->error, compiler->error_size, "Unable to read XKB symbols '%.*s'", (int)file_length, file);
+        return false;
+    }
+
+    const char *body;
+    const char *body_end;
+    bool ok = find_section(data, length, section, section_length, &body, &body_end);
+    if (!ok) {
+        snprintf(compiler->error, compiler->error_size, "XKB symbols '%.*s(%.*s)' not found",
+                 (int)file_length, file, (int)section_length, section ? section : "");
+    } else {
+        ok = apply_section(compiler, body, body_end, augment, depth);
+    }
+    free(data);
+    return ok;
+}
+
+/* Reads XKBLAYOUT and XKBVARIANT; only the first of several comma-separated layouts is used. */
+static bool read_system_keyboard(char *layout, size_t layout_size, char *variant, size_t variant_size)
+{
+    FILE *fp = fopen(LAYOUT_SYSTEM_KEYBOARD, "r");
+    if (!fp) {
+        return false;
+    }
+    layout[0] = '\0';
+    variant[0] = '\0';
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char *target = NULL;
+        size_t size = 0;
+        char *value = NULL;
+        if (strncmp(line, "XKBLAYOUT=", 10) == 0) {
+            target = layout;
+            size = layout_size;
+            value = line + 10;
+        } else if (strncmp(line, "XKBVARIANT=", 11) == 0) {
+            target = variant;
+            size = variant_size;
+            value = line + 11;
+        } else {
+            continue;
+        }
+        value += strspn(value, "\"'");
+        size_t length = strcspn(value, "\"',\r\n");
+        if (length >= size) {
+            length = size - 1;
+        }
+        memcpy(target, value, length);
+        target[length] = '\0';
+    }
+    fclose(fp);
+    return layout[0] != '\0';
+}
+
+static pthread_once_t system_keyboard_once = PTHREAD_ONCE_INIT;
+static char system_layout[64];
+static char system_variant[64];
+
+static void load_system_keyboard(void)
+{
+    if (!read_system_keyboard(system_layout, sizeof(system_layout), system_variant, sizeof(system_variant))) {
+        snprintf(system_layout, sizeof(system_layout), "us");
+        system_variant[0] = '\0';
+    }
+}
+
+/* Replaces an unset name by the system keyboard's layout and variant; an empty variant is NULL. */
+static void resolve_names(const char **name, const char **variant)
+{
+    if (!*name || (*name)[0] == '\0') {
+        pthread_once(&system_keyboard_once, load_system_keyboard);
+        *name = system_layout;
+        *variant = system_variant;
+    }
+    if (*variant && (*variant)[0] == '\0') {
+        *variant = NULL;
+    }
+}
+
+void layout_resolve(const char *name, const char *variant, char *spec, size_t spec_size)
+{
+    resolve_names(&name, &variant);
+    if (variant) {
+        snprintf(spec, spec_size, "%s(%s)", name, variant);
+    } else {
+        snprintf(spec, spec_size, "%s", name);
+    }
+}
+
+bool layout_compile(KeyboardLayout *layout, const char *name, const char *variant, char *error, size_t error_size)
+{
+    if (!layout) {
+        return false;
+    }
+    memset(layout, 0, sizeof(*layout));
+    resolve_names(&name, &variant);
+
+    const char *root = getenv("XKB_CONFIG_ROOT");
+    LayoutCompiler compiler = {
+        .layout = layout,
+        .root = root && root[0] ? root : LAYOUT_DEFAULT_XKB_ROOT,
+        .error = error,
+        .error_size = error_size,
+    };
+    /* The same symbols the evdev rules produce for a single layout: "pc+layout(variant)". */
+    char spec[256];
+    int length = variant ? snprintf(spec, sizeof(spec), "pc+%s(%s)", name, variant)
+                         : snprintf(spec, sizeof(spec), "pc+%s", name);
+    if (length < 0 || (size_t)length >= sizeof(spec)) {
+        snprintf(error, error_size, "XKB layout name too long");
+        return false;
+    }
+    return apply_include(&compiler, spec, (size_t)length, false, 0);
+}
+
+void layout_load_us(KeyboardLayout *layout)
+{
+    memset(layout, 0, sizeof(*layout));
+    for (size_t i = 0; i < sizeof(us_keys) / sizeof(us_keys[0]); ++i) {
+        layout->levels[us_keys[i].keycode][0] = (unsigned char)us_keys[i].levels[0];
+        layout->levels[us_keys[i].keycode][1] = (unsigned char)us_keys[i].levels[1];
+    }
+}
+
+bool layout_key_is_alphabetic(const KeyboardLayout *layout, uint16_t keycode)
+{
+    if (keycode >= KEY_CNT) {
+        return false;
+    }
+    uint32_t lower = layout->levels[keycode][0];
+    return lower != 0 && codepoint_upper_case(lower) == layout->levels[keycode][1];
+}
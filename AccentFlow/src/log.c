@@ -0,0 +1,670 @@
+#include "log.h"
+#include "spsc_ring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_RING_SLOTS 512
+#define LOG_RECORD_DATA 224
+#define LOG_LINE_MAX 1024
+#define LOG_OUTPUT_BUFFER 16384
+#define LOG_SPEC_MAX 32
+
+enum {
+    LOG_SITE_UNPARSED,
+    LOG_SITE_PARSING,
+    LOG_SITE_READY,
+    LOG_SITE_PREFORMATTED, /* a conversion the log thread cannot replay; formatted by the caller */
+};
+
+enum {
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_POINTER,
+    LOG_ARG_STRING,
+};
+
+/* One message as the call site left it: the arguments in order, numbers as raw bytes and
+ * strings copied with their terminator, or the formatted text for preformatted sites. */
+typedef struct {
+    const LogSite *site;
+    struct timespec when;
+    uint32_t suppressed;
+    unsigned char preformatted;
+    unsigned char data[LOG_RECORD_DATA];
+} LogRecord;
+
+/* A producer thread's ring. Rings are pushed on the list the first time their thread
+ * logs and stay until log_stop. */
+typedef struct LogRing {
+    SpscRing *ring;
+    _Atomic size_t dropped;
+    size_t dropped_reported; /* log thread only */
+    struct LogRing *next;
+} LogRing;
+
+static _Atomic int log_threshold = LOG_INFO;
+static _Atomic uint32_t log_rate_limit = LOG_RATE_LIMIT;
+
+static struct {
+    _Atomic bool running;
+    _Atomic unsigned int generation;
+    _Atomic(LogRing *) rings;
+    int wake_fd;
+    pthread_t thread;
+    _Atomic bool sleeping;
+    _Atomic bool stopping;
+} logger;
+
+static _Thread_local LogRing *thread_ring;
+static _Thread_local unsigned int thread_generation;
+
+/* Columns of an unterminated status line on stderr; guarded by the stderr lock. */
+static size_t partial_columns;
+
+static const char *const level_names[] = {"error", "warn", "info", "debug"};
+static const char *const level_labels[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+static size_t type_size(unsigned char type)
+{
+    switch (type) {
+    case LOG_ARG_INT: return sizeof(int);
+    case LOG_ARG_LONG: return sizeof(long);
+    case LOG_ARG_LLONG: return sizeof(long long);
+    case LOG_ARG_SIZE: return sizeof(size_t);
+    case LOG_ARG_DOUBLE: return sizeof(double);
+    case LOG_ARG_POINTER: return sizeof(void *);
+    default: return 1; /* a string's terminator at least */
+    }
+}
+
+/* Reads one conversion after its '%'. Returns its end, or NULL for conversions the log
+ * thread does not replay ('*' widths, %n, unusual length modifiers). */
+static const char *parse_conversion(const char *p, unsigned char *type)
+{
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    int longs = 0;
+    bool size = false;
+    if (*p == 'h') {
+        p += p[1] == 'h' ? 2 : 1;
+    } else if (*p == 'l') {
+        longs = p[1] == 'l' ? 2 : 1;
+        p += longs;
+    } else if (*p == 'z') {
+        size = true;
+        p++;
+    }
+    if (!*p) {
+        return NULL;
+    }
+    switch (*p) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        *type = size ? LOG_ARG_SIZE : longs == 2 ? LOG_ARG_LLONG : longs == 1 ? LOG_ARG_LONG : LOG_ARG_INT;
+        return p + 1;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        *type = LOG_ARG_DOUBLE;
+        return size || longs > 1 ? NULL : p + 1;
+    case 's':
+        *type = LOG_ARG_STRING;
+        return size || longs ? NULL : p + 1;
+    case 'p':
+        *type = LOG_ARG_POINTER;
+        return size || longs ? NULL : p + 1;
+    default:
+        return NULL;
+    }
+}
+
+static bool parse_format(const char *format, unsigned char *types, unsigned char *count)
+{
+    size_t fixed = 0;
+    *count = 0;
+    for (const char *p = format; *p; ++p) {
+        if (*p != '%') {
+            continue;
+        }
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        unsigned char type;
+        const char *end = parse_conversion(p + 1, &type);
+        if (!end || end - p >= LOG_SPEC_MAX || *count == LOG_MAX_ARGS) {
+            return false;
+        }
+        types[(*count)++] = type;
+        fixed += type_size(type);
+        p = end - 1;
+    }
+    return fixed < LOG_RECORD_DATA;
+}
+
+/* The site's argument types, parsed once; false when the caller must format. */
+static bool site_arg_types(LogSite *site, unsigned char *local, const unsigned char **types, unsigned char *count)
+{
+    unsigned char state = atomic_load_explicit(&site->parse_state, memory_order_acquire);
+    if (state == LOG_SITE_UNPARSED) {
+        unsigned char expected = LOG_SITE_UNPARSED;
+        if (atomic_compare_exchange_strong(&site->parse_state, &expected, LOG_SITE_PARSING)) {
+            bool ok = parse_format(site->format, site->arg_types, &site->arg_count);
+            atomic_store_explicit(&site->parse_state, ok ? LOG_SITE_READY : LOG_SITE_PREFORMATTED,
+                                  memory_order_release);
+            state = ok ? LOG_SITE_READY : LOG_SITE_PREFORMATTED;
+        } else {
+            state = expected;
+        }
+    }
+    if (state == LOG_SITE_READY) {
+        *types = site->arg_types;
+        *count = site->arg_count;
+        return true;
+    }
+    if (state == LOG_SITE_PREFORMATTED) {
+        return false;
+    }
+    /* Another thread is parsing the same site right now. */
+    *types = local;
+    return parse_format(site->format, local, count);
+}
+
+static void capture(LogRecord *record, const unsigned char *types, unsigned char count, va_list args)
+{
+    size_t reserved = 0;
+    for (unsigned char i = 0; i < count; ++i) {
+        reserved += type_size(types[i]);
+    }
+    size_t offset = 0;
+    for (unsigned char i = 0; i < count; ++i) {
+        reserved -= type_size(types[i]);
+        unsigned char *out = record->data + offset;
+        switch (types[i]) {
+        case LOG_ARG_INT: {
+            int value = va_arg(args, int);
+            memcpy(out, &value, sizeof(value));
+            break;
+        }
+        case LOG_ARG_LONG: {
+            long value = va_arg(args, long);
+            memcpy(out, &value, sizeof(value));
+            break;
+        }
+        case LOG_ARG_LLONG: {
+            long long value = va_arg(args, long long);
+            memcpy(out, &value, sizeof(value));
+            break;
+        }
+        case LOG_ARG_SIZE: {
+            size_t value = va_arg(args, size_t);
+            memcpy(out, &value, sizeof(value));
+            break;
+        }
+        case LOG_ARG_DOUBLE: {
+            double value = va_arg(args, double);
+            memcpy(out, &value, sizeof(value));
+            break;
+        }
+        case LOG_ARG_POINTER: {
+            void *value = va_arg(args, void *);
+            memcpy(out, &value, sizeof(value));
+            break;
+        }
+        default: {
+            /* Long strings are cut so the arguments after them still fit. */
+            const char *value = va_arg(args, const char *);
+            if (!value) {
+                value = "(null)";
+            }
+            size_t room = LOG_RECORD_DATA - offset - reserved - 1;
+            size_t length = strnlen(value, room);
+            memcpy(out, value, length);
+            out[length] = '\0';
+            offset += length + 1;
+            continue;
+        }
+        }
+        offset += type_size(types[i]);
+    }
+}
+
+static size_t append_text(char *line, size_t length, size_t size, const char *text, size_t text_length)
+{
+    if (text_length > size - 1 - length) {
+        text_length = size - 1 - length;
+    }
+    memcpy(line + length, text, text_length);
+    return length + text_length;
+}
+
+/* snprintf appends at length, clamped so length stays below size. */
+#define APPEND_FORMAT(line, length, size, ...)                                                    \
+    do {                                                                                          \
+        int written_ = snprintf((line) + (length), (size) - (length), __VA_ARGS__);             \
+        if (written_ > 0) {                                                                       \
+            (length) += (size_t)written_ < (size) - (length) ? (size_t)written_ : (size) - (length) - 1; \
+        }                                                                                         \
+    } while (0)
+
+static size_t replay_message(const LogRecord *record, char *line, size_t length, size_t size)
+{
+    const unsigned char *data = record->data;
+    for (const char *p = record->site->format; *p && length < size - 1;) {
+        if (*p != '%') {
+            const char *next = strchr(p, '%');
+            size_t run = next ? (size_t)(next - p) : strlen(p);
+            length = append_text(line, length, size, p, run);
+            p += run;
+            continue;
+        }
+        if (p[1] == '%') {
+            length = append_text(line, length, size, "%", 1);
+            p += 2;
+            continue;
+        }
+        unsigned char type = LOG_ARG_INT;
+        const char *end = parse_conversion(p + 1, &type);
+        char spec[LOG_SPEC_MAX];
+        memcpy(spec, p, (size_t)(end - p));
+        spec[end - p] = '\0';
+        p = end;
+        switch (type) {
+        case LOG_ARG_INT: {
+            int value;
+            memcpy(&value, data, sizeof(value));
+            APPEND_FORMAT(line, length, size, spec, value);
+            break;
+        }
+        case LOG_ARG_LONG: {
+            long value;
+            memcpy(&value, data, sizeof(value));
+            APPEND_FORMAT(line, length, size, spec, value);
+            break;
+        }
+        case LOG_ARG_LLONG: {
+            long long value;
+            memcpy(&value, data, sizeof(value));
+            APPEND_FORMAT(line, length, size, spec, value);
+            break;
+        }
+        case LOG_ARG_SIZE: {
+            size_t value;
+            memcpy(&value, data, sizeof(value));
+            APPEND_FORMAT(line, length, size, spec, value);
+            break;
+        }
+        case LOG_ARG_DOUBLE: {
+            double value;
+            memcpy(&value, data, sizeof(value));
+            APPEND_FORMAT(line, length, size, spec, value);
+            break;
+        }
+        case LOG_ARG_POINTER: {
+            void *value;
+            memcpy(&value, data, sizeof(value));
+            APPEND_FORMAT(line, length, size, spec, value);
+            break;
+        }
+        default: {
+            const char *value = (const char *)data;
+            APPEND_FORMAT(line, length, size, spec, value);
+            data += strlen(value) + 1;
+            continue;
+        }
+        }
+        data += type_size(type);
+    }
+    return length;
+}
+
+/* Formats the timestamp and level; the date part is reused within one second. */
+static size_t format_prefix(char *line, size_t size, const struct timespec *when, LogLevel level)
+{
+    static _Thread_local time_t cached_second = -1;
+    static _Thread_local char cached_date[32];
+    if (when->tv_sec != cached_second) {
+        struct tm tm;
+        localtime_r(&when->tv_sec, &tm);
+        strftime(cached_date, sizeof(cached_date), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_second = when->tv_sec;
+    }
+    size_t length = 0;
+    APPEND_FORMAT(line, length, size, "%s.%03ld [%s] ", cached_date, when->tv_nsec / 1000000L, level_labels[level]);
+    return length;
+}
+
+static size_t format_record(const LogRecord *record, char *line, size_t size)
+{
+    size_t length = format_prefix(line, size, &record->when, record->site->level);
+    if (record->preformatted) {
+        const char *text = (const char *)record->data;
+        length = append_text(line, length, size, text, strlen(text));
+    } else {
+        length = replay_message(record, line, length, size);
+    }
+    if (record->suppressed > 0) {
+        APPEND_FORMAT(line, length, size, " (%u similar messages suppressed)", (unsigned int)record->suppressed);
+    }
+    line[length++] = '\n';
+    return length;
+}
+
+static void write_output(const char *text, size_t length)
+{
+    flockfile(stderr);
+    size_t columns = log_take_partial_line();
+    if (columns > 0) {
+        fputc('\r', stderr);
+        for (size_t i = 0; i < columns; ++i) {
+            fputc(' ', stderr);
+        }
+        fputc('\r', stderr);
+    }
+    fwrite(text, 1, length, stderr);
+    funlockfile(stderr);
+}
+
+/* Errors are never suppressed: a dropped one may be the only trace of a failure. */
+static bool rate_allow(LogSite *site, const struct timespec *when, uint32_t *suppressed)
+{
+    uint32_t limit = atomic_load_explicit(&log_rate_limit, memory_order_relaxed);
+    if (limit == 0 || site->level == LOG_ERROR) {
+        *suppressed = 0;
+        return true;
+    }
+    uint64_t now_ns = (uint64_t)when->tv_sec * 1000000000ull + (uint64_t)when->tv_nsec;
+    uint64_t start = atomic_load_explicit(&site->window_start_ns, memory_order_relaxed);
+    if (now_ns - start >= 1000000000ull) {
+        atomic_store_explicit(&site->window_start_ns, now_ns, memory_order_relaxed);
+        atomic_store_explicit(&site->window_count, 0, memory_order_relaxed);
+    }
+    if (atomic_fetch_add_explicit(&site->window_count, 1, memory_order_relaxed) >= limit) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+    *suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    return true;
+}
+
+/* The calling thread's ring, created on its first message; NULL to write directly. */
+static LogRing *current_ring(void)
+{
+    if (!atomic_load_explicit(&logger.running, memory_order_acquire)) {
+        return NULL;
+    }
+    unsigned int generation = atomic_load_explicit(&logger.generation, memory_order_relaxed);
+    if (thread_ring && thread_generation == generation) {
+        return thread_ring;
+    }
+    LogRing *ring = calloc(1, sizeof(LogRing));
+    if (!ring || !(ring->ring = spsc_ring_create(sizeof(LogRecord), LOG_RING_SLOTS))) {
+        free(ring);
+        return NULL;
+    }
+    ring->next = atomic_load_explicit(&logger.rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&logger.rings, &ring->next, ring, memory_order_release,
+                                                  memory_order_relaxed)) {
+    }
+    thread_ring = ring;
+    thread_generation = generation;
+    return ring;
+}
+
+static void wake(void)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&logger.sleeping, memory_order_relaxed) && atomic_exchange(&logger.sleeping, false)) {
+        uint64_t one = 1;
+        if (write(logger.wake_fd, &one, sizeof(one)) < 0) {
+            /* The log thread still drains the ring on its next wakeup. */
+        }
+    }
+}
+
+bool log_enabled(LogLevel level)
+{
+    return (int)level <= atomic_load_explicit(&log_threshold, memory_order_relaxed);
+}
+
+void log_write(LogSite *site, const char *fmt, ...)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint32_t suppressed;
+    if (!rate_allow(site, &now, &suppressed)) {
+        return;
+    }
+
+    LogRing *ring = current_ring();
+    LogRecord local;
+    LogRecord *record = ring ? spsc_ring_reserve(ring->ring) : &local;
+    if (!record) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    record->site = site;
+    record->when = now;
+    record->suppressed = suppressed;
+
+    unsigned char local_types[LOG_MAX_ARGS];
+    const unsigned char *types;
+    unsigned char count;
+    va_list args;
+    va_start(args, fmt);
+    record->preformatted = !site_arg_types(site, local_types, &types, &count);
+    if (record->preformatted) {
+        vsnprintf((char *)record->data, sizeof(record->data), fmt, args);
+    } else {
+        capture(record, types, count, args);
+    }
+    va_end(args);
+
+    if (ring) {
+        spsc_ring_publish(ring->ring);
+        wake();
+    } else {
+        char line[LOG_LINE_MAX];
+        write_output(line, format_record(record, line, sizeof(line)));
+    }
+}
+
+/* The ring whose next record is oldest, or NULL when every ring is empty. */
+static LogRing *oldest_ring(void)
+{
+    LogRing *oldest = NULL;
+    const LogRecord *oldest_record = NULL;
+    for (LogRing *ring = atomic_load_explicit(&logger.rings, memory_order_acquire); ring; ring = ring->next) {
+        const LogRecord *record = spsc_ring_peek(ring->ring, 0);
+        if (record && (!oldest_record || record->when.tv_sec < oldest_record->when.tv_sec ||
+                       (record->when.tv_sec == oldest_record->when.tv_sec &&
+                        record->when.tv_nsec < oldest_record->when.tv_nsec))) {
+            oldest = ring;
+            oldest_record = record;
+        }
+    }
+    return oldest;
+}
+
+static void report_dropped(void)
+{
+    for (LogRing *ring = atomic_load_explicit(&logger.rings, memory_order_acquire); ring; ring = ring->next) {
+        size_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped == ring->dropped_reported) {
+            continue;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        char line[LOG_LINE_MAX];
+        size_t length = format_prefix(line, sizeof(line), &now, LOG_WARN);
+        APPEND_FORMAT(line, length, sizeof(line), "Logging fell behind; dropped %zu messages\n",
+                      dropped - ring->dropped_reported);
+        ring->dropped_reported = dropped;
+        write_output(line, length);
+    }
+}
+
+/* Formats every queued record into output, writing it out whenever it fills up. */
+static bool drain(char *output)
+{
+    size_t length = 0;
+    bool drained = false;
+    LogRing *ring;
+    while ((ring = oldest_ring()) != NULL) {
+        if (LOG_OUTPUT_BUFFER - length < LOG_LINE_MAX) {
+            write_output(output, length);
+            length = 0;
+        }
+        length += format_record(spsc_ring_peek(ring->ring, 0), output + length, LOG_LINE_MAX);
+        spsc_ring_pop(ring->ring);
+        drained = true;
+    }
+    if (length > 0) {
+        write_output(output, length);
+    }
+    report_dropped();
+    return drained;
+}
+
+static void wait_for_records(void)
+{
+    atomic_store(&logger.sleeping, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (oldest_ring() || atomic_load(&logger.stopping)) {
+        atomic_store(&logger.sleeping, false);
+        return;
+    }
+    struct pollfd pfd = {.fd = logger.wake_fd, .events = POLLIN};
+    if (poll(&pfd, 1, -1) > 0) {
+        uint64_t count;
+        if (read(logger.wake_fd, &count, sizeof(count)) < 0) {
+            /* Nothing to do: the rings are checked again either way. */
+        }
+    }
+    atomic_store(&logger.sleeping, false);
+}
+
+static void *log_thread(void *userdata)
+{
+    (void)userdata;
+    char *output = malloc(LOG_OUTPUT_BUFFER);
+    if (!output) {
+        return NULL;
+    }
+    while (1) {
+        if (drain(output)) {
+            continue;
+        }
+        if (atomic_load(&logger.stopping)) {
+            break;
+        }
+        wait_for_records();
+    }
+    free(output);
+    return NULL;
+}
+
+bool log_set_level(const char *name)
+{
+    if (!name) {
+        atomic_store_explicit(&log_threshold, LOG_INFO, memory_order_relaxed);
+        return true;
+    }
+    for (int level = LOG_ERROR; level <= LOG_DEBUG; ++level) {
+        if (strcmp(name, level_names[level]) == 0) {
+            atomic_store_explicit(&log_threshold, level, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void log_set_rate_limit(uint32_t per_second)
+{
+    atomic_store_explicit(&log_rate_limit, per_second, memory_order_relaxed);
+}
+
+bool log_start(void)
+{
+    if (atomic_load(&logger.running)) {
+        return true;
+    }
+    logger.wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (logger.wake_fd < 0) {
+        log_error("Unable to start the log thread: %s", strerror(errno));
+        return false;
+    }
+    atomic_store(&logger.stopping, false);
+    atomic_store(&logger.sleeping, false);
+
+    /* Signals stay with the event loop's signalfd. */
+    sigset_t all_signals;
+    sigset_t previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+    int rc = pthread_create(&logger.thread, NULL, log_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    if (rc != 0) {
+        close(logger.wake_fd);
+        log_error("Unable to start the log thread: %s", strerror(rc));
+        return false;
+    }
+    atomic_fetch_add(&logger.generation, 1);
+    atomic_store_explicit(&logger.running, true, memory_order_release);
+    return true;
+}
+
+void log_stop(void)
+{
+    if (!atomic_load(&logger.running)) {
+        return;
+    }
+    atomic_store(&logger.running, false);
+    atomic_store(&logger.stopping, true);
+    uint64_t one = 1;
+    if (write(logger.wake_fd, &one, sizeof(one)) < 0) {
+        log_error("Unable to stop the log thread: %s", strerror(errno));
+    }
+    pthread_join(logger.thread, NULL);
+    close(logger.wake_fd);
+
+    LogRing *ring = atomic_exchange(&logger.rings, NULL);
+    while (ring) {
+        LogRing *next = ring->next;
+        spsc_ring_destroy(ring->ring);
+        free(ring);
+        ring = next;
+    }
+}
+
+void log_partial_line(size_t columns)
+{
+    partial_columns = columns;
+}
+
+size_t log_take_partial_line(void)
+{
+    size_t columns = partial_columns;
+    partial_columns = 0;
+    return columns;
+}
@@ -1,62 +1,206 @@
 #include "mapper.h"
+#include "arena.h"
+#include "compose.h"
 #include "config.h"
+#include "layout.h"
+#include "unicode_sequence.h"
+#include "utils.h"
 
-#include <ctype.h>
 #include <linux/input-event-codes.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
-static const char *keycode_to_base(uint16_t keycode)
+typedef struct {
+    uint32_t codepoint;
+    const AccentMapping *mapping;
+} BaseSlot;
+
+/* Open-addressed code point -> mapping table; capacity is a power of two. */
+typedef struct {
+    BaseSlot *slots;
+    size_t mask;
+} BaseTable;
+
+static size_t base_slot(const BaseTable *table, uint32_t codepoint)
+{
+    size_t index = (codepoint * 2654435761u) & table->mask;
+    while (table->slots[index].codepoint && table->slots[index].codepoint != codepoint) {
+        index = (index + 1) & table->mask;
+    }
+    return index;
+}
+
+/* Indexes single-character bases; the first mapping for a base wins, like config_find_mapping. */
+static bool build_base_table(BaseTable *table, const struct AccentConfig *config)
 {
-    switch (keycode) {
-    case KEY_A: return "a";
-    case KEY_B: return "b";
-    case KEY_C: return "c";
-    case KEY_D: return "d";
-    case KEY_E: return "e";
-    case KEY_F: return "f";
-    case KEY_G: return "g";
-    case KEY_H: return "h";
-    case KEY_I: return "i";
-    case KEY_J: return "j";
-    case KEY_K: return "k";
-    case KEY_L: return "l";
-    case KEY_M: return "m";
-    case KEY_N: return "n";
-    case KEY_O: return "o";
-    case KEY_P: return "p";
-    case KEY_Q: return "q";
-    case KEY_R: return "r";
-    case KEY_S: return "s";
-    case KEY_T: return "t";
-    case KEY_U: return "u";
-    case KEY_V: return "v";
-    case KEY_W: return "w";
-    case KEY_X: return "x";
-    case KEY_Y: return "y";
-    case KEY_Z: return "z";
-    case KEY_APOSTROPHE: return "'";
-    case KEY_SEMICOLON: return ";";
-    case KEY_GRAVE: return "`";
-    case KEY_LEFTBRACE: return "[";
-    case KEY_RIGHTBRACE: return "]";
-    case KEY_MINUS: return "-";
-    case KEY_EQUAL: return "=";
-    default:
+    size_t capacity = 16;
+    while (capacity < config->mapping_count * 2) {
+        capacity <<= 1;
+    }
+    table->slots = calloc(capacity, sizeof(BaseSlot));
+    if (!table->slots) {
+        return false;
+    }
+    table->mask = capacity - 1;
+
+    for (size_t i = 0; i < config->mapping_count; ++i) {
+        const AccentMapping *mapping = &config->mappings[i];
+        uint32_t codepoint = 0;
+        size_t consumed = utf8_to_codepoint(mapping->base, &codepoint);
+        if (consumed == 0 || mapping->base[consumed] != '\0') {
+            continue;
+        }
+        BaseSlot *slot = &table->slots[base_slot(table, codepoint)];
+        if (!slot->codepoint) {
+            slot->codepoint = codepoint;
+            slot->mapping = mapping;
+        }
+    }
+    return true;
+}
+
+static const AccentMapping *base_lookup(const BaseTable *table, uint32_t codepoint)
+{
+    if (!codepoint) {
         return NULL;
     }
+    return table->slots[base_slot(table, codepoint)].mapping;
+}
+
+/* Caps Lock shifts letters only; Shift cancels it, as on a regular keyboard. */
+static int layer_level(const KeyboardLayout *layout, uint16_t keycode, unsigned int layer)
+{
+    bool shift = (layer & MAPPER_LAYER_SHIFT) != 0;
+    bool caps = (layer & MAPPER_LAYER_CAPS) != 0;
+    return (shift != (caps && layout_key_is_alphabetic(layout, keycode))) ? 1 : 0;
+}
+
+/* A shifted key without its own mapping falls back to the unshifted one. */
+static bool compile_keymap(struct AccentConfig *config, const KeyboardLayout *layout)
+{
+    size_t entries = (size_t)MAPPER_LAYER_COUNT * MAPPER_KEY_COUNT;
+    if (!config->keymap) {
+        config->keymap = arena_alloc(config->arena, entries * sizeof(*config->keymap));
+        if (!config->keymap) {
+            return false;
+        }
+    } else {
+        memset(config->keymap, 0, entries * sizeof(*config->keymap));
+    }
+
+    BaseTable bases = {0};
+    if (!build_base_table(&bases, config)) {
+        return false;
+    }
+    for (unsigned int layer = 0; layer < MAPPER_LAYER_COUNT; ++layer) {
+        const AccentMapping **table = config->keymap + (size_t)layer * MAPPER_KEY_COUNT;
+        for (uint16_t keycode = 0; keycode < MAPPER_KEY_COUNT; ++keycode) {
+            const AccentMapping *unshifted = base_lookup(&bases, layout->levels[keycode][0]);
+            const AccentMapping *mapping = base_lookup(&bases, layout->levels[keycode][layer_level(layout, keycode, layer)]);
+            table[keycode] = mapping ? mapping : unshifted;
+        }
+    }
+    free(bases.slots);
+    return true;
 }
 
-const struct AccentMapping *mapper_from_keycode(const struct AccentConfig *config, uint16_t keycode, char *out_base)
+/* The key sequences are built with US keys when the configuration is loaded; a layout
+ * that types "u" or a hex digit elsewhere gets them rebuilt. */
+static bool compile_unicode_keys(struct AccentConfig *config, const KeyboardLayout *layout)
 {
-    const char *base = keycode_to_base(keycode);
-    if (!base) {
+    UnicodeKeys keys;
+    if (!unicode_keys_from_layout(&keys, layout)) {
+        log_warn("The keyboard layout lacks \"u\" or a hex digit; Unicode entry uses US keys for it");
+    }
+    if (memcmp(&keys, config->unicode_keys ? config->unicode_keys : &unicode_keys_us, sizeof(keys)) == 0) {
+        return true;
+    }
+    UnicodeKeys *copy = arena_alloc(config->arena, sizeof(keys));
+    if (!copy) {
+        return false;
+    }
+    *copy = keys;
+    config->unicode_keys = copy;
+    char *error = NULL;
+    if (!config_compile_sequences(config, &error)) {
+        log_error("%s", error ? error : "Out of memory");
+        free(error);
+        return false;
+    }
+    return true;
+}
+
+/* The layout is compiled once for the configuration and all of its profiles, which share
+ * the compose sequences; each profile gets its own keymap. */
+bool mapper_compile(struct AccentConfig *config)
+{
+    if (!config || !compose_build(config)) {
+        return false;
+    }
+    size_t entries = (size_t)MAPPER_LAYER_COUNT * MAPPER_KEY_COUNT;
+    config->key_characters = NULL;
+    if (config->compose) {
+        config->key_characters = arena_alloc(config->arena, entries * sizeof(*config->key_characters));
+        if (!config->key_characters) {
+            return false;
+        }
+    }
+
+    KeyboardLayout *layout = malloc(sizeof(KeyboardLayout));
+    if (!layout) {
+        return false;
+    }
+    char spec[160];
+    layout_resolve(config->xkb_layout, config->xkb_variant, spec, sizeof(spec));
+    config->layout = arena_strndup(config->arena, spec, strlen(spec));
+    if (!config->layout) {
+        free(layout);
+        return false;
+    }
+    char error[256];
+    if (!layout_compile(layout, config->xkb_layout, config->xkb_variant, error, sizeof(error))) {
+        log_error("%s; falling back to the US layout", error);
+        layout_load_us(layout);
+    }
+
+    if (config->key_characters) {
+        for (unsigned int layer = 0; layer < MAPPER_LAYER_COUNT; ++layer) {
+            uint32_t *characters = config->key_characters + (size_t)layer * MAPPER_KEY_COUNT;
+            for (uint16_t keycode = 0; keycode < MAPPER_KEY_COUNT; ++keycode) {
+                uint32_t character = layout->levels[keycode][layer_level(layout, keycode, layer)];
+                characters[keycode] = character ? character : layout->levels[keycode][0];
+            }
+        }
+    }
+
+    bool ok = compile_keymap(config, layout) && compile_unicode_keys(config, layout);
+    for (size_t i = 1; i < config->profile_count && ok; ++i) {
+        struct AccentConfig *profile = config->profiles[i];
+        profile->compose = config->compose;
+        profile->key_characters = config->key_characters;
+        profile->unicode_keys = config->unicode_keys;
+        profile->layout = config->layout;
+        ok = compile_keymap(profile, layout);
+    }
+    free(layout);
+    return ok;
+}
+
+const struct AccentMapping *mapper_from_keycode(const struct AccentConfig *config, uint16_t keycode, unsigned int layer)
+{
+    if (keycode >= MAPPER_KEY_COUNT) {
         return NULL;
     }
-    if (out_base) {
-        strcpy(out_base, base);
+    return config->keymap[(size_t)layer * MAPPER_KEY_COUNT + keycode];
+}
+
+uint32_t mapper_character_from_keycode(const struct AccentConfig *config, uint16_t keycode, unsigned int layer)
+{
+    if (keycode >= MAPPER_KEY_COUNT || !config->key_characters) {
+        return 0;
     }
-    return config_find_mapping(config, base);
+    return config->key_characters[(size_t)layer * MAPPER_KEY_COUNT + keycode];
 }
 
 const char *mapper_select_variant(const struct AccentMapping *mapping, size_t index)
@@ -0,0 +1,92 @@
+#include "output_backend.h"
+#include "unicode_sequence.h"
+#include "utils.h"
+
+#include <linux/input.h>
+#include <stdio.h>
+#include <string.h>
+
+OutputBackend *output_backend_create(const char *spec, char **error_message)
+{
+    if (!spec || strcmp(spec, "uinput") == 0) {
+        return output_backend_create_uinput();
+    }
+    if (strcmp(spec, "recorder") == 0) {
+        return output_backend_create_recorder(NULL);
+    }
+    if (strncmp(spec, "recorder:", 9) == 0 && spec[9] != '\0') {
+        return output_backend_create_recorder(spec + 9);
+    }
+    if (error_message) {
+        char message[256];
+        snprintf(message, sizeof(message), "Unknown output backend '%s' (expected uinput, recorder or recorder:PATH)", spec);
+        *error_message = duplicate_string(message);
+    }
+    return NULL;
+}
+
+void output_backend_destroy(OutputBackend *backend)
+{
+    if (backend) {
+        backend->ops->destroy(backend);
+    }
+}
+
+int output_backend_forward(OutputBackend *backend, const struct input_event *event)
+{
+    backend->stats.forwarded_events++;
+    return backend->ops->forward(backend, event);
+}
+
+int output_backend_commit(OutputBackend *backend, const char *utf8, const struct AccentSequence *sequence,
+                          const OutputModifiers *held)
+{
+    uint64_t start = monotonic_time_ns();
+    int rc = backend->ops->commit(backend, utf8, sequence, held);
+    uint64_t elapsed = monotonic_time_ns() - start;
+
+    if (rc == 0) {
+        backend->stats.commits++;
+        backend->stats.commit_events += sequence->event_count;
+        if (held && held->count > 0) {
+            backend->stats.commit_events += 2 * (held->count + 1);
+        }
+        backend->stats.commit_ns += elapsed;
+        if (elapsed > backend->stats.commit_ns_max) {
+            backend->stats.commit_ns_max = elapsed;
+        }
+    }
+    return rc;
+}
+
+size_t output_modifier_events(const OutputModifiers *held, int32_t value, struct input_event *events)
+{
+    if (!held || held->count == 0) {
+        return 0;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < held->count && i < OUTPUT_MODIFIERS_MAX; ++i) {
+        memset(&events[count], 0, sizeof(events[count]));
+        events[count].type = EV_KEY;
+        events[count].code = held->keys[i];
+        events[count].value = value;
+        count++;
+    }
+    memset(&events[count], 0, sizeof(events[count]));
+    events[count].type = EV_SYN;
+    events[count].code = SYN_REPORT;
+    return count + 1;
+}
+
+const char *output_backend_name(const OutputBackend *backend)
+{
+    return backend ? backend->ops->name : NULL;
+}
+
+void output_backend_get_stats(const OutputBackend *backend, OutputBackendStats *stats)
+{
+    if (!backend || !stats) {
+        return;
+    }
+    *stats = backend->stats;
+}
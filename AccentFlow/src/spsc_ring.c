@@ -0,0 +1,103 @@
+#include "spsc_ring.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SPSC_CACHE_LINE 64
+
+/* head and tail count slots ever consumed and published. Each side keeps a copy of the
+ * other's counter and reloads it only when the copy says the ring is full or empty, so
+ * the two cache lines change hands once per batch rather than once per slot. */
+struct SpscRing {
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;
+    size_t cached_head;
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;
+    size_t cached_tail;
+    _Alignas(SPSC_CACHE_LINE) unsigned char *slots;
+    size_t slot_size;
+    size_t mask;
+};
+
+SpscRing *spsc_ring_create(size_t slot_size, size_t slot_count)
+{
+    if (slot_size == 0 || slot_count == 0 || slot_count > SIZE_MAX / 2) {
+        return NULL;
+    }
+    size_t capacity = 1;
+    while (capacity < slot_count) {
+        capacity <<= 1;
+    }
+    slot_size = (slot_size + 15u) & ~(size_t)15u;
+    if (capacity > SIZE_MAX / slot_size) {
+        return NULL;
+    }
+
+    SpscRing *ring = aligned_alloc(SPSC_CACHE_LINE, sizeof(SpscRing));
+    if (!ring) {
+        return NULL;
+    }
+    size_t bytes = (capacity * slot_size + SPSC_CACHE_LINE - 1) & ~(size_t)(SPSC_CACHE_LINE - 1);
+    ring->slots = aligned_alloc(SPSC_CACHE_LINE, bytes);
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->slot_size = slot_size;
+    ring->mask = capacity - 1;
+    return ring;
+}
+
+void spsc_ring_destroy(SpscRing *ring)
+{
+    if (!ring) {
+        return;
+    }
+    free(ring->slots);
+    free(ring);
+}
+
+void *spsc_ring_reserve(SpscRing *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head > ring->mask) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail - ring->cached_head > ring->mask) {
+            return NULL;
+        }
+    }
+    return ring->slots + (tail & ring->mask) * ring->slot_size;
+}
+
+void spsc_ring_publish(SpscRing *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+const void *spsc_ring_peek(SpscRing *ring, size_t offset)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (ring->cached_tail - head <= offset) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (ring->cached_tail - head <= offset) {
+            return NULL;
+        }
+    }
+    return ring->slots + ((head + offset) & ring->mask) * ring->slot_size;
+}
+
+void spsc_ring_pop(SpscRing *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+bool spsc_ring_empty(SpscRing *ring)
+{
+    return spsc_ring_peek(ring, 0) == NULL;
+}
@@ -0,0 +1,352 @@
+#include "text_scan.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define TEXT_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static TextScanLevel level_limit = TEXT_SCAN_AVX2;
+
+TextScanLevel text_scan_level(void)
+{
+#ifdef TEXT_SCAN_X86
+    TextScanLevel level = __builtin_cpu_supports("avx2") ? TEXT_SCAN_AVX2 : TEXT_SCAN_SSE2;
+#else
+    TextScanLevel level = TEXT_SCAN_SCALAR;
+#endif
+    return level < level_limit ? level : level_limit;
+}
+
+void text_scan_limit(TextScanLevel level)
+{
+    level_limit = level;
+}
+
+const char *text_scan_level_name(TextScanLevel level)
+{
+    switch (level) {
+    case TEXT_SCAN_AVX2:
+        return "avx2";
+    case TEXT_SCAN_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+static inline bool is_json_space(unsigned char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+#ifdef TEXT_SCAN_X86
+static inline __m128i sse2_whitespace(__m128i block)
+{
+    __m128i space = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    __m128i newline = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+    __m128i tab = _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'));
+    __m128i carriage = _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(space, newline), _mm_or_si128(tab, carriage));
+}
+
+static size_t sse2_skip_whitespace(const char *data, size_t pos, size_t length)
+{
+    while (length - pos >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + pos));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(sse2_whitespace(block)) & 0xFFFFu;
+        if (mask) {
+            return pos + (size_t)__builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return pos;
+}
+
+static size_t sse2_find_string_delimiter(const char *data, size_t pos, size_t length)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (length - pos >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + pos));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+        if (mask) {
+            return pos + (size_t)__builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return pos;
+}
+
+/* The sign bit of every byte is set exactly for non-ASCII input. */
+static size_t sse2_ascii_span(const unsigned char *data, size_t pos, size_t length)
+{
+    while (length - pos >= 16) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + pos)));
+        if (mask) {
+            return pos + (size_t)__builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return pos;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find_string_delimiter(const char *data, size_t pos, size_t length)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    while (length - pos >= 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + pos));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits);
+        if (mask) {
+            return pos + (size_t)__builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+
+/* Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte" (2021): three
+ * nibble lookups over each byte and its predecessor flag every invalid two-byte pattern,
+ * and a saturating subtract catches missing third and fourth continuation bytes. */
+#define UTF8_TOO_SHORT (1 << 0)
+#define UTF8_TOO_LONG (1 << 1)
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE (1 << 3)
+#define UTF8_SURROGATE (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS (1 << 7)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/* A 16-entry nibble lookup, repeated in both lanes for vpshufb. */
+#define UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h), \
+                     (char)(i), (char)(j), (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p), \
+                     (char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h), \
+                     (char)(i), (char)(j), (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p))
+
+/* The input shifted back by n bytes, with the tail of the previous block shifted in. */
+#define AVX2_PREVIOUS(input, previous, n) \
+    _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+static __m256i avx2_utf8_errors(__m256i input, __m256i previous)
+{
+    const __m256i byte_1_high_table = UTF8_TABLE(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    const __m256i byte_1_low_table = UTF8_TABLE(
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = UTF8_TABLE(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    __m256i previous_1 = AVX2_PREVIOUS(input, previous, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table,
+                                              _mm256_and_si256(_mm256_srli_epi16(previous_1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(previous_1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table,
+                                              _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    /* Bytes two or three after a 3- or 4-byte lead must be continuations; those are the
+     * only places a TWO_CONTS flag is legitimate, so the XOR clears exactly them. */
+    __m256i third = _mm256_subs_epu8(AVX2_PREVIOUS(input, previous, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(AVX2_PREVIOUS(input, previous, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+/* Any of the last three bytes that starts a sequence too long to finish in this block. */
+__attribute__((target("avx2")))
+static __m256i avx2_utf8_incomplete(__m256i input)
+{
+    const __m256i limits = _mm256_setr_epi8(
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, limits);
+}
+
+__attribute__((target("avx2")))
+static bool avx2_validate_utf8(const unsigned char *data, size_t length)
+{
+    __m256i error = _mm256_setzero_si256();
+    __m256i previous = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    size_t pos = 0;
+    for (;;) {
+        __m256i input;
+        bool last = length - pos < 32;
+        if (last) {
+            /* Spaces after the end: a sequence cut off by the end of the buffer fails
+             * like one cut off by ASCII. */
+            unsigned char tail[32];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, data + pos, length - pos);
+            input = _mm256_loadu_si256((const __m256i *)tail);
+        } else {
+            input = _mm256_loadu_si256((const __m256i *)(data + pos));
+        }
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, incomplete);
+        } else {
+            error = _mm256_or_si256(error, avx2_utf8_errors(input, previous));
+            incomplete = avx2_utf8_incomplete(input);
+        }
+        previous = input;
+        if (last) {
+            break;
+        }
+        pos += 32;
+    }
+    return _mm256_testz_si256(error, error);
+}
+#endif
+
+size_t text_skip_whitespace(const char *data, size_t pos, size_t length)
+{
+    /* Gaps between tokens are mostly a byte or two; only indentation reaches the vector loop. */
+    if (pos >= length || !is_json_space((unsigned char)data[pos])) {
+        return pos;
+    }
+#ifdef TEXT_SCAN_X86
+    if (level_limit >= TEXT_SCAN_SSE2) {
+        pos = sse2_skip_whitespace(data, pos, length);
+    }
+#endif
+    while (pos < length && is_json_space((unsigned char)data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+size_t text_find_string_delimiter(const char *data, size_t pos, size_t length)
+{
+    if (pos >= length) {
+        return length;
+    }
+#ifdef TEXT_SCAN_X86
+    TextScanLevel level = text_scan_level();
+    if (level == TEXT_SCAN_AVX2) {
+        pos = avx2_find_string_delimiter(data, pos, length);
+    }
+    if (level >= TEXT_SCAN_SSE2) {
+        pos = sse2_find_string_delimiter(data, pos, length);
+    }
+#endif
+    while (pos < length && data[pos] != '"' && data[pos] != '\\') {
+        pos++;
+    }
+    return pos;
+}
+
+/* Length of the well-formed multi-byte sequence at s (RFC 3629, table 3-7), or 0. */
+static size_t utf8_sequence_length(const unsigned char *s, size_t available)
+{
+    unsigned char lead = s[0];
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    size_t length;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) {
+            low = 0xA0;
+        } else if (lead == 0xED) {
+            high = 0x9F;
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) {
+            low = 0x90;
+        } else if (lead == 0xF4) {
+            high = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+    if (available < length || s[1] < low || s[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+bool text_validate_utf8(const char *data, size_t length, size_t *error_offset)
+{
+    const unsigned char *s = (const unsigned char *)data;
+    TextScanLevel level = text_scan_level();
+#ifdef TEXT_SCAN_X86
+    /* The vector check only answers yes or no; the scalar pass below locates the error. */
+    if (level == TEXT_SCAN_AVX2 && avx2_validate_utf8(s, length)) {
+        return true;
+    }
+#endif
+    size_t pos = 0;
+    while (pos < length) {
+        if (s[pos] < 0x80) {
+#ifdef TEXT_SCAN_X86
+            if (level >= TEXT_SCAN_SSE2) {
+                pos = sse2_ascii_span(s, pos, length);
+            }
+#else
+            (void)level;
+#endif
+            while (pos < length && s[pos] < 0x80) {
+                pos++;
+            }
+            continue;
+        }
+        size_t sequence = utf8_sequence_length(s + pos, length - pos);
+        if (sequence == 0) {
+            if (error_offset) {
+                *error_offset = pos;
+            }
+            return false;
+        }
+        pos += sequence;
+    }
+    return true;
+}
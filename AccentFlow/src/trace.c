@@ -0,0 +1,175 @@
+#include "trace.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TRACE_WRITE_BUFFER (64 * 1024)
+
+struct TraceWriter {
+    FILE *file;
+    char *path;
+    uint64_t last_us;
+    bool started;
+    bool failed;
+};
+
+struct Trace {
+    void *mapping;
+    size_t size;
+    const TraceEvent *events;
+    size_t count;
+};
+
+static void set_error(char **error_message, const char *fmt, const char *path)
+{
+    if (!error_message) {
+        return;
+    }
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), fmt, path, strerror(errno));
+    *error_message = duplicate_string(buffer);
+}
+
+TraceWriter *trace_writer_create(const char *path, char **error_message)
+{
+    TraceWriter *writer = calloc(1, sizeof(TraceWriter));
+    if (!writer) {
+        return NULL;
+    }
+    writer->path = duplicate_string(path);
+    writer->file = fopen(path, "wbe");
+    if (!writer->path || !writer->file) {
+        set_error(error_message, "Unable to create %s: %s", path);
+        trace_writer_destroy(writer);
+        return NULL;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, TRACE_WRITE_BUFFER);
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.event_size = sizeof(TraceEvent);
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        set_error(error_message, "Unable to write %s: %s", path);
+        trace_writer_destroy(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+void trace_writer_append(TraceWriter *writer, uint16_t device, const struct input_event *events, size_t count)
+{
+    if (!writer || writer->failed) {
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const struct input_event *event = &events[i];
+        uint64_t time_us = (uint64_t)event->input_event_sec * 1000000u + (uint64_t)event->input_event_usec;
+        uint64_t delta = writer->started && time_us > writer->last_us ? time_us - writer->last_us : 0;
+        writer->last_us = time_us;
+        writer->started = true;
+
+        TraceEvent record = {
+            .delta_us = delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta,
+            .device = device,
+            .type = event->type,
+            .code = event->code,
+            .value = event->value,
+        };
+        if (fwrite(&record, sizeof(record), 1, writer->file) != 1) {
+            log_error("Unable to write %s: %s; recording stopped", writer->path, strerror(errno));
+            writer->failed = true;
+            return;
+        }
+    }
+}
+
+void trace_writer_destroy(TraceWriter *writer)
+{
+    if (!writer) {
+        return;
+    }
+    if (writer->file && fclose(writer->file) != 0 && !writer->failed) {
+        log_error("Unable to write %s: %s", writer->path, strerror(errno));
+    }
+    free(writer->path);
+    free(writer);
+}
+
+Trace *trace_open(const char *path, char **error_message)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        set_error(error_message, "Unable to open %s: %s", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        close(fd);
+        errno = EINVAL;
+        set_error(error_message, "%s is not an input trace (%s)", path);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        set_error(error_message, "Unable to map %s: %s", path);
+        return NULL;
+    }
+
+    const TraceHeader *header = mapping;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION ||
+        header->event_size != sizeof(TraceEvent) || (size - sizeof(TraceHeader)) % sizeof(TraceEvent) != 0) {
+        munmap(mapping, size);
+        errno = EINVAL;
+        set_error(error_message, "%s is not an input trace of this version (%s)", path);
+        return NULL;
+    }
+    Trace *trace = malloc(sizeof(Trace));
+    if (!trace) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    trace->mapping = mapping;
+    trace->size = size;
+    trace->events = (const TraceEvent *)((const char *)mapping + sizeof(TraceHeader));
+    trace->count = (size - sizeof(TraceHeader)) / sizeof(TraceEvent);
+    return trace;
+}
+
+void trace_close(Trace *trace)
+{
+    if (!trace) {
+        return;
+    }
+    munmap(trace->mapping, trace->size);
+    free(trace);
+}
+
+const TraceEvent *trace_events(const Trace *trace, size_t *count)
+{
+    *count = trace ? trace->count : 0;
+    return trace ? trace->events : NULL;
+}
+
+void trace_event_decode(const TraceEvent *trace_event, uint64_t *time_us, struct input_event *event)
+{
+    *time_us += trace_event->delta_us;
+    memset(event, 0, sizeof(*event));
+    event->input_event_sec = (time_t)(*time_us / 1000000u);
+    event->input_event_usec = (suseconds_t)(*time_us % 1000000u);
+    event->type = trace_event->type;
+    event->code = trace_event->code;
+    event->value = trace_event->value;
+}
@@ -0,0 +1,156 @@
+#include "unicode_sequence.h"
+#include "arena.h"
+#include "layout.h"
+#include "mapper.h"
+#include "utils.h"
+
+#include <linux/input-event-codes.h>
+#include <linux/input.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Ctrl, Shift, U and Enter presses and releases; two more per hex digit, and two for
+ * Shift around a shifted one. */
+#define UNICODE_SEQUENCE_FIXED_KEYS 8
+#define UNICODE_SEQUENCE_MAX_DIGITS 6
+
+const UnicodeKeys unicode_keys_us = {
+    .u = KEY_U,
+    .digits = {KEY_0, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7,
+               KEY_8, KEY_9, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F},
+};
+
+/* The key typing character, unshifted if any key does; false when there is none. */
+static bool find_key(const KeyboardLayout *layout, uint32_t character, uint16_t *keycode, bool *shifted)
+{
+    for (int level = 0; level < 2; ++level) {
+        for (uint16_t code = 0; code < MAPPER_KEY_COUNT; ++code) {
+            if (layout->levels[code][level] == character) {
+                *keycode = code;
+                *shifted = level == 1;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool unicode_keys_from_layout(UnicodeKeys *keys, const KeyboardLayout *layout)
+{
+    static const char hex[] = "0123456789abcdef";
+    *keys = unicode_keys_us;
+    bool complete = true;
+    bool shifted = false;
+    if (!find_key(layout, 'u', &keys->u, &shifted) || shifted) {
+        keys->u = unicode_keys_us.u;
+        complete = false;
+    }
+    for (unsigned int digit = 0; digit < 16; ++digit) {
+        if (!find_key(layout, (uint32_t)hex[digit], &keys->digits[digit], &shifted)) {
+            keys->digits[digit] = unicode_keys_us.digits[digit];
+            complete = false;
+        } else if (shifted) {
+            keys->shifted_digits |= (uint16_t)(1u << digit);
+        }
+    }
+    return complete;
+}
+
+static void append_key(struct input_event *events, size_t *count, uint16_t code, int32_t value)
+{
+    struct input_event *key = &events[(*count)++];
+    key->type = EV_KEY;
+    key->code = code;
+    key->value = value;
+
+    struct input_event *syn = &events[(*count)++];
+    syn->type = EV_SYN;
+    syn->code = SYN_REPORT;
+    syn->value = 0;
+}
+
+static void append_codepoint(struct input_event *events, size_t *count, const UnicodeKeys *keys, uint32_t codepoint)
+{
+    append_key(events, count, KEY_LEFTCTRL, 1);
+    append_key(events, count, KEY_LEFTSHIFT, 1);
+    append_key(events, count, keys->u, 1);
+    append_key(events, count, keys->u, 0);
+    append_key(events, count, KEY_LEFTCTRL, 0);
+    append_key(events, count, KEY_LEFTSHIFT, 0);
+
+    unsigned int digits[UNICODE_SEQUENCE_MAX_DIGITS];
+    size_t digit_count = 0;
+    do {
+        digits[digit_count++] = codepoint & 0xF;
+        codepoint >>= 4;
+    } while (codepoint != 0);
+    while (digit_count > 0) {
+        unsigned int digit = digits[--digit_count];
+        bool shifted = (keys->shifted_digits >> digit) & 1u;
+        if (shifted) {
+            append_key(events, count, KEY_LEFTSHIFT, 1);
+        }
+        append_key(events, count, keys->digits[digit], 1);
+        append_key(events, count, keys->digits[digit], 0);
+        if (shifted) {
+            append_key(events, count, KEY_LEFTSHIFT, 0);
+        }
+    }
+
+    append_key(events, count, KEY_ENTER, 1);
+    append_key(events, count, KEY_ENTER, 0);
+}
+
+bool unicode_sequence_build(const char *utf8, const UnicodeKeys *keys, AccentSequence *sequence, Arena *arena,
+                            char *error, size_t error_size)
+{
+    if (!utf8 || !sequence) {
+        return false;
+    }
+    memset(sequence, 0, sizeof(*sequence));
+    if (!keys) {
+        keys = &unicode_keys_us;
+    }
+
+    size_t codepoints = 0;
+    size_t capacity = 0;
+    for (const char *cursor = utf8; *cursor;) {
+        uint32_t codepoint = 0;
+        size_t consumed = utf8_to_codepoint(cursor, &codepoint);
+        if (consumed == 0) {
+            snprintf(error, error_size, "invalid UTF-8 at byte %zu", (size_t)(cursor - utf8));
+            return false;
+        }
+        cursor += consumed;
+        codepoints++;
+        /* Every key event is followed by its own SYN_REPORT. */
+        size_t keys_pressed = UNICODE_SEQUENCE_FIXED_KEYS;
+        do {
+            keys_pressed += (keys->shifted_digits >> (codepoint & 0xF)) & 1u ? 4 : 2;
+        } while (codepoint >>= 4);
+        capacity += keys_pressed * 2;
+    }
+    if (codepoints == 0) {
+        snprintf(error, error_size, "empty variant");
+        return false;
+    }
+
+    struct input_event *events = arena_alloc(arena, capacity * sizeof(struct input_event));
+    if (!events) {
+        snprintf(error, error_size, "Out of memory");
+        return false;
+    }
+
+    size_t count = 0;
+    for (const char *cursor = utf8; *cursor;) {
+        uint32_t codepoint = 0;
+        cursor += utf8_to_codepoint(cursor, &codepoint);
+        append_codepoint(events, &count, keys, codepoint);
+    }
+
+    sequence->events = events;
+    sequence->event_count = count;
+    return true;
+}
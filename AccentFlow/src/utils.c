@@ -1,42 +1,11 @@
 #include "utils.h"
 
 #include <errno.h>
-#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-static void vprint_log(const char *prefix, const char *fmt, va_list args)
-{
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    struct tm tm;
-    localtime_r(&ts.tv_sec, &tm);
-
-    char buffer[64];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
-    fprintf(stderr, "%s.%03ld [%s] ", buffer, ts.tv_nsec / 1000000L, prefix);
-    vfprintf(stderr, fmt, args);
-    fputc('\n', stderr);
-}
-
-void log_info(const char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
-    vprint_log("INFO", fmt, args);
-    va_end(args);
-}
-
-void log_error(const char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
-    vprint_log("ERROR", fmt, args);
-    va_end(args);
-}
-
 char *read_file_to_buffer(const char *path, size_t *length)
 {
     FILE *fp = fopen(path, "rb");
@@ -95,3 +64,122 @@ char *duplicate_string(const char *src)
     memcpy(copy, src, len + 1);
     return copy;
 }
+
+uint64_t monotonic_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Decodes one code point and returns the number of bytes consumed, or 0 when
+ * the input is not valid UTF-8 (truncated, overlong, surrogate or > U+10FFFF). */
+size_t utf8_to_codepoint(const char *utf8, uint32_t *codepoint)
+{
+    if (!utf8 || !codepoint) {
+        return 0;
+    }
+    const unsigned char *s = (const unsigned char *)utf8;
+    if (s[0] < 0x80) {
+        *codepoint = s[0];
+        return s[0] ? 1 : 0;
+    }
+    if ((s[0] & 0xE0) == 0xC0) {
+        if ((s[1] & 0xC0) != 0x80) {
+            return 0;
+        }
+        uint32_t value = ((uint32_t)(s[0] & 0x1F) << 6) | (uint32_t)(s[1] & 0x3F);
+        if (value < 0x80) {
+            return 0;
+        }
+        *codepoint = value;
+        return 2;
+    }
+    if ((s[0] & 0xF0) == 0xE0) {
+        if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80) {
+            return 0;
+        }
+        uint32_t value = ((uint32_t)(s[0] & 0x0F) << 12) | ((uint32_t)(s[1] & 0x3F) << 6) | (uint32_t)(s[2] & 0x3F);
+        if (value < 0x800 || (value >= 0xD800 && value <= 0xDFFF)) {
+            return 0;
+        }
+        *codepoint = value;
+        return 3;
+    }
+    if ((s[0] & 0xF8) == 0xF0) {
+        if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80) {
+            return 0;
+        }
+        uint32_t value = ((uint32_t)(s[0] & 0x07) << 18) |
+                         ((uint32_t)(s[1] & 0x3F) << 12) |
+                         ((uint32_t)(s[2] & 0x3F) << 6) |
+                         (uint32_t)(s[3] & 0x3F);
+        if (value < 0x10000 || value > 0x10FFFF) {
+            return 0;
+        }
+        *codepoint = value;
+        return 4;
+    }
+    return 0;
+}
+
+size_t codepoint_to_utf8(uint32_t codepoint, char *out)
+{
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+int hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+uint32_t codepoint_upper_case(uint32_t codepoint)
+{
+    if ((codepoint >= 'a' && codepoint <= 'z') ||
+        (codepoint >= 0xe0 && codepoint <= 0xfe && codepoint != 0xf7) ||
+        (codepoint >= 0x3b1 && codepoint <= 0x3c9 && codepoint != 0x3c2) ||
+        (codepoint >= 0x430 && codepoint <= 0x44f)) {
+        return codepoint - 0x20;
+    }
+    if (codepoint >= 0x450 && codepoint <= 0x45f) {
+        return codepoint - 0x50;
+    }
+    if (codepoint == 0xff) {
+        return 0x178;
+    }
+    if ((codepoint >= 0x101 && codepoint <= 0x137 && (codepoint & 1) && codepoint != 0x131) ||
+        (codepoint >= 0x13a && codepoint <= 0x148 && !(codepoint & 1)) ||
+        (codepoint >= 0x14b && codepoint <= 0x177 && (codepoint & 1)) ||
+        (codepoint >= 0x17a && codepoint <= 0x17e && !(codepoint & 1))) {
+        return codepoint - 1;
+    }
+    return 0;
+}
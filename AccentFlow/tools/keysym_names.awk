@@ -0,0 +1,58 @@
+# Writes the keysym name table of src/keysym_names.h from X11/keysymdef.h and the vendor
+# headers next to it (XF86XK_AudioMute is named XF86AudioMute): every name with the code
+# point it types, 0 for keys that type none (BackSpace, Shift_L, dead keys). Names sharing
+# a keysym value share its code point, so deprecated aliases resolve too.
+# Run through `make keysym-names`; the output is sorted there.
+
+function hex(text,    i, c, value) {
+    value = 0
+    text = tolower(text)
+    sub(/^0x/, "", text)
+    for (i = 1; i <= length(text); ++i) {
+        c = index("0123456789abcdef", substr(text, i, 1))
+        if (c == 0) {
+            break
+        }
+        value = value * 16 + c - 1
+    }
+    return value
+}
+
+/^#define[ \t]+[A-Za-z0-9]*XK_[A-Za-z0-9_]+[ \t]+(0x[0-9a-fA-F]+|_EVDEVK\(0x[0-9a-fA-F]+\))/ {
+    name = $2
+    sub(/XK_/, "", name)
+    if ($3 ~ /^_EVDEVK/) {
+        value = 268963840 + hex(substr($3, 9)) # 0x10081000, XF86keysym.h's _EVDEVK
+    } else {
+        value = hex($3)
+    }
+    names[++count] = name
+    values[count] = value
+    # The XFree86 server actions (0x1008FExx) are written XF86_Switch_VT_1 in layouts.
+    if (name ~ /^XF86/ && value >= 269024768 && value <= 269025023) {
+        names[++count] = "XF86_" substr(name, 5)
+        values[count] = value
+    }
+    if (match($0, /\/\* U\+[0-9A-Fa-f]+ /)) {
+        codepoints[value] = hex(substr($0, RSTART + 5, RLENGTH - 6))
+    }
+}
+
+END {
+    for (i = 1; i <= count; ++i) {
+        value = values[i]
+        if (value in codepoints) {
+            codepoint = codepoints[value]
+        } else if ((value >= 32 && value < 127) || (value >= 160 && value <= 255)) {
+            codepoint = value
+        } else if (value >= 16777472 && value <= 17891327) {
+            codepoint = value - 16777216
+        } else {
+            codepoint = 0
+        }
+        if (!(names[i] in seen)) {
+            seen[names[i]] = 1
+            printf "    {\"%s\", 0x%04x},\n", names[i], codepoint
+        }
+    }
+}